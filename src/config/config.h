@@ -7,10 +7,24 @@
 #define HW_UART_SPEED 115200L
 
 //
-// 5 second timeout to reset the board
+// telnet log console (see telnetConsole.h)
+//
+
+#define TELNET_PORT 23
+#define TELNET_MAX_CLIENTS 3
+#define TELNET_CLIENT_BUFFER_SIZE 2048		// per client, must be a power of two
+#define TELNET_STALLED_TIMEOUT_MS 10000		// disconnect clients stalled for this long
+
+//
+// 5 second timeout to reset the board, default for every task registered
+// with the watchdog (see watchdog.h)
 //
 
 #define WATCHDOG_TIMEOUT 5000
+#define WATCHDOG_MAX_TASKS 8
+#define WATCHDOG_CHECK_INTERVAL_MS 1000
+#define WATCHDOG_HW_TASK_WDT true			// the watchdog task itself is guarded by the hardware task WDT
+#define WATCHDOG_HW_TIMEOUT_S 10
 
 //
 // Timeout for the WiFi connection. When this is reached,
@@ -28,31 +42,85 @@
 //
 
 #define NTP_TIME_SYNC_ENABLED true
-#define NTP_SERVER "pool.ntp.org"
-#define NTP_OFFSET_SECONDS 3600
-#define NTP_UPDATE_INTERVAL_MS (5 * 60 * 1000)
+#define NTP_SERVERS { "pool.ntp.org", "time.google.com", "time.cloudflare.com" }
+#define NTP_MAX_SERVERS 4						// room for this many NTP_SERVERS
+#define NTP_LOCAL_PORT 2390
+#define NTP_DNS_TIMEOUT_MS 2000				// a server name not resolved in time is queried at its last address
+#define NTP_QUERY_TIMEOUT_MS 1000
+#define NTP_OUTLIER_MS 100						// servers further than this from the median are rejected
+#define TIMEZONE "CET-1CEST,M3.5.0,M10.5.0/3"	// POSIX TZ string, see timezone.h
+#define NTP_UPDATE_INTERVAL_MS (5 * 60 * 1000)			// shortest interval between updates
+#define NTP_UPDATE_INTERVAL_MAX_MS (4 * 60 * 60 * 1000)	// longest interval once the drift is learned
+#define NTP_RESTORE_MIN_UTC_S 1609459200		// RTC time after a reset is taken over if later than this (2021-01-01)
+
+//
+// Weekly bell/alarm timetable (see schedule.h), requires NTP time sync
+//
+
+#define SCHEDULER_ENABLED true
+#define SCHEDULE_FILENAME "/schedule.dat"
+#define SCHEDULE_MAX_RULES 32
+#define SCHEDULE_MAX_SLEEP_MS (5 * 60 * 1000)	// recheck the local clock at least this often
+#define SCHEDULE_MAX_LATE_MS (5 * 60 * 1000)	// events missed by more than this are skipped
+
+//
+// Clock discipline (see clockDiscipline.h)
+//
+
+#define CLOCK_SLEW_RATE_PPM 500				// maximum rate offsets are slewed in with
+#define CLOCK_STEP_THRESHOLD_MS 1000		// larger offsets are stepped
+#define CLOCK_MAX_FREQ_PPM 500				// maximum expected crystal error
+#define CLOCK_FREQ_RESOLUTION_PPM 20		// required resolution of a frequency sample
+#define CLOCK_FREQ_AVERAGING 4				// averaging factor of frequency samples
+#define CLOCK_GOOD_OFFSET_MS 20				// offsets below this double the update interval
+#define CLOCK_BAD_OFFSET_MS 200				// offsets above this halve the update interval
 
 //
 // Wifi related settings
 //
 
-#define ESPASYNC_WIFIMGR_DEBUG_PORT SERIAL
+#define ESPASYNC_WIFIMGR_DEBUG_PORT Serial
 #define _ESPASYNC_WIFIMGR_LOGLEVEL_ 2		// Use from 0 to 4. Higher number, more debugging messages and memory usage.
 #define DOUBLERESETDETECTOR_DEBUG true		// double reset detector enabled
 #define DRD_TIMEOUT 10						// Number of seconds after reset during which a subseqent reset will be considered a double reset.
-#define DRD_ADDRESS 0						// RTC Memory Address for the DoubleResetDetector to use
+#define DRD_ADDRESS 0						// EEPROM address of the DoubleResetDetector flag
 #define HEARTBEAT_INTERVAL 10000
 #define MIN_AP_PASSWORD_SIZE 8
 #define SSID_MAX_LEN 32
 #define PASS_MAX_LEN 64
-#define WIFICHECK_INTERVAL 1000L
-#define CONFIG_FILENAME F("/wifi_cred.dat")
+#define WIFI_BACKOFF_MIN_MS 1000L				// first retry after a failed connection attempt
+#define WIFI_BACKOFF_MAX_MS (5 * 60 * 1000L)	// retry interval doubles up to this
+#define WIFI_ROAM_ENABLED true
+#define WIFI_ROAM_SCAN_INTERVAL_MS 60000L		// background scan interval while the link is weak
+#define WIFI_ROAM_RSSI_THRESHOLD -70			// links weaker than this (dBm) look for a better BSSID
+#define WIFI_ROAM_HYSTERESIS_DB 8				// a new BSSID has to be this much stronger
+#define WIFI_ROAM_SCAN_MS_PER_CHAN 120			// passive scan dwell time
+#define WIFI_SCAN_MS_PER_CHAN 120				// active scan dwell time of the targeted scan
+#define WIFI_SCAN_CACHE_SIZE 16					// access points of known networks remembered
+#define WIFI_SCAN_CACHE_MAX_AGE_MS (60 * 60 * 1000L)	// cached access points are forgotten after this
+#define WIFI_FAST_AUTH_DEADLINE_MS 1500			// the last BSSID has to associate this fast, or a scan takes over
+#define WIFI_SCAN_GOOD_SCORE -67				// the targeted scan stops at the first candidate scoring this (dBm less history penalties)
+#define WIFI_HISTORY_SIZE 8						// access points remembered in the connection history (see WiFiHistory.h)
+#define WIFI_HISTORY_WEIGHT 4					// a new sample counts 1/4 in the moving averages
+#define WIFI_HISTORY_FAIL_PENALTY_DB 20			// at 100% failed attempts
+#define WIFI_HISTORY_CONNECT_MS_PER_DB 250		// 1 dB per 250 ms time to connect...
+#define WIFI_HISTORY_CONNECT_PENALTY_DB 10		// ...up to 10 dB
+#define WIFI_HISTORY_SHORT_SESSION_S 600		// sessions shorter than this are penalized...
+#define WIFI_HISTORY_SESSION_PENALTY_DB 10		// ...up to 10 dB for a session of 0 s
+#define WIFI_HISTORY_MIN_ATTEMPTS 3				// attempts before fast reconnect may be refused
+#define WIFI_HISTORY_FAST_MAX_FAIL_PERMILLE 500	// no fast reconnect to access points failing more often
+#define CONFIG_FILENAME F("/wifi_cred.dat")				// legacy SPIFFS files, migrated to the config store
 #define LAST_PARAMS_FILENAME F("/wifi_last_params.dat")
+#define LAST_LEASE_FILENAME F("/wifi_last_lease.dat")
+#define WIFI_DEFAULT_LEASE_S 3600			// if the DHCP server's lease time can't be read
+#define WIFI_PORTAL_STACK_SIZE 8192			// the configuration portal runs in a task of its own
+#define WIFI_DRD_PORTAL_TIMEOUT_S 600		// the portal of a double reset closes after this if WiFi is configured, the station is retried then
 #define USING_CORS_FEATURE false
 #define USE_DHCP_IP true
 #define USE_CONFIGURABLE_DNS true
 #define USE_CUSTOM_AP_IP false
-#define ESP_DRD_USE_SPIFFS true
+#define ESP_DRD_USE_SPIFFS false
+#define ESP_DRD_USE_EEPROM true				// the double reset flag lives in NVS, SPIFFS isn't mounted at boot
 #define HOST_NAME_LEN 40
 #define HTTP_PORT 80
 #define RESET_WHEN_RECONFIGURING_WIFI 0		// set to 1 to reconfigure wifi via esp32 reset
@@ -76,10 +144,94 @@
 #define WIFI_MULTI_CONNECT_WAITING_MS 500L
 
 //
-// Periodic reset every 24 hours
+// Health monitor (see healthMonitor.h), the board is rebooted only
+// when one of these thresholds is crossed
+//
+
+#define HEALTH_INTERVAL_MS 60000
+#define HEALTH_TREND_SIZE 60					// one hour of samples
+#define HEALTH_UNHEALTHY_SAMPLES 3				// consecutive samples before a reboot
+#define HEALTH_MIN_FREE_HEAP 16384
+#define HEALTH_MIN_LARGEST_BLOCK 8192
+#define HEALTH_RECONNECT_WINDOW 15				// samples the reconnect failure rate is computed over
+#define HEALTH_MIN_RECONNECT_FAILURES 5
+#define HEALTH_MAX_RECONNECT_FAIL_PERCENT 80
+
+//
+// WiFi modem sleep (see powerManager.h)
+//
+
+#define POWER_MODE POWER_MODE_ADAPTIVE			// POWER_MODE_PERFORMANCE, POWER_MODE_ADAPTIVE or POWER_MODE_SAVING
+#define POWER_LATENCY_BUDGET_MS 300				// wake-up latency accepted while the modem sleeps
+#define POWER_BEACON_INTERVAL_MS 102			// 100 TU, the usual beacon interval of access points
+#define POWER_IDLE_MS 10000						// stay awake this long after the last request
+#define POWER_CHECK_INTERVAL_MS 250				// beeper state polling
+#define POWER_PROBE_INTERVAL_MS 30000			// gateway round trip probes
+
+//
+// Compile-time log levels per module (see logLevel.h).
+// Messages above these levels are removed from the build.
+//
+
+#define LOG_LEVEL_MAIN		LOG_LEVEL_INFO
+#define LOG_LEVEL_WIFI		LOG_LEVEL_INFO
+#define LOG_LEVEL_SERVER	LOG_LEVEL_INFO
+#define LOG_LEVEL_NTP		LOG_LEVEL_INFO
+#define LOG_LEVEL_OTA		LOG_LEVEL_INFO
+#define LOG_LEVEL_WATCHDOG	LOG_LEVEL_INFO
+#define LOG_LEVEL_CONFIG	LOG_LEVEL_INFO
+#define LOG_LEVEL_SCHED		LOG_LEVEL_INFO
+#define LOG_LEVEL_POWER		LOG_LEVEL_INFO
+#define LOG_LEVEL_HEALTH	LOG_LEVEL_INFO
+#define LOG_LEVEL_SYSLOG	LOG_LEVEL_INFO
+
+//
+// Post-mortem log in RTC memory (see postmortem.h)
+//
+
+#define POSTMORTEM_NUM_RECORDS 32
+#define POSTMORTEM_RECORD_SIZE 80
+
+//
+// Versioned configuration records in NVS (see configStore.h)
+//
+
+#define CONFIG_NVS_NAMESPACE "config"
+#define CONFIG_MAX_RECORD_SIZE 4000			// NVS blobs of up to ~4000 bytes fit a single page
+
+//
+// Boot timeline in RTC memory (see bootTrace.h)
+//
+
+#define BOOT_TRACE_MAX_SPANS 32
+#define BOOT_TRACE_NAME_LEN 16
+
+//
+// UDP syslog log shipping (see syslogClient.h)
+//
+
+#define SYSLOG_ENABLED false
+#define SYSLOG_SERVER "192.168.2.10"
+#define SYSLOG_PORT 514
+#define SYSLOG_BUFFER_SIZE 4096				// must be a power of two
+#define SYSLOG_FLUSH_BYTES 1024				// the sender wakes up once this much is queued
+#define SYSLOG_FLUSH_INTERVAL_MS 1000
+
+//
+// Task CPU/stack profiler (see taskProfiler.h)
+//
+
+#define PROFILER_ENABLED true
+#define PROFILER_INTERVAL_MS 10000
+#define PROFILER_MAX_TASKS 24
+
+//
+// Binary (deferred format) logging used on hot paths, see binlog.h.
+// Buffer size is in bytes and must be a power of two.
 //
 
-#define PERIODIC_RESET_TIMEOUT (24 * 60 * 60 * 1000)
+#define BINLOG_ENABLED true
+#define BINLOG_BUFFER_SIZE 4096
 
 //
 // color macros
@@ -12,31 +12,83 @@
 #include "config.h"
 #include "SerialAndTelnetInit.h"
 #include "watchdog.h"
+#include "wifiTask.h"
 #include "serverTask.h"
 #include "ntpTask.h"
 #include "otaTask.h"
 #include "beeperTask.h"
+#include "schedulerTask.h"
+#include "postmortem.h"
+#include "syslogClient.h"
+#include "taskProfiler.h"
+#include "healthMonitor.h"
+#include "bootTrace.h"
+#include "configStore.h"
+#include "readiness.h"
+#include "powerManager.h"
 
 void setup()
 {
+	// grab the previous boot's timeline and post-mortem log before
+	// anything is recorded
+	bootTraceInit();
+	bootTraceMark("setup");
+	postmortemInit();
+
+	// tasks started from here on may wait for readiness bits
+	readinessInit();
+
 	//
 	// make sure wifi is initialized before calling anything else
 	//
 
+	int8_t span = bootTraceBegin("wifiMode");
 	WiFi.mode(WIFI_OFF);
 	WiFi.mode(WIFI_MODE_STA);
+
+	// awake while connecting, the power manager takes over once connected
 	WiFi.setSleep(false);
+	bootTraceEnd(span);
 
 	// init serial/telnet
+	span = bootTraceBegin("serial");
 	SerialAndTelnetInit::init();
+	bootTraceEnd(span);
+
+	span = bootTraceBegin("services");
+
+	// config store locking, records are read on demand
+	configStoreInit();
+
+	// init syslog shipping
+	syslogInit();
 
 	// init watchdog
 	watchdogInit();
 
+	// init timetable locking, rules are loaded by the task
+	schedulerInit();
+
+	// per-task CPU usage and stack statistics
+	profilerInit();
+
+	// reboot policy based on heap, sockets and reconnect failures
+	healthInit();
+
+	// modem sleep while idle
+	powerInit();
+
+	// bell, alarm and reboot before any portal takes the web server
+	serverInit();
+
+	bootTraceEnd(span);
+
 #if	(BUILD_PICO_STAMP == 0)
 	// Init M5Atom
+	span = bootTraceBegin("m5");
 	M5.begin(false, true, true);
 	delay(10);
+	bootTraceEnd(span);
 #endif
 
 #if 0
@@ -44,6 +96,8 @@ void setup()
 	while (!Serial) {};
 #endif
 
+	span = bootTraceBegin("startTasks");
+
 	//
 	// start beeper task
 	//
@@ -71,12 +125,13 @@ void setup()
 		ARDUINO_RUNNING_CORE);
 
 	//
-	// Connect to WiFi & keep the connection alive.
+	// start the server task, it serves the configuration portal's
+	// neighbours until the network is up and its pages after that
 	//
 
 	xTaskCreatePinnedToCore(
-		wifiTask,
-		"wifiTask", // Task name
+		serverTask,
+		"serverTask",	 // Task name
 		8192,			 // Stack size (bytes)
 		NULL,			 // Parameter
 		2,				 // Task priority
@@ -84,27 +139,23 @@ void setup()
 		ARDUINO_RUNNING_CORE);
 
 	//
-	// wait for connection
-	//
-
-	wifiWaitForConnection();
-
-	//
-	// now start the server task and NTP task
+	// Connect to WiFi & keep the connection alive.
 	//
 
 	xTaskCreatePinnedToCore(
-		serverTask,
-		"serverTask",	 // Task name
+		wifiTask,
+		"wifiTask", // Task name
 		8192,			 // Stack size (bytes)
 		NULL,			 // Parameter
 		2,				 // Task priority
 		NULL,			 // Task handle
 		ARDUINO_RUNNING_CORE);
 
+	bootTraceEnd(span);
+
 #if NTP_TIME_SYNC_ENABLED == true
 	//
-	// Update time from NTP server.
+	// Update time from NTP server, the task waits for the network itself.
 	//
 
 	xTaskCreate(
@@ -115,6 +166,21 @@ void setup()
 		1,	  // Task priority
 		NULL  // Task handle
 	);
+
+#if SCHEDULER_ENABLED == true
+	//
+	// Ring the bell by the timetable.
+	//
+
+	xTaskCreatePinnedToCore(
+		schedulerTask,
+		"schedulerTask", // Task name
+		4096,			 // Stack size (bytes)
+		NULL,			 // Parameter
+		1,				 // Task priority
+		NULL,			 // Task handle
+		ARDUINO_RUNNING_CORE);
+#endif
 #endif
 }
 
@@ -131,6 +197,7 @@ void __assert(const char *__func, const char *__file, int __lineno, const char *
 	SERIAL.println(__file);
 	SERIAL.println(__lineno, DEC);
 	SERIAL.println(__sexp);
+	postmortemSetResetCause(__sexp);
 	SERIAL.flush();
 	// abort program execution.
 	abort();
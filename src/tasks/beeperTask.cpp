@@ -5,6 +5,8 @@
 #include "button.h"
 #include "beeperTask.h"
 #include "utils.h"
+#include "watchdog.h"
+#include "taskProfiler.h"
 
 //
 // ring melody
@@ -60,14 +62,16 @@ public:
 	unsigned int m_notePos = 0;
 	int m_repeatCnt = 0;
 
-	bool m_bellOn;
-	bool m_alarmOn;
+	// BeeperSource masks of the pending requests
+	volatile uint8_t m_bellOn;
+	volatile uint8_t m_alarmOn;
+	portMUX_TYPE m_requestMux = portMUX_INITIALIZER_UNLOCKED;
 
 	Button m_bellButton;
 	
 	BeeperContext()
-	: m_bellOn(false)
-	, m_alarmOn(false)
+	: m_bellOn(0)
+	, m_alarmOn(0)
 	, m_bellButton(INPUT_BELL_PIN, true, 10)
 	{
 	}
@@ -99,14 +103,30 @@ public:
 		setNote(-1);
 	}
 	
-	void alarmOn(const bool &on)
+	void request(volatile uint8_t &requests, const bool &on, const BeeperSource &source)
 	{
-		m_alarmOn = on;
+		portENTER_CRITICAL(&m_requestMux);
+		if (on) {
+			requests |= source;
+		} else {
+			requests &= (source == BEEPER_MANUAL) ? 0 : ~source;
+		}
+		portEXIT_CRITICAL(&m_requestMux);
+	}
+
+	void alarmOn(const bool &on, const BeeperSource &source)
+	{
+		request(m_alarmOn, on, source);
 	}
 
-	void bellOn(const bool &on)
+	void bellOn(const bool &on, const BeeperSource &source)
 	{
-		m_bellOn = on;
+		request(m_bellOn, on, source);
+	}
+
+	bool idle() const
+	{
+		return !m_bellOn && !m_alarmOn && !m_bellRunning && !m_alarmRunning;
 	}
 
 	void setNote(int note)
@@ -114,7 +134,7 @@ public:
 		static int lastNote = -1;
 
 		if (note != lastNote) {
-			LOG_PRINTF("Setting note %d\n", note);
+			LOG_BINARY("Setting note %d\n", note);
 			lastNote = note;
 
 			if (note < 0) {
@@ -143,8 +163,8 @@ public:
 			bellPressed = false;
 		}
 
-		alarmPressed |= m_alarmOn;
-		bellPressed |= m_bellOn;
+		alarmPressed |= m_alarmOn != 0;
+		bellPressed |= m_bellOn != 0;
 
 		static bool prevBellPressed = false;
 		static bool prevAlarmPressed = false;
@@ -152,13 +172,13 @@ public:
 		if (bellPressed != prevBellPressed)
 		{
 			prevBellPressed = bellPressed;
-			LOG_PRINTF("Bell button %s\n", bellPressed ? "pressed" : "released");
+			LOG_BINARY("Bell button %s\n", bellPressed ? "pressed" : "released");
 		}
 
 		if (alarmPressed != prevAlarmPressed)
 		{
 			prevAlarmPressed = alarmPressed;
-			LOG_PRINTF("Alarm button %s\n", alarmPressed ? "pressed" : "released");
+			LOG_BINARY("Alarm button %s\n", alarmPressed ? "pressed" : "released");
 		}
 
 		//
@@ -334,9 +354,12 @@ public:
 	void task()
 	{
 		init();
+		watchdogRegister();
+		profilerRegister();
 
 		while (1) {
 			processTone();
+			watchdogReset();
 			delay(10);
 		}
 	}
@@ -349,13 +372,18 @@ void beeperTask(void *pvParameters __attribute__((unused)))
 	g_ctx.task();
 }
 
-void beeperAlarmOn(const bool &on)
+void beeperAlarmOn(const bool &on, const BeeperSource &source)
+{
+	g_ctx.alarmOn(on, source);
+}
+
+void beeperBellOn(const bool &on, const BeeperSource &source)
 {
-	g_ctx.alarmOn(on);
+	g_ctx.bellOn(on, source);
 }
 
-void beeperBellOn(const bool &on)
+bool beeperIsIdle()
 {
-	g_ctx.bellOn(on);
+	return g_ctx.idle();
 }
 
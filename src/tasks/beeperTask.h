@@ -1,5 +1,14 @@
 #pragma once
 
+// who asked for the bell/alarm; it sounds while anyone does
+enum BeeperSource {
+	BEEPER_MANUAL = 0x01,		// HTTP, turning it off silences every source
+	BEEPER_SCHEDULE = 0x02,		// the timetable, turning it off drops its own request only
+};
+
 void beeperTask(void *pvParameters __attribute__((unused)));
-void beeperAlarmOn(const bool &on);
-void beeperBellOn(const bool &on);
+void beeperAlarmOn(const bool &on, const BeeperSource &source = BEEPER_MANUAL);
+void beeperBellOn(const bool &on, const BeeperSource &source = BEEPER_MANUAL);
+
+// no bell or alarm is sounding or requested
+bool beeperIsIdle();
@@ -92,7 +92,7 @@ void advanceLedBlink()
 void ledTask(void *pvParameters __attribute__((unused)))
 {
 #if	BUILD_PICO_STAMP
-	LOG_PRINTF("M5Stamp initializing...OK\n");
+	LOG_INFO(MAIN, "M5Stamp initializing...OK\n");
 
 	// RBG led
 	FastLED.addLeds<SK6812, DATA_PIN, RGB>(g_ctx.m_leds, NUM_LEDS);
@@ -108,7 +108,7 @@ void ledTask(void *pvParameters __attribute__((unused)))
 			setLedColor(COLOR_RED, true);
 
 			if (!wifiReconnect()) {
-				LOG_PRINTF("Failed to reconnect, restarting board!\n");
+				LOG_ERROR(MAIN, "Failed to reconnect, restarting board!\n");
 				ESP.restart();
 			} else {
 				// we have reconnected successfully
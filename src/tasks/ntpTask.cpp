@@ -1,57 +1,171 @@
 #include <Arduino.h>
-#include <WiFiUdp.h>
-#include <NTPClient.h>
+#include <sys/time.h>
 #include "utils.h"
 #include "config.h"
 #include "ntpTask.h"
+#include "clockDiscipline.h"
+#include "sntpClient.h"
+#include "timezone.h"
+#include "readiness.h"
+#include "seqLock.h"
 #include "../tasks/wifiTask.h"
 
-static WiFiUDP ntpUDP;
+static SntpClient g_sntp;
+static ClockDiscipline g_discipline;
+static Timezone g_timezone;
 
-// TODO: this does not take timezones into account! Only UTC for now.
-static NTPClient timeClient(ntpUDP, NTP_SERVER, NTP_OFFSET_SECONDS, NTP_UPDATE_INTERVAL_MS);
-static SemaphoreHandle_t g_mutex = xSemaphoreCreateMutex();
-static unsigned long g_lastEpochTime = 0;
-static uint32_t g_lastEpochMillis = 0;
+//
+// Clock state, published with a sequence lock so compensatedMillis() never
+// blocks and can be called from any task or ISR.
+//
+
+struct ClockSnapshot {
+	ClockDiscipline::State m_clock;
+	Timezone::Window m_timezone;
+	bool m_synced = false;		// wall time known
+	bool m_restored = false;	// from the RTC, not synchronized yet
+};
+
+static SeqLock<ClockSnapshot> g_clockState;
+static portMUX_TYPE g_clockMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void publishClockState(const ClockSnapshot &state)
+{
+	// interrupts are disabled on this core while the sequence is odd,
+	// so a reader can only spin while the other core is writing
+	portENTER_CRITICAL(&g_clockMux);
+	g_clockState.write(state);
+	portEXIT_CRITICAL(&g_clockMux);
+}
+
+static ClockSnapshot readClockState()
+{
+	return g_clockState.read();
+}
+
+// The system time is kept on the RTC across a reset (not a power loss), so
+// a reboot during a network outage still knows the time. It is off by the
+// drift of the RTC slow clock since the last synchronization, good enough
+// to keep ringing the timetable until NTP is back.
+static void restoreClockState()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	if (tv.tv_sec < NTP_RESTORE_MIN_UTC_S) {
+		LOG_INFO(NTP, "[NTP] No time to restore, waiting for synchronization\n");
+		return;
+	}
+
+	ClockSnapshot state;
+	state.m_clock.m_localBaseUs = esp_timer_get_time();
+	state.m_clock.m_wallBaseUs = tv.tv_sec * 1000000LL + tv.tv_usec;
+	state.m_timezone = g_timezone.window(state.m_clock.m_wallBaseUs / 1000);
+	state.m_synced = true;
+	state.m_restored = true;
+	publishClockState(state);
+	readinessSet(READY_TIME_SYNCED);
+
+	LOG_WARN(NTP, "[NTP] Restored time from the RTC: %s\n", msToTimeStr(compensatedMillis()));
+}
+
+// keep the RTC up to date for restoreClockState()
+static void saveClockState(const ClockSnapshot &state)
+{
+	int64_t wallUs = ClockDiscipline::wallUs(state.m_clock, esp_timer_get_time());
+	struct timeval tv;
+	tv.tv_sec = wallUs / 1000000;
+	tv.tv_usec = wallUs % 1000000;
+	settimeofday(&tv, NULL);
+}
 
 void fetchTimeFromNTP(void * parameter)
 {
-	// wait until the network is connected
-	wifiWaitForConnection();
+	if (!g_timezone.parse(TIMEZONE)) {
+		LOG_ERROR(NTP, "[NTP] Invalid timezone \"%s\", using UTC\n", TIMEZONE);
+	}
+
+	restoreClockState();
+
+	// after a failed update, doubles with every further failure; the
+	// regular interval may be hours once the drift is learned
+	uint32_t retryMs = NTP_UPDATE_INTERVAL_MS;
 
 	while (1) {
-		LOG_PRINTF("[NTP] Updating...\n");
-		timeClient.update();
-
-		// atomically update last epoch time and millis() reference
-		if (xSemaphoreTake(g_mutex, portMAX_DELAY) == pdTRUE) {
-			g_lastEpochTime = timeClient.getEpochTime();
-			g_lastEpochMillis = millis();
-			xSemaphoreGive(g_mutex);
+		// stay suspended while the network is down
+		wifiWaitForConnection();
+
+		LOG_DEBUG(NTP, "[NTP] Updating...\n");
+
+		SntpSample sample;
+		bool updated = g_sntp.query(sample);
+		if (updated) {
+			// the error of a sample is at most half of its round trip delay
+			int64_t precisionUs = max(sample.m_delayUs / 2, 1000LL);
+
+			g_discipline.sample(sample.m_localUs + sample.m_offsetUs, sample.m_localUs, precisionUs);
+
+			LOG_INFO(NTP, "[NTP] %s: delay %lld ms, offset %lld ms, frequency %d ppb, next update in %u s\n",
+				g_sntp.serverName(sample.m_server),
+				sample.m_delayUs / 1000,
+				g_discipline.lastOffsetUs() / 1000,
+				g_discipline.state().m_freqPpb,
+				g_discipline.intervalMs() / 1000);
+			retryMs = NTP_UPDATE_INTERVAL_MS;
+		} else {
+			LOG_WARN(NTP, "[NTP] Update failed, retrying in %u s\n", min(retryMs, g_discipline.intervalMs()) / 1000);
 		}
 
-		String timestring = timeClient.getFormattedTime();
-		short tIndex = timestring.indexOf("T");
-		LOG_PRINTF("NTP time: %s\n", timestring.substring(tIndex + 1, timestring.length() -3).c_str());
+		if (g_discipline.synced()) {
+			// refresh the timezone window, updates are frequent enough
+			// to never miss more than one transition
+			ClockSnapshot state;
+			state.m_clock = g_discipline.state();
+			state.m_timezone = g_timezone.window(ClockDiscipline::wallUs(state.m_clock, esp_timer_get_time()) / 1000);
+			state.m_synced = true;
+			publishClockState(state);
+			saveClockState(state);
+			readinessSet(READY_TIME_SYNCED);
+		}
+
+		LOG_INFO(NTP, "NTP time: %s\n", msToTimeStr(compensatedMillis()));
 
-		// Sleep for a minute before checking again
-		longDelay(NTP_UPDATE_INTERVAL_MS);
+		// sleep until the next update
+		uint32_t sleepMs = g_discipline.intervalMs();
+		if (!updated) {
+			sleepMs = min(retryMs, sleepMs);
+			retryMs = (retryMs < NTP_UPDATE_INTERVAL_MAX_MS / 2) ? retryMs * 2 : NTP_UPDATE_INTERVAL_MAX_MS;
+		}
+		longDelay(sleepMs);
 	}
 }
 
-uint64_t compensatedMillis()
+uint64_t compensatedUtcMillis()
 {
-	unsigned long lastEpochTime = 0;
-	uint32_t lastEpochMillis;
+	ClockSnapshot state = readClockState();
+	return ClockDiscipline::wallUs(state.m_clock, esp_timer_get_time()) / 1000;
+}
 
-	if (xSemaphoreTake(g_mutex, portMAX_DELAY) == pdTRUE) {
-		lastEpochTime = g_lastEpochTime;
-		lastEpochMillis = g_lastEpochMillis;
-		xSemaphoreGive(g_mutex);
+uint64_t compensatedMillis()
+{
+	ClockSnapshot state = readClockState();
+	int64_t utcMs = ClockDiscipline::wallUs(state.m_clock, esp_timer_get_time()) / 1000;
 
-		// conversion
-		return (uint64_t)lastEpochTime * 1000 + (millis() - lastEpochMillis);
-	} else {
-		return 0;
+	// time since boot until synchronized
+	if (!state.m_synced) {
+		return utcMs;
 	}
+
+	return Timezone::toLocalMs(state.m_timezone, utcMs);
+}
+
+bool ntpTimeSynced()
+{
+	ClockSnapshot state = readClockState();
+	return state.m_synced && !state.m_restored;
+}
+
+int64_t ntpNextTransitionMs()
+{
+	ClockSnapshot state = readClockState();
+	return state.m_synced ? state.m_timezone.m_nextTransitionMs : INT64_MAX;
 }
@@ -5,4 +5,16 @@
 //
 
 void fetchTimeFromNTP(void *pvParameters __attribute__((unused)));
+
+// local time (per TIMEZONE) in ms since epoch, time since boot until synchronized
 uint64_t compensatedMillis();
+
+// UTC time in ms since epoch
+uint64_t compensatedUtcMillis();
+
+// synchronized by NTP; false while the time restored after a reset is used
+bool ntpTimeSynced();
+
+// UTC ms of the next timezone transition, local time jumps there;
+// INT64_MAX if none is known
+int64_t ntpNextTransitionMs();
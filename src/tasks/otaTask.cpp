@@ -4,13 +4,18 @@
 
 #include "utils.h"
 #include "watchdog.h"
+#include "taskProfiler.h"
 #include "wifiTask.h"
+#include "readiness.h"
+#include "powerManager.h"
 
 void otaTask(void * parameter)
 {
 	// wait until the network is connected
 	wifiWaitForConnection();
-	LOG_PRINTF("WiFi available, initializing OTA service\n");
+	watchdogRegister();
+	profilerRegister();
+	LOG_INFO(OTA, "WiFi available, initializing OTA service\n");
 
 	//
 	// arduino ota
@@ -25,27 +30,29 @@ void otaTask(void * parameter)
 				type = "filesystem";
 
 			// NOTE: if updating SPIFFS this would be the place to unmount SPIFFS using SPIFFS.end()
-			LOG_PRINTF("Start updating %s\n", type.c_str());
+			LOG_INFO(OTA, "Start updating %s\n", type.c_str());
+			powerNotifyActivity();
 		})
 		.onEnd([](){
-			LOG_PRINTF("\nEnd");
+			LOG_INFO(OTA, "\nEnd");
 		})
 		.onProgress([](unsigned int progress, unsigned int total) {
 			static int lastProgressPercent = -1;
 			int progressPercent = (progress / (total / 100));
 			if (progressPercent != lastProgressPercent) {
 				lastProgressPercent = progressPercent;
-				LOG_PRINTF("Progress: %u%%\r", progressPercent);
+				LOG_INFO(OTA, "Progress: %u%%\r", progressPercent);
 			}
+			powerNotifyActivity();
 			watchdogReset();
 		})
 		.onError([](ota_error_t error) {
-			LOG_PRINTF("Error[%u]: ", error);
-			if (error == OTA_AUTH_ERROR) LOG_PRINTF("Auth Failed\n");
-			else if (error == OTA_BEGIN_ERROR) LOG_PRINTF("Begin Failed\n");
-			else if (error == OTA_CONNECT_ERROR) LOG_PRINTF("Connect Failed\n");
-			else if (error == OTA_RECEIVE_ERROR) LOG_PRINTF("Receive Failed\n");
-			else if (error == OTA_END_ERROR) LOG_PRINTF("End Failed\n");
+			LOG_ERROR(OTA, "Error[%u]: ", error);
+			if (error == OTA_AUTH_ERROR) LOG_ERROR(OTA, "Auth Failed\n");
+			else if (error == OTA_BEGIN_ERROR) LOG_ERROR(OTA, "Begin Failed\n");
+			else if (error == OTA_CONNECT_ERROR) LOG_ERROR(OTA, "Connect Failed\n");
+			else if (error == OTA_RECEIVE_ERROR) LOG_ERROR(OTA, "Receive Failed\n");
+			else if (error == OTA_END_ERROR) LOG_ERROR(OTA, "End Failed\n");
 		});
 
 	ArduinoOTA.setHostname(wifiHostName().c_str());
@@ -53,8 +60,15 @@ void otaTask(void * parameter)
 	ArduinoOTA.begin();
 
 	while (1) {
+		// stay suspended while the network is down
+		while (!wifiIsConnected()) {
+			watchdogReset();
+			readinessWait(READY_NETWORK_UP, WATCHDOG_TIMEOUT / 2);
+		}
+
 		// handle OTA support
 		ArduinoOTA.handle();
+		watchdogReset();
 		delay(100);
 	}
 }
@@ -0,0 +1,334 @@
+#include <Arduino.h>
+#include <SPIFFS.h>
+
+#include "config.h"
+#include "utils.h"
+#include "schedule.h"
+#include "schedulerTask.h"
+#include "beeperTask.h"
+#include "ntpTask.h"
+#include "watchdog.h"
+#include "readiness.h"
+#include "configStore.h"
+
+#define SCHEDULE_MAGIC 0x31444353	// "SCD1"
+
+struct ScheduleFileHeader {
+	uint32_t m_magic;
+	uint8_t m_numRules;
+	uint8_t m_reserved;
+	uint16_t m_checksum;
+};
+
+class SchedulerContext {
+private:
+	SemaphoreHandle_t m_mutex = NULL;
+	TaskHandle_t m_task = NULL;
+
+	// rules as edited over HTTP, guarded by m_mutex
+	uint32_t m_rules[SCHEDULE_MAX_RULES];
+	uint8_t m_numRules = 0;
+	bool m_loaded = false;
+	bool m_dirty = false;
+
+	// owned by the task
+	Schedule m_schedule;
+
+	// uptime (ms) the bell/alarm is released at, 0 when not held
+	int64_t m_bellReleaseMs = 0;
+	int64_t m_alarmReleaseMs = 0;
+
+	static uint16_t checksum(const uint32_t *rules, const uint8_t &numRules)
+	{
+		uint16_t sum = 0;
+		const uint8_t *p = (const uint8_t *)rules;
+		for (size_t i = 0; i < numRules * sizeof(uint32_t); i++) {
+			sum = (sum << 1 | sum >> 15) + p[i];
+		}
+		return sum;
+	}
+
+	static int64_t uptimeMs()
+	{
+		return esp_timer_get_time() / 1000;
+	}
+
+	void load()
+	{
+		ScheduleFileHeader header;
+		uint32_t rules[SCHEDULE_MAX_RULES];
+		uint8_t numRules = 0;
+
+		File file;
+		if (configFsMount()) {
+			file = SPIFFS.open(SCHEDULE_FILENAME, "r");
+		}
+		if (file) {
+			if (file.readBytes((char *)&header, sizeof(header)) == sizeof(header) &&
+				header.m_magic == SCHEDULE_MAGIC && header.m_numRules <= SCHEDULE_MAX_RULES &&
+				file.readBytes((char *)rules, header.m_numRules * sizeof(uint32_t)) == header.m_numRules * sizeof(uint32_t) &&
+				header.m_checksum == checksum(rules, header.m_numRules)) {
+				numRules = header.m_numRules;
+			} else {
+				LOG_WARN(SCHED, "[SCHED] Invalid %s, starting with an empty timetable\n", SCHEDULE_FILENAME);
+			}
+			file.close();
+		}
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			memcpy(m_rules, rules, numRules * sizeof(uint32_t));
+			m_numRules = numRules;
+			m_loaded = true;
+			m_dirty = false;
+			xSemaphoreGive(m_mutex);
+		}
+
+		LOG_INFO(SCHED, "[SCHED] Loaded %u rules\n", numRules);
+	}
+
+	void save(const uint32_t *rules, const uint8_t &numRules)
+	{
+		ScheduleFileHeader header;
+		header.m_magic = SCHEDULE_MAGIC;
+		header.m_numRules = numRules;
+		header.m_reserved = 0;
+		header.m_checksum = checksum(rules, numRules);
+
+		File file;
+		if (configFsMount()) {
+			file = SPIFFS.open(SCHEDULE_FILENAME, "w");
+		}
+		if (!file) {
+			LOG_ERROR(SCHED, "[SCHED] Unable to write %s\n", SCHEDULE_FILENAME);
+			return;
+		}
+		file.write((const uint8_t *)&header, sizeof(header));
+		file.write((const uint8_t *)rules, numRules * sizeof(uint32_t));
+		file.close();
+	}
+
+	// take over edited rules, rescheduling all of them
+	void reload()
+	{
+		uint32_t rules[SCHEDULE_MAX_RULES];
+		uint8_t numRules = 0;
+		bool dirty = false;
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			dirty = m_dirty;
+			m_dirty = false;
+			numRules = m_numRules;
+			memcpy(rules, m_rules, numRules * sizeof(uint32_t));
+			xSemaphoreGive(m_mutex);
+		}
+
+		if (dirty) {
+			save(rules, numRules);
+		}
+		m_schedule.setRules(rules, numRules, compensatedMillis());
+	}
+
+	void fire(const Schedule::Event &event, const int64_t &nowMs)
+	{
+		uint32_t rule = m_schedule.rule(event.m_rule);
+		bool alarm = Schedule::ruleAlarm(rule);
+
+		// e.g. after a clock step, do not ring a long gone slot
+		if (nowMs - event.m_fireMs > SCHEDULE_MAX_LATE_MS) {
+			LOG_WARN(SCHED, "[SCHED] Rule %u missed by %lld s, skipping\n", event.m_rule, (nowMs - event.m_fireMs) / 1000);
+			return;
+		}
+
+		LOG_INFO(SCHED, "[SCHED] Rule %u: %s for %u s\n", event.m_rule, alarm ? "alarm" : "bell", Schedule::ruleDurationS(rule));
+
+		// overlapping rules extend the running signal
+		int64_t releaseMs = uptimeMs() + Schedule::ruleDurationS(rule) * 1000LL;
+		if (alarm) {
+			m_alarmReleaseMs = max(m_alarmReleaseMs, releaseMs);
+			beeperAlarmOn(true, BEEPER_SCHEDULE);
+		} else {
+			m_bellReleaseMs = max(m_bellReleaseMs, releaseMs);
+			beeperBellOn(true, BEEPER_SCHEDULE);
+		}
+	}
+
+	// drops the scheduler's request only, a bell turned on over HTTP keeps ringing
+	void release()
+	{
+		int64_t now = uptimeMs();
+
+		if (m_bellReleaseMs && now >= m_bellReleaseMs) {
+			m_bellReleaseMs = 0;
+			beeperBellOn(false, BEEPER_SCHEDULE);
+		}
+
+		if (m_alarmReleaseMs && now >= m_alarmReleaseMs) {
+			m_alarmReleaseMs = 0;
+			beeperAlarmOn(false, BEEPER_SCHEDULE);
+		}
+	}
+
+	// time to sleep until the next fire or release deadline
+	uint32_t sleepMs()
+	{
+		int64_t sleep = SCHEDULE_MAX_SLEEP_MS;
+
+		int64_t deadline = m_schedule.nextDeadlineMs();
+		if (deadline != INT64_MAX) {
+			sleep = min(sleep, deadline - (int64_t)compensatedMillis());
+		}
+
+		// local deadlines jump with the local time at a DST transition
+		int64_t transition = ntpNextTransitionMs();
+		int64_t utcMs = compensatedUtcMillis();
+		if (transition != INT64_MAX && transition > utcMs) {
+			sleep = min(sleep, transition - utcMs);
+		}
+
+		int64_t now = uptimeMs();
+		if (m_bellReleaseMs) {
+			sleep = min(sleep, m_bellReleaseMs - now);
+		}
+		if (m_alarmReleaseMs) {
+			sleep = min(sleep, m_alarmReleaseMs - now);
+		}
+
+		return (uint32_t)max(sleep, 1LL);
+	}
+
+	bool edit(const uint32_t *rules, const uint8_t &numRules)
+	{
+		bool ok = false;
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			if (m_loaded) {
+				memcpy(m_rules, rules, numRules * sizeof(uint32_t));
+				m_numRules = numRules;
+				m_dirty = true;
+				ok = true;
+			}
+			xSemaphoreGive(m_mutex);
+		}
+
+		// wake the task up to reschedule
+		if (ok && m_task) {
+			xTaskNotifyGive(m_task);
+		}
+		return ok;
+	}
+
+public:
+	void init()
+	{
+		m_mutex = xSemaphoreCreateMutex();
+	}
+
+	void task()
+	{
+		m_task = xTaskGetCurrentTaskHandle();
+
+		// the task sleeps for up to SCHEDULE_MAX_SLEEP_MS between check-ins
+		watchdogRegister(SCHEDULE_MAX_SLEEP_MS + WATCHDOG_TIMEOUT);
+
+		// local time is meaningless until synchronized, the timetable
+		// file mounts SPIFFS, off the path of the WiFi connection
+		while (!readinessWait(READY_TIME_SYNCED, WATCHDOG_TIMEOUT / 2)) {
+			watchdogReset();
+		}
+
+		load();
+		reload();
+
+		while (1) {
+			// the deadline may be a few ms ahead of the clock after the wakeup,
+			// events are only taken once they are really due
+			int64_t now = compensatedMillis();
+			Schedule::Event event;
+			while (m_schedule.pop(now, event)) {
+				fire(event, now);
+			}
+			release();
+			watchdogReset();
+
+			// sleep until the next deadline, DST transition or rule change;
+			// the sleep is capped since clock corrections move the deadline too
+			if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepMs()))) {
+				reload();
+			}
+		}
+	}
+
+	bool addRule(const uint32_t &rule)
+	{
+		uint32_t rules[SCHEDULE_MAX_RULES];
+		uint8_t numRules = getRules(rules, SCHEDULE_MAX_RULES);
+
+		if (!Schedule::ruleValid(rule) || numRules >= SCHEDULE_MAX_RULES) {
+			return false;
+		}
+		rules[numRules++] = rule;
+		return edit(rules, numRules);
+	}
+
+	bool deleteRule(const uint8_t &index)
+	{
+		uint32_t rules[SCHEDULE_MAX_RULES];
+		uint8_t numRules = getRules(rules, SCHEDULE_MAX_RULES);
+
+		if (index >= numRules) {
+			return false;
+		}
+		memmove(&rules[index], &rules[index + 1], (numRules - index - 1) * sizeof(uint32_t));
+		return edit(rules, numRules - 1);
+	}
+
+	bool clear()
+	{
+		uint32_t rules[1];
+		return edit(rules, 0);
+	}
+
+	uint8_t getRules(uint32_t *rules, const uint8_t &maxRules)
+	{
+		uint8_t numRules = 0;
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			numRules = min(m_numRules, maxRules);
+			memcpy(rules, m_rules, numRules * sizeof(uint32_t));
+			xSemaphoreGive(m_mutex);
+		}
+		return numRules;
+	}
+};
+
+static SchedulerContext g_ctx;
+
+void schedulerInit()
+{
+	g_ctx.init();
+}
+
+void schedulerTask(void *pvParameters __attribute__((unused)))
+{
+	g_ctx.task();
+}
+
+bool schedulerAddRule(const uint32_t &rule)
+{
+	return g_ctx.addRule(rule);
+}
+
+bool schedulerDeleteRule(const uint8_t &index)
+{
+	return g_ctx.deleteRule(index);
+}
+
+bool schedulerClear()
+{
+	return g_ctx.clear();
+}
+
+uint8_t schedulerGetRules(uint32_t *rules, const uint8_t &maxRules)
+{
+	return g_ctx.getRules(rules, maxRules);
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// task ringing the bell/alarm by the weekly timetable (see schedule.h)
+//
+
+void schedulerInit();
+void schedulerTask(void *pvParameters __attribute__((unused)));
+
+// rule editing, false until the timetable was loaded or when it is full
+bool schedulerAddRule(const uint32_t &rule);
+bool schedulerDeleteRule(const uint8_t &index);
+bool schedulerClear();
+
+uint8_t schedulerGetRules(uint32_t *rules, const uint8_t &maxRules);
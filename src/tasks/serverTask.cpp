@@ -14,8 +14,24 @@
 #include "ledTask.h"
 #include "ntpTask.h"
 #include "beeperTask.h"
+#include "schedulerTask.h"
+#include "schedule.h"
+#include "postmortem.h"
+#include "syslogClient.h"
+#include "taskProfiler.h"
+#include "healthMonitor.h"
+#include "bootTrace.h"
+#include "powerManager.h"
+#include "readiness.h"
 
 #define OUTPUT_JSON_BUFFER_SIZE 512
+#define LOGLEVEL_JSON_BUFFER_SIZE 1024
+#define WIFI_JSON_BUFFER_SIZE 3072
+#define POSTMORTEM_JSON_BUFFER_SIZE 3072
+#define SCHEDULE_JSON_BUFFER_SIZE 4096
+#define TASKS_JSON_BUFFER_SIZE 4096
+#define HEALTH_JSON_BUFFER_SIZE 8192
+#define BOOT_JSON_BUFFER_SIZE 8192
 
 #if BUILD_PICO_STAMP
 #define TITLE "Alarm beeper/Bell signal generator (M5Stamp variant)<br>"
@@ -24,6 +40,18 @@
 #endif
 
 
+// sees every request first but never handles one itself: ends the boot
+// timeline on the first request and keeps the modem awake while requests come in
+class RequestObserver : public AsyncWebHandler {
+public:
+	virtual bool canHandle(AsyncWebServerRequest *request) override
+	{
+		bootTraceFinish("firstRequest");
+		powerNotifyActivity();
+		return false;
+	}
+};
+
 class ServerTaskCtx {
 private:
 	bool m_wifiReconfigureRequested;
@@ -42,7 +70,7 @@ public:
 
 	void indexHandler(AsyncWebServerRequest *request)
 	{
-		LOG_PRINTF("%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
 		String body =
 		"<!DOCTYPE html>\n"
 		"<html>\n"
@@ -66,7 +94,15 @@ public:
 		"Click <a href=\"/alarm?value=off\">here</a> to turn alarm off<br>"
 		"Click <a href=\"/bell?value=on\">here</a> to turn bell on<br>"
 		"Click <a href=\"/bell?value=off\">here</a> to turn bell off<br>"
-		"Click <a href=\"/rssi\">here</a> to get RSSI<br><br>";
+		"Click <a href=\"/rssi\">here</a> to get RSSI<br>"
+		"Click <a href=\"/wifi\">here</a> to show WiFi connection details<br>"
+		"Click <a href=\"/loglevel\">here</a> to show log levels<br>"
+		"Click <a href=\"/schedule\">here</a> to show the bell timetable<br>"
+		"Click <a href=\"/tasks\">here</a> to show task CPU and stack usage<br>"
+		"Click <a href=\"/health\">here</a> to show health trends<br>"
+		"Click <a href=\"/power\">here</a> to show the modem sleep state and latency<br>"
+		"Click <a href=\"/boot\">here</a> to show the boot timeline (<a href=\"/boot?format=chrome\">Chrome trace</a>)<br>"
+		"Click <a href=\"/postmortem\">here</a> to show the log of the previous boot<br><br>";
 
 		body +=
 		"<br>"
@@ -81,12 +117,12 @@ public:
 
 	void rssiHandler(AsyncWebServerRequest *request)
 	{
-		LOG_PRINTF("%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
 		StaticJsonDocument<OUTPUT_JSON_BUFFER_SIZE> doc;
 
 		// print the received signal strength:
 		long rssi = WiFi.RSSI();
-		LOG_PRINTF("signal strength (RSSI): %d dBm\n", rssi);
+		LOG_DEBUG(SERVER, "signal strength (RSSI): %d dBm\n", rssi);
 
 		doc["rssi"] = rssi;
 
@@ -94,20 +130,97 @@ public:
 		uint64_t currTimeMs = compensatedMillis();
 		doc["currTimeMs"] = currTimeMs;
 		doc["currTime"] = msToTimeStr(currTimeMs);
-		doc["watchdogTimeToReset"] = msToTimeStr(watchdogTimeToReset());
 
 		char buffer[OUTPUT_JSON_BUFFER_SIZE];
 		serializeJson(doc, buffer, sizeof(buffer));
 		request->send(200, "application/json", buffer);
 	}
 
+	void wifiHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		StaticJsonDocument<WIFI_JSON_BUFFER_SIZE> doc;
+
+		WiFiStats stats = wifiStats();
+		doc["ssid"] = WiFi.SSID();
+		doc["bssid"] = WiFi.BSSIDstr();
+		doc["channel"] = WiFi.channel();
+		doc["rssi"] = WiFi.RSSI();
+		doc["ip"] = WiFi.localIP().toString();
+		doc["connects"] = stats.m_connects;
+		doc["lastConnectMs"] = stats.m_lastConnectMs;
+		doc["maxConnectMs"] = stats.m_maxConnectMs;
+
+		JsonObject lease = doc.createNestedObject("lease");
+		lease["inUse"] = stats.m_leaseInUse;
+		lease["ip"] = IPAddress(stats.m_leaseIp).toString();
+		lease["leaseS"] = stats.m_leaseS;
+		lease["renewInS"] = stats.m_leaseRenewInS;
+
+		JsonObject roam = doc.createNestedObject("roam");
+		roam["scans"] = stats.m_roam.m_scans;
+		roam["roams"] = stats.m_roam.m_roams;
+		roam["failures"] = stats.m_roam.m_failures;
+		roam["lastDowntimeMs"] = stats.m_roam.m_lastDowntimeMs;
+		roam["maxDowntimeMs"] = stats.m_roam.m_maxDowntimeMs;
+		roam["avgDowntimeMs"] = stats.m_roam.m_roams ? stats.m_roam.m_totalDowntimeMs / stats.m_roam.m_roams : 0;
+
+		JsonObject scan = doc.createNestedObject("scan");
+		scan["targetedScans"] = stats.m_scan.m_targetedScans;
+		scan["targetedHits"] = stats.m_scan.m_targetedHits;
+		scan["fullScans"] = stats.m_scan.m_fullScans;
+		scan["lastChannels"] = stats.m_scan.m_lastChannels;
+		scan["lastScanMs"] = stats.m_scan.m_lastScanMs;
+		scan["lastScanToConnectMs"] = stats.m_scan.m_lastScanToConnectMs;
+		scan["cacheEntries"] = stats.m_scan.m_cacheEntries;
+		scan["authTimeouts"] = stats.m_scan.m_authTimeouts;
+		scan["earlyStops"] = stats.m_scan.m_earlyStops;
+
+		// connection history of the access points, most recently used first
+		uint8_t order[WIFI_HISTORY_SIZE];
+		uint8_t count = 0;
+		for (uint8_t i = 0; i < WIFI_HISTORY_SIZE; i++) {
+			if (!stats.m_history[i].m_lastUsed) {
+				continue;
+			}
+
+			uint8_t pos = count++;
+			while (pos > 0 && stats.m_history[order[pos - 1]].m_lastUsed < stats.m_history[i].m_lastUsed) {
+				order[pos] = order[pos - 1];
+				pos--;
+			}
+			order[pos] = i;
+		}
+
+		JsonArray history = doc.createNestedArray("history");
+		for (uint8_t i = 0; i < count; i++) {
+			const WiFiHistory::Entry *entry = &stats.m_history[order[i]];
+
+			char bssid[18];
+			snprintf(bssid, sizeof(bssid), "%02X:%02X:%02X:%02X:%02X:%02X", entry->m_bssid[0], entry->m_bssid[1], entry->m_bssid[2], entry->m_bssid[3], entry->m_bssid[4], entry->m_bssid[5]);
+
+			JsonObject obj = history.createNestedObject();
+			obj["ssid"] = stats.m_historySSID[order[i]];
+			obj["bssid"] = bssid;
+			obj["attempts"] = entry->m_attempts;
+			obj["failPercent"] = entry->m_failPermille / 10.0;
+			obj["connectMs"] = entry->m_connectMs;
+			obj["sessions"] = entry->m_sessions;
+			obj["sessionS"] = entry->m_sessionS;
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
 	void ledHandler(AsyncWebServerRequest *request)
 	{
-		LOG_PRINTF("%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
 
 		if (request->hasParam("value")) {
 			int value = atoi(request->getParam("value")->value().c_str());
-			LOG_PRINTF("LED value: %d\n", value);
+			LOG_INFO(SERVER, "LED value: %d\n", value);
 			setLedBrightness(value);
 			request->redirect("/index");
 		} else {
@@ -117,7 +230,7 @@ public:
 
 	void alarmHandler(AsyncWebServerRequest *request)
 	{
-		LOG_PRINTF("%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
 
 		int duration = 0;
 
@@ -134,14 +247,14 @@ public:
 
 		if (request->hasParam("value")) {
 			if (request->getParam("value")->value() == "on") {
-				LOG_PRINTF("Alarm is on\n");
+				LOG_INFO(SERVER, "Alarm is on\n");
 				beeperAlarmOn(true);
 				if (duration) {
 					delay(duration);
 					beeperAlarmOn(false);
 				}
 			} else {
-				LOG_PRINTF("Alarm is off\n");
+				LOG_INFO(SERVER, "Alarm is off\n");
 				beeperAlarmOn(false);
 				if (duration) {
 					delay(duration);
@@ -156,14 +269,14 @@ public:
 
 	void bellHandler(AsyncWebServerRequest *request)
 	{
-		LOG_PRINTF("%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
 
 		if (request->hasParam("value")) {
 			if (request->getParam("value")->value() == "on") {
-				LOG_PRINTF("Bell is on\n");
+				LOG_INFO(SERVER, "Bell is on\n");
 				beeperBellOn(true);
 			} else {
-				LOG_PRINTF("Bell is off\n");
+				LOG_INFO(SERVER, "Bell is off\n");
 				beeperBellOn(false);
 			}
 			request->redirect("/index");
@@ -172,6 +285,406 @@ public:
 		}
 	}
 
+	void binlogHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+
+		size_t size = binlogDumpSize();
+		uint8_t *buf = (uint8_t *)malloc(size);
+		if (!buf) {
+			request->send(500, "text/plain", "Out of memory");
+			return;
+		}
+
+		// raw records, decode with tools/binlog_decode.py
+		size_t len = binlogDump(buf, size);
+		if (request->hasParam("clear")) {
+			binlogClear();
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/octet-stream");
+		response->write(buf, len);
+		free(buf);
+		request->send(response);
+	}
+
+	void syslogHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		StaticJsonDocument<OUTPUT_JSON_BUFFER_SIZE> doc;
+
+		SyslogStats stats = syslogStats();
+		doc["enabled"] = SYSLOG_ENABLED;
+		doc["queued"] = stats.m_queued;
+		doc["dropped"] = stats.m_dropped;
+		doc["sent"] = stats.m_sent;
+		doc["lost"] = stats.m_lost;
+
+		char buffer[OUTPUT_JSON_BUFFER_SIZE];
+		serializeJson(doc, buffer, sizeof(buffer));
+		request->send(200, "application/json", buffer);
+	}
+
+	void logLevelHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+
+		// change the runtime level of a single module
+		if (request->hasParam("module") && request->hasParam("level")) {
+			int module = logModuleFind(request->getParam("module")->value().c_str());
+			int level = atoi(request->getParam("level")->value().c_str());
+
+			if ((module < 0) || (level < LOG_LEVEL_NONE) || (level > LOG_LEVEL_VERBOSE)) {
+				request->send(404, "text/plain", "Not found");
+				return;
+			}
+
+			logSetLevel(module, level);
+			LOG_INFO(SERVER, "Log level of %s set to %d\n", logModuleName(module), g_logLevels[module]);
+		}
+
+		StaticJsonDocument<LOGLEVEL_JSON_BUFFER_SIZE> doc;
+
+		for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+			JsonObject module = doc.createNestedObject(logModuleName(i));
+			module["level"] = (uint8_t)g_logLevels[i];
+			module["max"] = logModuleMaxLevel(i);
+		}
+
+		char buffer[LOGLEVEL_JSON_BUFFER_SIZE];
+		serializeJson(doc, buffer, sizeof(buffer));
+		request->send(200, "application/json", buffer);
+	}
+
+	void postmortemHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		DynamicJsonDocument doc(POSTMORTEM_JSON_BUFFER_SIZE);
+
+		doc["resetReason"] = postmortemResetReason();
+		doc["available"] = postmortemAvailable();
+
+		if (postmortemAvailable()) {
+			doc["resetCause"] = postmortemResetCause();
+			doc["resetUptime"] = msToTimeStr(postmortemResetUptime());
+
+			// oldest record first
+			JsonArray records = doc.createNestedArray("records");
+			for (uint32_t i = 0; i < postmortemNumRecords(); i++) {
+				const PostmortemRecord *record = postmortemRecord(i);
+				JsonObject obj = records.createNestedObject();
+				obj["ts"] = record->m_ts;
+				obj["text"] = (const char *)record->m_text;
+			}
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
+	void tasksHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+
+		ProfilerTask tasks[PROFILER_MAX_TASKS];
+		uint8_t numTasks = profilerGetTasks(tasks, PROFILER_MAX_TASKS);
+		ProfilerStats stats = profilerStats();
+
+		DynamicJsonDocument doc(TASKS_JSON_BUFFER_SIZE);
+		doc["available"] = stats.m_available;
+		doc["allTasks"] = stats.m_allTasks;
+		doc["cpuAvailable"] = stats.m_cpuAvailable;
+		doc["intervalMs"] = stats.m_intervalMs;
+		doc["sampleUs"] = stats.m_sampleUs;
+		doc["freeHeap"] = ESP.getFreeHeap();
+
+		JsonArray array = doc.createNestedArray("tasks");
+		for (uint8_t i = 0; i < numTasks; i++) {
+			JsonObject obj = array.createNestedObject();
+			obj["name"] = (const char *)tasks[i].m_name;
+			obj["priority"] = tasks[i].m_priority;
+			obj["state"] = tasks[i].m_state;
+			obj["stackFree"] = tasks[i].m_stackFree;
+			if (stats.m_cpuAvailable) {
+				obj["cpu"] = tasks[i].m_cpuPermille / 10.0;
+			}
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
+	void healthHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		DynamicJsonDocument doc(HEALTH_JSON_BUFFER_SIZE);
+
+		const char *reason = healthRebootReason();
+		doc["healthy"] = reason == NULL;
+		doc["rebootReason"] = reason;
+		doc["minFreeHeap"] = ESP.getMinFreeHeap();
+
+		// column per value, oldest sample first
+		JsonArray uptime = doc.createNestedArray("uptimeS");
+		JsonArray freeHeap = doc.createNestedArray("freeHeap");
+		JsonArray largestBlock = doc.createNestedArray("largestBlock");
+		JsonArray socketOk = doc.createNestedArray("socketOk");
+		JsonArray reconnects = doc.createNestedArray("reconnects");
+		JsonArray reconnectFailures = doc.createNestedArray("reconnectFailures");
+
+		for (uint8_t i = 0; i < healthNumSamples(); i++) {
+			HealthSample sample = healthSample(i);
+			uptime.add(sample.m_uptimeS);
+			freeHeap.add(sample.m_freeHeap);
+			largestBlock.add(sample.m_largestBlock);
+			socketOk.add(sample.m_socketOk);
+			reconnects.add(sample.m_reconnects);
+			reconnectFailures.add(sample.m_reconnectFailures);
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
+	static void bootTraceToJson(const BootTrace &trace, JsonObject obj)
+	{
+		obj["finished"] = trace.m_finished;
+
+		// names are copied, the trace is reused for the previous boot
+		JsonArray spans = obj.createNestedArray("spans");
+		for (uint8_t i = 0; i < trace.m_numSpans; i++) {
+			const BootTraceSpan &span = trace.m_spans[i];
+			JsonObject item = spans.createNestedObject();
+			item["name"] = (char *)span.m_name;
+			item["task"] = (char *)span.m_task;
+			item["startUs"] = span.m_startUs;
+			if (span.m_durationUs != BOOT_TRACE_OPEN) {
+				item["durationUs"] = span.m_durationUs;
+			}
+		}
+	}
+
+	// Chrome trace event format, opens in chrome://tracing or Perfetto
+	static void bootTraceToChrome(const BootTrace &trace, JsonArray events, const uint8_t &pid)
+	{
+		const char *tasks[BOOT_TRACE_MAX_SPANS];
+		uint8_t numTasks = 0;
+
+		for (uint8_t i = 0; i < trace.m_numSpans; i++) {
+			const BootTraceSpan &span = trace.m_spans[i];
+
+			// one thread per task
+			uint8_t tid = 0;
+			while (tid < numTasks && strcmp(tasks[tid], span.m_task)) {
+				tid++;
+			}
+			if (tid == numTasks) {
+				tasks[numTasks++] = span.m_task;
+				JsonObject meta = events.createNestedObject();
+				meta["name"] = "thread_name";
+				meta["ph"] = "M";
+				meta["pid"] = pid;
+				meta["tid"] = tid;
+				meta["args"]["name"] = (char *)span.m_task;
+			}
+
+			JsonObject event = events.createNestedObject();
+			event["name"] = (char *)span.m_name;
+			event["cat"] = "boot";
+			event["pid"] = pid;
+			event["tid"] = tid;
+			event["ts"] = span.m_startUs;
+			if (span.m_durationUs == 0) {
+				event["ph"] = "i";
+				event["s"] = "g";
+			} else if (span.m_durationUs == BOOT_TRACE_OPEN) {
+				// shown up to the end of the trace
+				event["ph"] = "B";
+			} else {
+				event["ph"] = "X";
+				event["dur"] = span.m_durationUs;
+			}
+		}
+	}
+
+	static void powerLatencyToJson(const PowerLatency &latency, JsonObject obj)
+	{
+		uint32_t answered = latency.m_probes - latency.m_timeouts;
+		obj["probes"] = latency.m_probes;
+		obj["timeouts"] = latency.m_timeouts;
+		obj["lastMs"] = latency.m_lastMs;
+		obj["maxMs"] = latency.m_maxMs;
+		obj["avgMs"] = answered ? latency.m_totalMs / answered : 0;
+	}
+
+	// modem sleep state; mode=performance|adaptive|saving switches the mode
+	void powerHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+
+		if (request->hasParam("mode")) {
+			String value = request->getParam("mode")->value();
+			uint8_t mode = 0;
+			while (mode < POWER_MODE_COUNT && value != powerModeName((PowerMode)mode)) {
+				mode++;
+			}
+
+			if (mode == POWER_MODE_COUNT) {
+				request->send(400, "text/plain", "Invalid mode");
+				return;
+			}
+
+			powerSetMode((PowerMode)mode);
+			LOG_INFO(SERVER, "Power mode set to %s\n", value.c_str());
+		}
+
+		PowerStats stats = powerStats();
+		StaticJsonDocument<OUTPUT_JSON_BUFFER_SIZE> doc;
+
+		doc["mode"] = powerModeName(stats.m_mode);
+		doc["sleeping"] = stats.m_sleeping;
+		doc["sleepPercent"] = stats.m_sleepPermille / 10.0;
+		doc["listenInterval"] = stats.m_listenInterval;
+		doc["budgetMs"] = stats.m_budgetMs;
+		doc["expectedLatencyMs"] = stats.m_expectedLatencyMs;
+		doc["overBudget"] = stats.m_overBudget;
+
+		// gateway round trips
+		powerLatencyToJson(stats.m_awake, doc.createNestedObject("awake"));
+		powerLatencyToJson(stats.m_asleep, doc.createNestedObject("asleep"));
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
+	// boot timeline; format=chrome for a Chrome trace file, previous=1 for the previous boot
+	void bootHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+		DynamicJsonDocument doc(BOOT_JSON_BUFFER_SIZE);
+		BootTrace trace;
+
+		bool chrome = request->hasParam("format") && request->getParam("format")->value() == "chrome";
+		bool previous = request->hasParam("previous") && request->getParam("previous")->value() == "1";
+
+		if (chrome) {
+			JsonArray events = doc.createNestedArray("traceEvents");
+			doc["displayTimeUnit"] = "ms";
+			if (previous ? bootTraceGetPrevious(trace) : bootTraceGet(trace)) {
+				bootTraceToChrome(trace, events, 1);
+			}
+
+			AsyncResponseStream *response = request->beginResponseStream("application/json");
+			response->addHeader("Content-Disposition", previous ? "attachment; filename=boot_previous.json" : "attachment; filename=boot.json");
+			serializeJson(doc, *response);
+			request->send(response);
+			return;
+		}
+
+		if (bootTraceGet(trace)) {
+			bootTraceToJson(trace, doc.createNestedObject("current"));
+		}
+		if (bootTraceGetPrevious(trace)) {
+			bootTraceToJson(trace, doc.createNestedObject("previous"));
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
+	// parse a rule given as days=12345 (0 = Sunday), time=HH:MM, duration=s, action=bell|alarm
+	bool parseScheduleRule(AsyncWebServerRequest *request, uint32_t &rule)
+	{
+		if (!request->hasParam("days") || !request->hasParam("time") || !request->hasParam("duration")) {
+			return false;
+		}
+
+		uint8_t days = 0;
+		for (const char *p = request->getParam("days")->value().c_str(); *p; p++) {
+			if (*p < '0' || *p > '6') {
+				return false;
+			}
+			days |= 1 << (*p - '0');
+		}
+
+		int hours, minutes;
+		if (sscanf(request->getParam("time")->value().c_str(), "%d:%d", &hours, &minutes) != 2 ||
+			hours < 0 || hours > 23 || minutes < 0 || minutes > 59) {
+			return false;
+		}
+
+		int duration = atoi(request->getParam("duration")->value().c_str());
+		if (duration < 1 || duration > 255) {
+			return false;
+		}
+
+		bool alarm = request->hasParam("action") && (request->getParam("action")->value() == "alarm");
+		rule = Schedule::packRule(days, hours * 60 + minutes, duration, alarm);
+		return true;
+	}
+
+	void scheduleHandler(AsyncWebServerRequest *request)
+	{
+		LOG_DEBUG(SERVER, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request->client()->remoteIP().toString().c_str());
+
+		bool ok = true;
+		if (request->hasParam("add")) {
+			uint32_t rule;
+			ok = parseScheduleRule(request, rule) && schedulerAddRule(rule);
+		} else if (request->hasParam("delete")) {
+			ok = schedulerDeleteRule(atoi(request->getParam("delete")->value().c_str()));
+		} else if (request->hasParam("clear")) {
+			ok = schedulerClear();
+		}
+
+		if (!ok) {
+			request->send(400, "text/plain", "Invalid rule");
+			return;
+		}
+
+		uint32_t rules[SCHEDULE_MAX_RULES];
+		uint8_t numRules = schedulerGetRules(rules, SCHEDULE_MAX_RULES);
+		uint64_t now = compensatedMillis();
+
+		DynamicJsonDocument doc(SCHEDULE_JSON_BUFFER_SIZE);
+		doc["synced"] = ntpTimeSynced();
+
+		JsonArray array = doc.createNestedArray("rules");
+		for (uint8_t i = 0; i < numRules; i++) {
+			char days[8];
+			char time[6];
+			uint8_t len = 0;
+
+			for (uint8_t day = 0; day < 7; day++) {
+				if (Schedule::ruleDays(rules[i]) & (1 << day)) {
+					days[len++] = '0' + day;
+				}
+			}
+			days[len] = 0;
+			snprintf(time, sizeof(time), "%02u:%02u", Schedule::ruleMinute(rules[i]) / 60, Schedule::ruleMinute(rules[i]) % 60);
+
+			JsonObject obj = array.createNestedObject();
+			obj["days"] = days;
+			obj["time"] = time;
+			obj["duration"] = Schedule::ruleDurationS(rules[i]);
+			obj["action"] = Schedule::ruleAlarm(rules[i]) ? "alarm" : "bell";
+
+			// local ms since epoch, the next fire is up to a week away
+			int64_t next = Schedule::nextFireMs(rules[i], now);
+			obj["nextMs"] = next;
+			obj["nextInS"] = (next - (int64_t)now) / 1000;
+		}
+
+		AsyncResponseStream *response = request->beginResponseStream("application/json");
+		serializeJson(doc, *response);
+		request->send(response);
+	}
+
 	void reconfigureWifiHandler(AsyncWebServerRequest *request)
 	{
 		String body =
@@ -218,10 +731,25 @@ public:
 		watchdogScheduleReboot();
 	}
 
+	void addControlHandlers(AsyncWebServer *server)
+	{
+		server->on("/alarm", HTTP_GET, [=](AsyncWebServerRequest *request){
+			alarmHandler(request);
+		});
+
+		server->on("/bell", HTTP_GET, [=](AsyncWebServerRequest *request){
+			bellHandler(request);
+		});
+
+		server->on("/reboot", HTTP_GET, [=](AsyncWebServerRequest *request){
+			rebootHandler(request);
+		});
+	}
+
 	void init()
-	{		
-		// green LED - we are ready to process clients
-		setLedColor(COLOR_GREEN);
+	{
+		// served until our pages take over, e.g. next to a portal opened at boot
+		addControlHandlers(wifiGetHttpServer());
 	}
 
 	void task()
@@ -229,8 +757,8 @@ public:
 		AsyncWebServer *server = wifiGetHttpServer();
 		bool shallInitServer = true;
 
-		// first initialization
-		init();
+		watchdogRegister();
+		profilerRegister();
 
 		while (1) {
 
@@ -238,8 +766,18 @@ public:
 			// init server handlers if necessary
 			//
 
-			if (shallInitServer) {
+			// the configuration portal registers its own pages, ours are
+			// added once it is closed; whether one opens at boot is known
+			// with the configuration
+			if (shallInitServer && (readinessGet() & READY_CONFIG_LOADED) && !wifiPortalActive()) {
 				shallInitServer = false;
+				int8_t span = bootTraceBegin("serverInit");
+
+				// drop the pages of a closed portal
+				server->reset();
+
+				// first, so it sees every request
+				server->addHandler(new RequestObserver());
 
 				server->on("/", HTTP_GET, [=](AsyncWebServerRequest *request){
 					indexHandler(request);
@@ -253,16 +791,51 @@ public:
 					rssiHandler(request);
 				});
 
+				server->on("/wifi", HTTP_GET, [=](AsyncWebServerRequest *request){
+					wifiHandler(request);
+				});
+
 				server->on("/led", HTTP_GET, [=](AsyncWebServerRequest *request){
 					ledHandler(request);
 				});
 
-				server->on("/alarm", HTTP_GET, [=](AsyncWebServerRequest *request){
-					alarmHandler(request);
+				// bell, alarm and reboot, also served next to the configuration portal
+				addControlHandlers(server);
+
+				server->on("/binlog", HTTP_GET, [=](AsyncWebServerRequest *request){
+					binlogHandler(request);
+				});
+
+				server->on("/syslog", HTTP_GET, [=](AsyncWebServerRequest *request){
+					syslogHandler(request);
+				});
+
+				server->on("/loglevel", HTTP_GET, [=](AsyncWebServerRequest *request){
+					logLevelHandler(request);
+				});
+
+				server->on("/postmortem", HTTP_GET, [=](AsyncWebServerRequest *request){
+					postmortemHandler(request);
+				});
+
+				server->on("/health", HTTP_GET, [=](AsyncWebServerRequest *request){
+					healthHandler(request);
+				});
+
+				server->on("/power", HTTP_GET, [=](AsyncWebServerRequest *request){
+					powerHandler(request);
 				});
 
-				server->on("/bell", HTTP_GET, [=](AsyncWebServerRequest *request){
-					bellHandler(request);
+				server->on("/boot", HTTP_GET, [=](AsyncWebServerRequest *request){
+					bootHandler(request);
+				});
+
+				server->on("/tasks", HTTP_GET, [=](AsyncWebServerRequest *request){
+					tasksHandler(request);
+				});
+
+				server->on("/schedule", HTTP_GET, [=](AsyncWebServerRequest *request){
+					scheduleHandler(request);
 				});
 
 				server->on("/reconfigureWifi", HTTP_GET, [=](AsyncWebServerRequest *request){
@@ -273,10 +846,6 @@ public:
 					resetWifi(request);
 				});
 
-				server->on("/reboot", HTTP_GET, [=](AsyncWebServerRequest *request){
-					rebootHandler(request);
-				});
-
 				server->onNotFound([=](AsyncWebServerRequest *request){
 					request->send(404, "text/plain", "Not found");
 				});
@@ -284,11 +853,15 @@ public:
 				server->begin();
 
 				if (!MDNS.begin(wifiHostName().c_str())) {
-					LOG_PRINTF("Error starting MDNS responder!\n");
+					LOG_ERROR(SERVER, "Error starting MDNS responder!\n");
 				}
 
 				// Add service to MDNS-SD so our webserver can be located
 				MDNS.addService("http", "tcp", 80);
+				bootTraceEnd(span);
+
+				// green LED - we are ready to process clients
+				setLedColor(COLOR_GREEN);
 			}
 
 			//
@@ -297,15 +870,17 @@ public:
 
 			if (m_wifiReconfigureRequested) {
 				m_wifiReconfigureRequested = false;
-				LOG_PRINTF("WiFi reconfiguration requested\n");
+				LOG_INFO(SERVER, "WiFi reconfiguration requested\n");
 
-				// reset server handlers
+				// the portal takes over the web server, only bell, alarm and
+				// reboot stay; they are added before it starts
 				server->reset();
+				addControlHandlers(server);
 
-				// init wifi reconfiguration
+				// the portal runs next to the normal operation
 				wifiReconfigure();
 
-				// and now we have to re-init the server again
+				// and now we have to re-init the server again, once the portal is closed
 				shallInitServer = true;
 			}
 
@@ -315,18 +890,21 @@ public:
 
 			if (m_wifiResetRequested) {
 				m_wifiResetRequested = false;
-				LOG_PRINTF("WiFi reset requested\n");
+				LOG_INFO(SERVER, "WiFi reset requested\n");
 
-				// reset server handlers
+				// the portal takes over the web server, only bell, alarm and
+				// reboot stay; they are added before it starts
 				server->reset();
+				addControlHandlers(server);
 
-				// init wifi reset
+				// erase the configuration and start the portal
 				wifiReset();
 
-				// and now we have to re-init the server again
+				// and now we have to re-init the server again, once the portal is closed
 				shallInitServer = true;
 			}
 
+			watchdogReset();
 			delay(100);
 		}
 	}
@@ -335,6 +913,11 @@ public:
 
 static ServerTaskCtx g_ctx;
 
+void serverInit()
+{
+	g_ctx.init();
+}
+
 void serverTask(void *pvParameters __attribute__((unused)))
 {
 	g_ctx.task();
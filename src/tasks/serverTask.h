@@ -1,3 +1,7 @@
 #pragma once
 
+// before the WiFi task starts: bell, alarm and reboot are served from the
+// start, also next to a configuration portal opened at boot
+void serverInit();
+
 void serverTask(void *pvParameters __attribute__((unused)));
@@ -2,11 +2,15 @@
 #include "config.h"
 #include "utils.h"
 #include "watchdog.h"
+#include "taskProfiler.h"
 
 #include <WiFi.h>
 #include <WiFiClient.h>
 #include <ESPmDNS.h>
 #include <SPIFFS.h>
+#include <esp_clk.h>
+#include <tcpip_adapter.h>
+#include <lwip/dhcp.h>
 #include "wifiTask.h"
 #include "driver/adc.h"
 #include "WiFiMultiSSID.h"
@@ -15,6 +19,12 @@
 #include <ESP_DoubleResetDetector.h>
 
 #include "ledTask.h"
+#include "postmortem.h"
+#include "healthMonitor.h"
+#include "bootTrace.h"
+#include "configStore.h"
+#include "readiness.h"
+#include "powerManager.h"
 
 #if PRINT_PASSWORDS
 #define PASSWORD_STR(str) (str && str[0]) ? str : "<empty>"
@@ -24,6 +34,15 @@
 
 #define MAX(a, b) ((a) > (b)) ? (a) : (b)
 
+// event group bits
+#define WIFI_GOT_IP_BIT		BIT1	// wakeup: station got an IP address
+#define WIFI_LINK_LOST_BIT	BIT2	// wakeup: station disconnected
+#define WIFI_REQUEST_BIT	BIT3	// wakeup: reconfiguration/reset requested
+#define WIFI_SCAN_DONE_BIT	BIT4	// wakeup: background scan finished
+#define WIFI_PORTAL_DONE_BIT	BIT5	// wakeup: configuration portal closed
+#define WIFI_IP_LOST_BIT	BIT6	// wakeup: station lost its IP address
+#define WIFI_WAKEUP_BITS	(WIFI_GOT_IP_BIT | WIFI_LINK_LOST_BIT | WIFI_REQUEST_BIT | WIFI_SCAN_DONE_BIT | WIFI_PORTAL_DONE_BIT | WIFI_IP_LOST_BIT)
+
 typedef struct {
 	// stored wifi credentials
 	WiFiMultiSSID::Credentials m_credentials[NUM_WIFI_CREDENTIALS];
@@ -31,10 +50,48 @@ typedef struct {
 	char m_hostName[HOST_NAME_LEN];
 	// force access point mode flag
 	bool m_forceAp;
-	// structure checksum
+	// structure checksum, only checked in legacy SPIFFS files
 	uint16_t m_checksum;
 } WiFiManagerConfig;
 
+// last DHCP lease, reused as static configuration while still valid
+typedef struct {
+	uint32_t m_ip;
+	uint32_t m_gateway;
+	uint32_t m_subnet;
+	uint32_t m_dns1;
+	uint32_t m_dns2;
+	uint32_t m_leaseS;
+	// RTC time (survives everything but power loss) the lease is due for renewal at
+	uint64_t m_renewRtcUs;
+	// access point the lease was obtained from
+	uint8_t m_bssid[6];
+	// structure checksum, only checked in legacy SPIFFS files
+	uint16_t m_checksum;
+} WiFiLease;
+
+// config store records (see configStore.h), bump the version on every
+// layout change and migrate the old layout in a ConfigMigrateFn
+#define WIFI_CONFIG_RECORD "wifi"
+#define WIFI_CONFIG_VERSION 1
+#define WIFI_PARAMS_RECORD "wifiParams"
+#define WIFI_PARAMS_VERSION 1
+#define WIFI_LEASE_RECORD "wifiLease"
+#define WIFI_LEASE_VERSION 1
+#define WIFI_HISTORY_RECORD "wifiHistory"
+#define WIFI_HISTORY_VERSION 1
+
+// written once no legacy SPIFFS file is left, SPIFFS isn't mounted for
+// the configuration after that
+#define WIFI_LEGACY_RECORD "wifiLegacy"
+#define WIFI_LEGACY_VERSION 1
+
+// same layout as the legacy SPIFFS config file
+typedef struct {
+	WiFiManagerConfig m_manager;
+	WiFi_STA_IPConfig m_ip;
+} WiFiConfigRecord;
+
 class WiFiContext {
 public:
 	// persistent wifi configuration data
@@ -48,16 +105,42 @@ public:
 	// last connection params
 	WiFiMultiSSID::LastParams m_lastWiFiParams;
 
+	// cached DHCP lease
+	WiFiLease m_lease;
+	bool m_leaseInUse;
+
+	// connection timing
+	uint32_t m_connects;
+	uint32_t m_lastConnectMs;
+	uint32_t m_maxConnectMs;
+
+	// background roaming
+	uint32_t m_nextRoamScanAt;
+	bool m_roamScanRunning;
+	WiFiRoamStats m_roamStats;
+
 	// multi SSID wifi connection helper
 	WiFiMultiSSID m_wifiMulti;
 
 	// double reset detector
 	DoubleResetDetector *m_drd;
 
+	// SPIFFS mounted for legacy files of older firmware still to be migrated
+	bool m_legacyFiles;
+
 	// SSID and PW for Config Portal
 	String m_ssid;
 	String m_password;
 
+	// configuration portal, the manager only exists while it runs
+	ESPAsync_WiFiManager *m_manager;
+	ESPAsync_WMParameter *m_hostNameParam;
+	bool m_portalConnected;
+	int8_t m_portalSpan;
+
+	// requested or running, the portal owns the radio and the web server
+	volatile bool m_portalActive;
+
 	#if (!USING_ESP32_S2 && !USING_ESP32_C3)
 	DNSServer m_dnsServer;
 	#endif
@@ -70,10 +153,16 @@ public:
 	#endif
 
 	wifi_event_id_t m_wifiEventId;
+	wifi_event_id_t m_stateEventId;
+
+	// connection state machine
+	EventGroupHandle_t m_events;
+	volatile WiFiState m_state;
+	uint32_t m_backoffMs;
+	uint32_t m_retryAt;
 
 	volatile bool m_shallReconfigure;
 	volatile bool m_shallReset;
-	volatile bool m_connected;
 
 	static WiFiContext &instance()
 	{
@@ -89,10 +178,28 @@ public:
 	{
 		m_ssid = String(HOST_NAME_BASE) + String("-") + String((uint32_t)ESP.getEfuseMac(), HEX);
 		m_drd = NULL;
+		m_legacyFiles = false;
+		m_manager = NULL;
+		m_hostNameParam = NULL;
+		m_portalConnected = false;
+		m_portalSpan = -1;
+		m_portalActive = false;
 		m_shallReconfigure = false;
 		m_shallReset = false;
-		m_connected = false;
 		m_wifiEventId = 0;
+		m_stateEventId = 0;
+		m_events = xEventGroupCreate();
+		m_state = WIFI_STATE_DISCONNECTED;
+		m_backoffMs = WIFI_BACKOFF_MIN_MS;
+		m_retryAt = 0;
+		memset((void *)&m_lease, 0, sizeof(m_lease));
+		m_leaseInUse = false;
+		m_connects = 0;
+		m_lastConnectMs = 0;
+		m_maxConnectMs = 0;
+		m_nextRoamScanAt = 0;
+		m_roamScanRunning = false;
+		memset((void *)&m_roamStats, 0, sizeof(m_roamStats));
 
 		// default client mode config
 		m_clientConfig._sta_static_ip = IPAddress(0, 0, 0, 0);
@@ -111,37 +218,39 @@ public:
 
 	void displayClientConfig()
 	{
-		LOG_PRINTF("Client IP configuration:\n");
-		LOG_PRINTF("IP           = %s\n", m_clientConfig._sta_static_ip.toString().c_str());
-		LOG_PRINTF("Gateway      = %s\n", m_clientConfig._sta_static_gw.toString().c_str());
-		LOG_PRINTF("Network mask = %s\n", m_clientConfig._sta_static_sn.toString().c_str());
-		LOG_PRINTF("DNS1         = %s\n", m_clientConfig._sta_static_dns1.toString().c_str());
-		LOG_PRINTF("DNS2         = %s\n", m_clientConfig._sta_static_dns2.toString().c_str());
+		LOG_DEBUG(WIFI, "Client IP configuration:\n");
+		LOG_DEBUG(WIFI, "IP           = %s\n", m_clientConfig._sta_static_ip.toString().c_str());
+		LOG_DEBUG(WIFI, "Gateway      = %s\n", m_clientConfig._sta_static_gw.toString().c_str());
+		LOG_DEBUG(WIFI, "Network mask = %s\n", m_clientConfig._sta_static_sn.toString().c_str());
+		LOG_DEBUG(WIFI, "DNS1         = %s\n", m_clientConfig._sta_static_dns1.toString().c_str());
+		LOG_DEBUG(WIFI, "DNS2         = %s\n", m_clientConfig._sta_static_dns2.toString().c_str());
 	}
 
 	void displayCredentials()
 	{
 		for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
-			LOG_PRINTF("Credentials #%d:\n", i);
-			LOG_PRINTF("SSID: %s\n", m_managerConfig.m_credentials[i].m_ssid[0] ? m_managerConfig.m_credentials[i].m_ssid : "<empty>");
-			LOG_PRINTF("PASS: %s\n", PASSWORD_STR(m_managerConfig.m_credentials[i].m_password));
+			LOG_DEBUG(WIFI, "Credentials #%d:\n", i);
+			LOG_DEBUG(WIFI, "SSID: %s\n", m_managerConfig.m_credentials[i].m_ssid[0] ? m_managerConfig.m_credentials[i].m_ssid : "<empty>");
+			LOG_DEBUG(WIFI, "PASS: %s\n", PASSWORD_STR(m_managerConfig.m_credentials[i].m_password));
 		}
 	}
 
 	void displayLastWifiParams(WiFiMultiSSID::LastParams &params)
 	{
-		LOG_PRINTF("Last WiFi parameters:\n");
-		LOG_PRINTF("SSID : %s\n", params.m_credentials.m_ssid[0] ? params.m_credentials.m_ssid : "<empty>");
-		LOG_PRINTF("PASS : %s\n", PASSWORD_STR(params.m_credentials.m_password));
-		LOG_PRINTF("BSSID: %02X:%02X:%02X:%02X:%02X:%02X\n", params.m_bssid[0], params.m_bssid[1], params.m_bssid[2], params.m_bssid[3], params.m_bssid[4], params.m_bssid[5]);
-		LOG_PRINTF("CHAN : %d\n", params.m_channel);
+		LOG_DEBUG(WIFI, "Last WiFi parameters:\n");
+		LOG_DEBUG(WIFI, "SSID : %s\n", params.m_credentials.m_ssid[0] ? params.m_credentials.m_ssid : "<empty>");
+		LOG_DEBUG(WIFI, "PASS : %s\n", PASSWORD_STR(params.m_credentials.m_password));
+		LOG_DEBUG(WIFI, "BSSID: %02X:%02X:%02X:%02X:%02X:%02X\n", params.m_bssid[0], params.m_bssid[1], params.m_bssid[2], params.m_bssid[3], params.m_bssid[4], params.m_bssid[5]);
+		LOG_DEBUG(WIFI, "CHAN : %d\n", params.m_channel);
 	}
 
-	uint8_t connectMultiWiFi()
+	static uint32_t bootMs()
 	{
-		uint8_t status;
-		LOG_PRINTF("Connecting to WiFi\n");
+		return esp_timer_get_time() / 1000;
+	}
 
+	void applyClientConfig()
+	{
 		//
 		// Set static IP, Gateway, Subnetmask, DNS1 and DNS2
 		//
@@ -152,20 +261,64 @@ public:
 			m_clientConfig._sta_static_sn,
 			m_clientConfig._sta_static_dns1,
 			m_clientConfig._sta_static_dns2);
+	}
+
+	uint8_t connectMultiWiFi()
+	{
+		uint8_t status;
+		uint32_t startMs = bootMs();
+		LOG_INFO(WIFI, "Connecting to WiFi\n");
+
+		// skip DHCP if the last lease from the same access point is still valid
+		bool useLease = leaseUsable();
+		if (useLease) {
+			LOG_INFO(WIFI, "Using cached lease %s, renewal in %lld s\n", IPAddress(m_lease.m_ip).toString().c_str(), (int64_t)(m_lease.m_renewRtcUs - esp_clk_rtc_time()) / 1000000);
+			WiFi.config(IPAddress(m_lease.m_ip), IPAddress(m_lease.m_gateway), IPAddress(m_lease.m_subnet), IPAddress(m_lease.m_dns1), IPAddress(m_lease.m_dns2));
+		} else {
+			applyClientConfig();
+		}
+		m_leaseInUse = useLease;
 
-		// first try to connect quickly using previous parameters
-		status = m_wifiMulti.fastReconnect(
-			m_lastWiFiParams,
-			[=] {
-				// periodically reset watchdog
-				watchdogReset();
-			},
-			WIFI_RETRIES,
-			WIFI_TIMEOUT);
+		if (useLease) {
+			bootTraceMarkOnce("cachedLease");
+		}
+
+		// first try to connect quickly using previous parameters, unless
+		// that access point kept failing lately; if it does not associate
+		// within the deadline it is probably gone and the scan takes over
+		int8_t span;
+		if (m_wifiMulti.fastReconnectAllowed(m_lastWiFiParams)) {
+			span = bootTraceBegin("fastReconnect");
+			status = m_wifiMulti.fastReconnect(
+				m_lastWiFiParams,
+				[=] {
+					// periodically reset watchdog
+					watchdogReset();
+				},
+				WIFI_RETRIES,
+				WIFI_TIMEOUT,
+				WIFI_FAST_AUTH_DEADLINE_MS);
+			bootTraceEnd(span);
+			healthReportReconnect(status == WL_CONNECTED);
+			if (status == WL_CONNECTED) {
+				bootTraceMarkOnce("fastConnected");
+			}
+		} else {
+			LOG_WARN(WIFI, "Last access point failed too often, skipping fast reconnect\n");
+			status = WL_CONNECT_FAILED;
+		}
 
 		// if the fast reconnect failed, do a full featured connect with scan:
 		if (status != WL_CONNECTED) {
+			// we may end up on another network, get a fresh lease
+			if (useLease) {
+				m_leaseInUse = false;
+				m_lease.m_renewRtcUs = 0;
+				applyClientConfig();
+			}
+
 			// attempt connection to all specified WiFi networks, with maximum of WIFI_RETRIES retries
+			span = bootTraceBegin("scanConnect");
 			status = m_wifiMulti.connect(
 				[=] {
 					// periodically reset watchdog
@@ -173,51 +326,398 @@ public:
 				},
 				WIFI_RETRIES,
 				WIFI_TIMEOUT);
+			bootTraceEnd(span);
+			healthReportReconnect(status == WL_CONNECTED);
 
 			if (status == WL_CONNECTED) {
-				LOG_PRINTF("WiFi connected\n");
-				LOG_PRINTF("SSID: %s, RSSI = %d\n", WiFi.SSID().c_str(), WiFi.RSSI());
-				LOG_PRINTF("Channel: %d, IP address: %s\n", WiFi.channel(), WiFi.localIP().toString().c_str());
+				LOG_INFO(WIFI, "WiFi connected\n");
+				LOG_INFO(WIFI, "SSID: %s, RSSI = %d\n", WiFi.SSID().c_str(), WiFi.RSSI());
+				LOG_INFO(WIFI, "Channel: %d, IP address: %s\n", WiFi.channel(), WiFi.localIP().toString().c_str());
 			} else {
-				LOG_PRINTF("WiFi connection failed, rebooting...\n");
-				delay(5000);
-				// To avoid unnecessary DRD
-				m_drd->stop();
-				// now restart
-				ESP.restart();
+				LOG_WARN(WIFI, "WiFi connection failed\n");
 			}
 		}
+
+		m_connects++;
+		m_lastConnectMs = bootMs() - startMs;
+		m_maxConnectMs = max(m_maxConnectMs, m_lastConnectMs);
 		return status;
 	}
 
-	void wifiReconnectIfNeeded()
+	//
+	// DHCP lease cache
+	//
+
+	bool leaseUsable()
+	{
+		// an explicitly configured static address wins
+		if ((uint32_t)m_clientConfig._sta_static_ip != 0) {
+			return false;
+		}
+
+		// the RTC timer restarts on power loss, the expiry can't be trusted then
+		esp_reset_reason_t reason = esp_reset_reason();
+		if (reason == ESP_RST_POWERON || reason == ESP_RST_BROWNOUT) {
+			return false;
+		}
+
+		uint64_t now = esp_clk_rtc_time();
+		return m_lease.m_ip && (now < m_lease.m_renewRtcUs) &&
+			(m_lease.m_renewRtcUs - now <= m_lease.m_leaseS * 1000000ULL) &&
+			!memcmp(m_lease.m_bssid, m_lastWiFiParams.m_bssid, sizeof(m_lease.m_bssid));
+	}
+
+	void wifiLoadLease()
+	{
+		WiFiLease lease;
+
+		if (configLoad(WIFI_LEASE_RECORD, WIFI_LEASE_VERSION, &lease, sizeof(lease))) {
+			m_lease = lease;
+			return;
+		}
+
+		memset((void *)&m_lease, 0, sizeof(m_lease));
+
+		if (readLegacyFile(LAST_LEASE_FILENAME, &lease, sizeof(lease))) {
+			if (lease.m_checksum != calcChecksum((uint8_t *)&lease, sizeof(lease) - sizeof(lease.m_checksum))) {
+				LOG_WARN(WIFI, "Lease checksum failed!\n");
+				SPIFFS.remove(LAST_LEASE_FILENAME);
+			} else {
+				m_lease = lease;
+				migrateLegacyFile(LAST_LEASE_FILENAME, WIFI_LEASE_RECORD, WIFI_LEASE_VERSION, &lease, sizeof(lease));
+			}
+		}
+	}
+
+	void wifiSaveLease()
+	{
+		WiFiLease lease;
+		memset((void *)&lease, 0, sizeof(lease));
+
+		// lease time granted by the DHCP server
+		struct netif *netif = NULL;
+		if (tcpip_adapter_get_netif(TCPIP_ADAPTER_IF_STA, (void **)&netif) == ESP_OK && netif) {
+			struct dhcp *dhcp = netif_dhcp_data(netif);
+			if (dhcp) {
+				lease.m_leaseS = dhcp->offered_t0_lease;
+			}
+		}
+
+		if (!lease.m_leaseS) {
+			lease.m_leaseS = WIFI_DEFAULT_LEASE_S;
+		}
+
+		lease.m_ip = WiFi.localIP();
+		lease.m_gateway = WiFi.gatewayIP();
+		lease.m_subnet = WiFi.subnetMask();
+		lease.m_dns1 = WiFi.dnsIP(0);
+		lease.m_dns2 = WiFi.dnsIP(1);
+		memcpy(lease.m_bssid, WiFi.BSSID(), sizeof(lease.m_bssid));
+
+		// a DHCP client renews at half of the lease time (T1), stop reusing it there
+		lease.m_renewRtcUs = esp_clk_rtc_time() + lease.m_leaseS * 500000ULL;
+		m_lease = lease;
+
+		if (configSave(WIFI_LEASE_RECORD, WIFI_LEASE_VERSION, &m_lease, sizeof(m_lease))) {
+			LOG_DEBUG(WIFI, "Lease %s saved, %u s\n", WiFi.localIP().toString().c_str(), m_lease.m_leaseS);
+		} else {
+			LOG_ERROR(WIFI, "Failed to save lease!\n");
+		}
+	}
+
+	//
+	// connection history, see WiFiHistory.h
+	//
+
+	void wifiLoadHistory()
+	{
+		WiFiHistory::Table &table = m_wifiMulti.history().table();
+		if (!configLoad(WIFI_HISTORY_RECORD, WIFI_HISTORY_VERSION, &table, sizeof(table))) {
+			memset((void *)&table, 0, sizeof(table));
+		}
+	}
+
+	// only when something changed, once per connection attempt or session at most
+	void wifiSaveHistory()
+	{
+		if (!m_wifiMulti.history().takeDirty()) {
+			return;
+		}
+
+		const WiFiHistory::Table &table = m_wifiMulti.history().table();
+		if (!configSave(WIFI_HISTORY_RECORD, WIFI_HISTORY_VERSION, &table, sizeof(table))) {
+			LOG_ERROR(WIFI, "Failed to save the connection history!\n");
+		}
+	}
+
+	// hand the address back to DHCP once the cached lease is due for renewal
+	void checkLeaseRenewal()
+	{
+		if (m_leaseInUse && esp_clk_rtc_time() >= m_lease.m_renewRtcUs) {
+			LOG_INFO(WIFI, "Cached lease due for renewal, switching back to DHCP\n");
+			m_leaseInUse = false;
+			applyClientConfig();
+		}
+	}
+
+	WiFiStats stats()
+	{
+		WiFiStats stats;
+		stats.m_connects = m_connects;
+		stats.m_lastConnectMs = m_lastConnectMs;
+		stats.m_maxConnectMs = m_maxConnectMs;
+		stats.m_leaseInUse = m_leaseInUse;
+		stats.m_leaseIp = m_lease.m_ip;
+		stats.m_leaseS = m_lease.m_leaseS;
+		stats.m_roam = m_roamStats;
+		stats.m_scan = m_wifiMulti.scanStats();
+		for (uint8_t i = 0; i < WIFI_HISTORY_SIZE; i++) {
+			const WiFiHistory::Entry &entry = m_wifiMulti.history().table().m_entries[i];
+			const char *ssid = m_wifiMulti.historySSID(entry);
+			stats.m_history[i] = entry;
+			strlcpy(stats.m_historySSID[i], ssid ? ssid : "", sizeof(stats.m_historySSID[i]));
+		}
+		stats.m_leaseRenewInS = (m_lease.m_renewRtcUs > esp_clk_rtc_time()) ? (m_lease.m_renewRtcUs - esp_clk_rtc_time()) / 1000000 : 0;
+		return stats;
+	}
+
+	//
+	// connection state machine
+	//
+
+	static const char *stateName(const WiFiState &state)
+	{
+		switch (state) {
+		case WIFI_STATE_DISCONNECTED:	return "disconnected";
+		case WIFI_STATE_CONNECTING:		return "connecting";
+		case WIFI_STATE_CONNECTED:		return "connected";
+		case WIFI_STATE_BACKOFF:		return "backoff";
+		case WIFI_STATE_ROAMING:		return "roaming";
+		}
+		return "unknown";
+	}
+
+	void setState(const WiFiState &state)
+	{
+		if (state == m_state) {
+			return;
+		}
+
+		LOG_INFO(WIFI, "[WIFI] %s -> %s\n", stateName(m_state), stateName(state));
+		m_state = state;
+
+		// publish to the waiting tasks
+		if (state == WIFI_STATE_CONNECTED) {
+			readinessSet(READY_NETWORK_UP);
+		} else {
+			readinessClear(READY_NETWORK_UP);
+		}
+	}
+
+	// called from the system event task
+	void onWiFiEvent(WiFiEvent_t event)
+	{
+		switch (event) {
+		case SYSTEM_EVENT_STA_CONNECTED:
+			bootTraceMarkOnce("associated");
+			break;
+
+		case SYSTEM_EVENT_STA_GOT_IP:
+			bootTraceMarkOnce("gotIp");
+			xEventGroupSetBits(m_events, WIFI_GOT_IP_BIT);
+			break;
+
+		case SYSTEM_EVENT_SCAN_DONE:
+			xEventGroupSetBits(m_events, WIFI_SCAN_DONE_BIT);
+			break;
+
+		case SYSTEM_EVENT_STA_DISCONNECTED:
+		case SYSTEM_EVENT_STA_LOST_IP:
+			// waiting tasks must not see a stale connected state
+			// until the WiFi task gets to it
+			readinessClear(READY_NETWORK_UP);
+			xEventGroupSetBits(m_events, (event == SYSTEM_EVENT_STA_LOST_IP) ? WIFI_IP_LOST_BIT : WIFI_LINK_LOST_BIT);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	// take over the connection status after a (re)connect attempt
+	void updateConnectedState()
+	{
+		// events older than this check are stale, newer ones are kept
+		xEventGroupClearBits(m_events, WIFI_GOT_IP_BIT | WIFI_LINK_LOST_BIT | WIFI_IP_LOST_BIT | WIFI_SCAN_DONE_BIT);
+		m_roamScanRunning = false;
+
+		if (WiFi.status() == WL_CONNECTED) {
+			onConnected();
+		} else {
+			// try again later, backing off exponentially
+			LOG_INFO(WIFI, "[WIFI] Not connected, retrying in %u ms\n", m_backoffMs);
+			m_retryAt = millis() + m_backoffMs;
+			m_backoffMs = min(m_backoffMs * 2, (uint32_t)WIFI_BACKOFF_MAX_MS);
+			setState(WIFI_STATE_BACKOFF);
+		}
+	}
+
+	void onConnected()
+	{
+		m_backoffMs = WIFI_BACKOFF_MIN_MS;
+		setState(WIFI_STATE_CONNECTED);
+		m_wifiMulti.sessionStart();
+
+		// the details are in the boot trace
+		if (bootTraceMarkOnce("connected")) {
+			LOG_INFO(WIFI, "[WIFI] Connected %u ms after boot\n", bootMs());
+		}
+
+		if (!m_leaseInUse && (uint32_t)m_clientConfig._sta_static_ip == 0) {
+			wifiSaveLease();
+		}
+	}
+
+	void processEvents(const EventBits_t &bits)
 	{
-		if ((WiFi.status() != WL_CONNECTED)) {
-			// clear connection status
-			m_connected = false;
+		if (bits & WIFI_PORTAL_DONE_BIT) {
+			finishConfigPortal();
+		}
 
-			LOG_PRINTF("\nWiFi lost. Call connectMultiWiFi in loop\n");
+		// the disconnect from the old access point of a roam is no loss;
+		// the driver registered its event handler first, so it has already
+		// counted the disconnect that woke us up
+		bool lost = (bits & WIFI_IP_LOST_BIT) || ((bits & WIFI_LINK_LOST_BIT) && m_wifiMulti.linkLost());
+		if (lost && m_state == WIFI_STATE_CONNECTED) {
+			LOG_WARN(WIFI, "WiFi lost, reconnecting\n");
+			setState(WIFI_STATE_DISCONNECTED);
+			m_wifiMulti.sessionEnd();
+			wifiSaveHistory();
+		}
+
+		// e.g. the driver reconnected by itself while we were backing off
+		if ((bits & WIFI_GOT_IP_BIT) && WiFi.status() == WL_CONNECTED) {
+			// new address, or the lease cache handed over to DHCP
+			onConnected();
+		}
+
+		if (m_state == WIFI_STATE_CONNECTED) {
+			checkLeaseRenewal();
+#if WIFI_ROAM_ENABLED
+			// the portal scans and serves its access point on our channel
+			if (!m_portalActive) {
+				checkRoaming(bits);
+			}
+#endif
+		}
+
+		// a connection attempt restarts the radio and would take the
+		// portal's access point down, it waits until the portal is closed
+		bool retry = !m_portalActive && ((m_state == WIFI_STATE_DISCONNECTED) ||
+			(m_state == WIFI_STATE_BACKOFF && (int32_t)(millis() - m_retryAt) >= 0));
+
+		if (retry) {
+			setState(WIFI_STATE_CONNECTING);
 			connectMultiWiFi();
+			updateConnectedState();
+			wifiSaveHistory();
+		}
+	}
+
+	//
+	// background roaming
+	//
 
-			// notify waiting tasks that we are successfully connected
-			m_connected = true;
+	void checkRoaming(const EventBits_t &bits)
+	{
+		// evaluate the finished scan
+		if (m_roamScanRunning && (bits & WIFI_SCAN_DONE_BIT)) {
+			m_roamScanRunning = false;
+
+			WiFiMultiSSID::LastParams candidate;
+			bool found = m_wifiMulti.findRoamCandidate(WIFI_ROAM_HYSTERESIS_DB, candidate);
+			WiFi.scanDelete();
+
+			if (found) {
+				roam(candidate);
+			}
+			return;
+		}
+
+		// scan only while the link is weak, a good link is left alone
+		if (m_roamScanRunning || (int32_t)(millis() - m_nextRoamScanAt) < 0) {
+			return;
+		}
+		m_nextRoamScanAt = millis() + WIFI_ROAM_SCAN_INTERVAL_MS;
+
+		int32_t rssi = WiFi.RSSI();
+		if (rssi >= WIFI_ROAM_RSSI_THRESHOLD || WiFi.scanComplete() == WIFI_SCAN_RUNNING) {
+			return;
+		}
+
+		// passive scan, the result is reported by SYSTEM_EVENT_SCAN_DONE
+		LOG_DEBUG(WIFI, "[WIFI] Weak link (%d dBm), scanning for a better access point\n", rssi);
+		if (WiFi.scanNetworks(true, false, true, WIFI_ROAM_SCAN_MS_PER_CHAN) == WIFI_SCAN_RUNNING) {
+			m_roamScanRunning = true;
+			m_roamStats.m_scans++;
 		}
 	}
 
-	void wifiCheckStatus()
+	void roam(const WiFiMultiSSID::LastParams &candidate)
 	{
-		static ulong checkwifi_timeout = 0;
-		static ulong current_millis;
+		LOG_INFO(WIFI, "[WIFI] Roaming from %s (%d dBm) to %02X:%02X:%02X:%02X:%02X:%02X, channel %d\n",
+			WiFi.BSSIDstr().c_str(), WiFi.RSSI(),
+			candidate.m_bssid[0], candidate.m_bssid[1], candidate.m_bssid[2], candidate.m_bssid[3], candidate.m_bssid[4], candidate.m_bssid[5],
+			candidate.m_channel);
+
+		setState(WIFI_STATE_ROAMING);
+		m_wifiMulti.sessionEnd(false);
+		uint32_t startMs = bootMs();
+		xEventGroupClearBits(m_events, WIFI_GOT_IP_BIT | WIFI_LINK_LOST_BIT | WIFI_IP_LOST_BIT);
+
+		// the channel is known from the scan, no need to scan again
+		m_wifiMulti.begin(candidate);
+
+		// wait for the new address
+		bool connected = false;
+		while (bootMs() - startMs < WIFI_TIMEOUT) {
+			watchdogReset();
+			if (xEventGroupWaitBits(m_events, WIFI_GOT_IP_BIT, pdTRUE, pdTRUE, pdMS_TO_TICKS(WATCHDOG_TIMEOUT / 2)) & WIFI_GOT_IP_BIT) {
+				connected = (WiFi.status() == WL_CONNECTED);
+				break;
+			}
+		}
 
-		current_millis = millis();
+		uint32_t downtimeMs = bootMs() - startMs;
+		if (connected) {
+			m_roamStats.m_roams++;
+			m_roamStats.m_lastDowntimeMs = downtimeMs;
+			m_roamStats.m_maxDowntimeMs = max(m_roamStats.m_maxDowntimeMs, downtimeMs);
+			m_roamStats.m_totalDowntimeMs += downtimeMs;
+			LOG_INFO(WIFI, "[WIFI] Roamed in %u ms, RSSI %d dBm\n", downtimeMs, WiFi.RSSI());
+			onConnected();
+		} else {
+			// fall back to the regular reconnect
+			m_roamStats.m_failures++;
+			LOG_WARN(WIFI, "[WIFI] Roaming failed after %u ms\n", downtimeMs);
+			setState(WIFI_STATE_DISCONNECTED);
+		}
+	}
 
-		// Check WiFi every WIFICHECK_INTERVAL (1) seconds.
-		if ((current_millis > checkwifi_timeout) || (checkwifi_timeout == 0)) {
-			wifiReconnectIfNeeded();
-			checkwifi_timeout = current_millis + WIFICHECK_INTERVAL;
+	// how long the task may sleep waiting for events
+	uint32_t waitMs()
+	{
+		// wake up in time for the watchdog
+		uint32_t wait = WATCHDOG_TIMEOUT / 2;
+
+		if (m_state == WIFI_STATE_BACKOFF && !m_portalActive) {
+			int32_t remaining = (int32_t)(m_retryAt - millis());
+			wait = min(wait, (uint32_t)max(remaining, (int32_t)0));
 		}
+		return wait;
 	}
 
+	// checksum of the legacy SPIFFS files
 	int calcChecksum(uint8_t *address, uint16_t sizeToCalc)
 	{
 		uint16_t checkSum = 0;
@@ -227,110 +727,198 @@ public:
 		return checkSum;
 	}
 
-	bool wifiLoadConfiguration()
+	//
+	// Older firmware raw-dumped the structs to SPIFFS files. A file is read
+	// only when its record is not in the config store yet, then it is moved
+	// there and removed.
+	//
+
+	// SPIFFS is only mounted if the store doesn't record that the files are gone
+	void checkLegacyFiles()
 	{
-		File file = SPIFFS.open(CONFIG_FILENAME, "r");
-		LOG_PRINTF("Loading config...\n");
+		uint8_t done = 0;
+		if (configLoad(WIFI_LEGACY_RECORD, WIFI_LEGACY_VERSION, &done, sizeof(done)) && done) {
+			return;
+		}
 
-		memset((void *)&m_managerConfig, 0, sizeof(m_managerConfig));
-		memset((void *)&m_clientConfig, 0, sizeof(m_clientConfig));
+		m_legacyFiles = configFsMount();
+		if (!m_legacyFiles) {
+			return;
+		}
+
+		File root = SPIFFS.open("/");
+		File file = root.openNextFile();
 
-		if (file) {
-			file.readBytes((char *)&m_managerConfig, sizeof(m_managerConfig));
-			file.readBytes((char *)&m_clientConfig, sizeof(m_clientConfig));
-			file.close();
+		while (file) {
+			String fileName = file.name();
+			size_t fileSize = file.size();
+			LOG_DEBUG(WIFI, "FS File: %s, size: %f kB\n", fileName.c_str(), fileSize / 1024.0);
+			file = root.openNextFile();
+		}
+	}
+
+	// once the loads moved every file into the store, the check is not repeated
+	void finishLegacyFiles()
+	{
+		if (!m_legacyFiles || SPIFFS.exists(CONFIG_FILENAME) || SPIFFS.exists(LAST_PARAMS_FILENAME) || SPIFFS.exists(LAST_LEASE_FILENAME)) {
+			return;
+		}
+
+		uint8_t done = 1;
+		if (configSave(WIFI_LEGACY_RECORD, WIFI_LEGACY_VERSION, &done, sizeof(done))) {
+			LOG_INFO(WIFI, "No legacy files left, SPIFFS is no longer mounted for the configuration\n");
+			m_legacyFiles = false;
+		}
+	}
+
+	bool readLegacyFile(const String &path, void *data, const size_t &size)
+	{
+		if (!m_legacyFiles) {
+			return false;
+		}
+
+		File file = SPIFFS.open(path, "r");
+		if (!file) {
+			return false;
+		}
+
+		int64_t startUs = esp_timer_get_time();
+		memset(data, 0, size);
+		size_t length = file.readBytes((char *)data, size);
+		file.close();
+
+		LOG_DEBUG(WIFI, "Read legacy %s (%u bytes) in %lld us\n", path.c_str(), length, esp_timer_get_time() - startUs);
+		return length > 0;
+	}
 
-			if (m_managerConfig.m_checksum != calcChecksum((uint8_t *)&m_managerConfig, sizeof(m_managerConfig) - sizeof(m_managerConfig.m_checksum))) {
-				LOG_PRINTF("Config checksum failed!\n");
+	void migrateLegacyFile(const String &path, const char *name, const uint16_t &version, const void *data, const size_t &size)
+	{
+		if (configSave(name, version, data, size)) {
+			LOG_INFO(WIFI, "Migrated %s to the config store\n", path.c_str());
+			SPIFFS.remove(path);
+		}
+	}
+
+	bool wifiLoadConfiguration()
+	{
+		WiFiConfigRecord record;
+		LOG_DEBUG(WIFI, "Loading config...\n");
+
+		if (!configLoad(WIFI_CONFIG_RECORD, WIFI_CONFIG_VERSION, &record, sizeof(record))) {
+			if (!readLegacyFile(CONFIG_FILENAME, &record, sizeof(record))) {
+				LOG_WARN(WIFI, "Loading of config failed!\n");
+				memset((void *)&m_managerConfig, 0, sizeof(m_managerConfig));
+				memset((void *)&m_clientConfig, 0, sizeof(m_clientConfig));
 				return false;
-			} else {
-				LOG_PRINTF("Config loaded correctly\n");
 			}
 
-			displayClientConfig();
-			displayCredentials();
-			return true;
-		} else {
-			LOG_PRINTF("Loading of config failed!\n");
-			return false;
+			if (record.m_manager.m_checksum != calcChecksum((uint8_t *)&record.m_manager, sizeof(record.m_manager) - sizeof(record.m_manager.m_checksum))) {
+				LOG_ERROR(WIFI, "Config checksum failed!\n");
+				SPIFFS.remove(CONFIG_FILENAME);
+				memset((void *)&m_managerConfig, 0, sizeof(m_managerConfig));
+				memset((void *)&m_clientConfig, 0, sizeof(m_clientConfig));
+				return false;
+			}
+
+			migrateLegacyFile(CONFIG_FILENAME, WIFI_CONFIG_RECORD, WIFI_CONFIG_VERSION, &record, sizeof(record));
 		}
+
+		// copied member by member, the IP addresses are objects
+		m_managerConfig = record.m_manager;
+		m_clientConfig = record.m_ip;
+		LOG_DEBUG(WIFI, "Config loaded correctly\n");
+
+		displayClientConfig();
+		displayCredentials();
+		return true;
 	}
 
 	bool wifiLoadLastParams()
 	{
-		File file = SPIFFS.open(LAST_PARAMS_FILENAME, "r");
-		LOG_PRINTF("Loading last params...\n");
+		WiFiMultiSSID::LastParams params;
+		LOG_DEBUG(WIFI, "Loading last params...\n");
 
 		memset((void *)&m_lastWiFiParams, 0, sizeof(m_lastWiFiParams));
 
-		if (file) {
-			file.readBytes((char *)&m_lastWiFiParams, sizeof(m_lastWiFiParams));
-			file.close();
-			LOG_PRINTF("Last params loading succeeded\n");
-
-			// sometimes it can happen that last params don't contain any password
-			// (this can happen when the connection is completed before the AP wizard finishes)
-			// In that case try to fill the password by matching the SSID:
-			if (!m_lastWiFiParams.m_credentials.m_password[0]) {
-				for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
-					if (String(m_managerConfig.m_credentials[i].m_ssid) == String(m_lastWiFiParams.m_credentials.m_ssid)) {
-						strcpy(m_lastWiFiParams.m_credentials.m_password, m_managerConfig.m_credentials[i].m_password);
-						break;
-					}
-				}
+		if (!configLoad(WIFI_PARAMS_RECORD, WIFI_PARAMS_VERSION, &params, sizeof(params))) {
+			if (!readLegacyFile(LAST_PARAMS_FILENAME, &params, sizeof(params))) {
+				LOG_WARN(WIFI, "Last params loading failed!\n");
+				return false;
 			}
+			migrateLegacyFile(LAST_PARAMS_FILENAME, WIFI_PARAMS_RECORD, WIFI_PARAMS_VERSION, &params, sizeof(params));
+		}
 
-			displayLastWifiParams(m_lastWiFiParams);
-			return true;
-		} else {
-			LOG_PRINTF("Last params loading failed!\n");
-			return false;
+		m_lastWiFiParams = params;
+		LOG_DEBUG(WIFI, "Last params loading succeeded\n");
+
+		// sometimes it can happen that last params don't contain any password
+		// (this can happen when the connection is completed before the AP wizard finishes)
+		// In that case try to fill the password by matching the SSID:
+		if (!m_lastWiFiParams.m_credentials.m_password[0]) {
+			for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
+				if (String(m_managerConfig.m_credentials[i].m_ssid) == String(m_lastWiFiParams.m_credentials.m_ssid)) {
+					strcpy(m_lastWiFiParams.m_credentials.m_password, m_managerConfig.m_credentials[i].m_password);
+					break;
+				}
+			}
 		}
+
+		displayLastWifiParams(m_lastWiFiParams);
+		return true;
 	}
 
 	void wifiEraseConfiguration()
 	{
-		LOG_PRINTF("Erasing config...\n");
+		LOG_INFO(WIFI, "Erasing config...\n");
 		memset((void *)&m_managerConfig, 0, sizeof(m_managerConfig));
 		memset((void *)&m_clientConfig, 0, sizeof(m_clientConfig));
 		wifiSaveConfiguration();
 
-		LOG_PRINTF("Erasing last params...\n");
+		LOG_INFO(WIFI, "Erasing last params...\n");
 		memset((void *)&m_lastWiFiParams, 0, sizeof(m_lastWiFiParams));
 		wifiSaveLastParams();
+
+		memset((void *)&m_lease, 0, sizeof(m_lease));
+		configErase(WIFI_LEASE_RECORD);
+
+		memset((void *)&m_wifiMulti.history().table(), 0, sizeof(WiFiHistory::Table));
+		configErase(WIFI_HISTORY_RECORD);
+
+		// files of older firmware must not come back
+		if (m_legacyFiles) {
+			SPIFFS.remove(CONFIG_FILENAME);
+			SPIFFS.remove(LAST_PARAMS_FILENAME);
+			SPIFFS.remove(LAST_LEASE_FILENAME);
+			finishLegacyFiles();
+		}
 	}
 
 	void wifiSaveConfiguration()
 	{
-		File file = SPIFFS.open(CONFIG_FILENAME, "w");
-		LOG_PRINTF("Saving config...\n");
+		WiFiConfigRecord record;
+		LOG_DEBUG(WIFI, "Saving config...\n");
 
-		if (file) {
-			m_managerConfig.m_checksum = calcChecksum((uint8_t *)&m_managerConfig, sizeof(m_managerConfig) - sizeof(m_managerConfig.m_checksum));
-			file.write((uint8_t *)&m_managerConfig, sizeof(m_managerConfig));
+		record.m_manager = m_managerConfig;
+		record.m_ip = m_clientConfig;
 
-			displayClientConfig();
-			displayCredentials();
+		displayClientConfig();
+		displayCredentials();
 
-			file.write((uint8_t *)&m_clientConfig, sizeof(m_clientConfig));
-			file.close();
-			LOG_PRINTF("Config saved successfully\n");
+		if (configSave(WIFI_CONFIG_RECORD, WIFI_CONFIG_VERSION, &record, sizeof(record))) {
+			LOG_DEBUG(WIFI, "Config saved successfully\n");
 		} else {
-			LOG_PRINTF("Failed to save config!\n");
+			LOG_ERROR(WIFI, "Failed to save config!\n");
 		}
 	}
 
 	void wifiSaveLastParams()
 	{
-		File file = SPIFFS.open(LAST_PARAMS_FILENAME, "w");
-		LOG_PRINTF("Saving last params...\n");
+		LOG_DEBUG(WIFI, "Saving last params...\n");
 
-		if (file) {
-			file.write((uint8_t *)&m_lastWiFiParams, sizeof(m_lastWiFiParams));
-			file.close();
-			LOG_PRINTF("Last params saved successfully\n");
+		if (configSave(WIFI_PARAMS_RECORD, WIFI_PARAMS_VERSION, &m_lastWiFiParams, sizeof(m_lastWiFiParams))) {
+			LOG_DEBUG(WIFI, "Last params saved successfully\n");
 		} else {
-			LOG_PRINTF("Failed to save last params!\n");
+			LOG_ERROR(WIFI, "Failed to save last params!\n");
 		}
 	}
 
@@ -356,16 +944,16 @@ public:
 		// keep current channel number
 		lastParams.m_channel = info.connected.channel;
 
-		LOG_PRINTF("Station connected!\n");
+		LOG_INFO(WIFI, "Station connected!\n");
 
 		// check if the configuration is different than the one currently cached
 		if (memcmp(&lastParams, &m_lastWiFiParams, sizeof(lastParams)) != 0) {
-			LOG_PRINTF("Last WiFi params have changed!\n");
+			LOG_DEBUG(WIFI, "Last WiFi params have changed!\n");
 			// copy the new configuration and save it
 			memcpy(&m_lastWiFiParams, &lastParams, sizeof(lastParams));
 			wifiSaveLastParams();	
 		} else {
-			LOG_PRINTF("Got the same WiFi params again\n");
+			LOG_DEBUG(WIFI, "Got the same WiFi params again\n");
 		}
 
 		displayLastWifiParams(lastParams);
@@ -373,43 +961,27 @@ public:
 
 	void wifiSetup()
 	{
-		LOG_PRINTF("Starting Wifi Manager using SPIFFS on %s %s %s\n", ARDUINO_BOARD, ESP_ASYNC_WIFIMANAGER_VERSION, ESP_DOUBLE_RESET_DETECTOR_VERSION);
-
-		// disable watchdgog as formatting may take a long time
-		watchdogEnable(false);
-		if (!SPIFFS.begin(true)) {
-			LOG_PRINTF("SPIFFS/LittleFS failed! Already tried formatting.\n");
-
-			if (!SPIFFS.begin()) {
-				// prevents debug info from the library to hide err message.
-				delay(100);
-				LOG_PRINTF("SPIFFS failed!. Please use LittleFS or EEPROM. Stay forever\n");
-				watchdogEnable(true);
+		LOG_INFO(WIFI, "Starting Wifi Manager on %s %s %s\n", ARDUINO_BOARD, ESP_ASYNC_WIFIMANAGER_VERSION, ESP_DOUBLE_RESET_DETECTOR_VERSION);
 
-				while (true) {
-					delay(1);
-				}
-			}
-		}
-		// re-enable watchdog
-		watchdogEnable(true);
-
-		File root = SPIFFS.open("/");
-		File file = root.openNextFile();
-
-		while (file) {
-			String fileName = file.name();
-			size_t fileSize = file.size();
-			LOG_PRINTF("FS File: %s, size: %f kB\n", fileName.c_str(), fileSize / 1024.0);
-			file = root.openNextFile();
-		}
-
-		LOG_PRINTF("\n");
+		// SPIFFS only if files of older firmware may be left
+		int8_t span = bootTraceBegin("legacyFs");
+		checkLegacyFiles();
+		bootTraceEnd(span);
 
+		span = bootTraceBegin("drd");
 		m_drd = new DoubleResetDetector(DRD_TIMEOUT, DRD_ADDRESS);
 
 		if (!m_drd)
-			LOG_PRINTF("Can't instantiate. Disable DRD feature\n");
+			LOG_ERROR(WIFI, "Can't instantiate. Disable DRD feature\n");
+		bootTraceEnd(span);
+
+		// connection state changes drive the state machine
+		if (!m_stateEventId) {
+			m_stateEventId = WiFi.onEvent(
+				[](system_event_id_t event, system_event_info_t info) -> void {
+					WiFiContext::instance().onWiFiEvent(event);
+				});
+		}
 
 		// start manager now
 		wifiStartManager();
@@ -417,7 +989,8 @@ public:
 
 	void wifiStartManager()
 	{
-		m_connected = false;
+		setState(WIFI_STATE_DISCONNECTED);
+		readinessClear(READY_CONFIG_LOADED);
 
 		bool shallRunAccessPoint = false;
 
@@ -426,14 +999,20 @@ public:
 		//
 
 		bool configDataLoaded = false;
+		int8_t span = bootTraceBegin("loadConfig");
+		wifiLoadLease();
+		wifiLoadHistory();
+
 		if (wifiLoadConfiguration() && wifiLoadLastParams()) {
 			configDataLoaded = true;
-			LOG_PRINTF("Got stored WiFiMultiSSID::Credentials. Timeout 120s for Config Portal\n");
+			LOG_INFO(WIFI, "Got stored WiFiMultiSSID::Credentials. Timeout 120s for Config Portal\n");
 		} else {
 			// Enter CP only if no stored SSID on flash and file
-			LOG_PRINTF("Open Config Portal without Timeout: No stored WiFiMultiSSID::Credentials.\n");
+			LOG_INFO(WIFI, "Open Config Portal without Timeout: No stored WiFiMultiSSID::Credentials.\n");
 			shallRunAccessPoint = true;
 		}
+		finishLegacyFiles();
+		bootTraceEnd(span);
 
 		//
 		// set default host name if explicit hostname was provided
@@ -443,60 +1022,40 @@ public:
 			strcpy(m_managerConfig.m_hostName, m_ssid.c_str());
 		}
 
-		LOG_PRINTF("Using host name %s\n", m_managerConfig.m_hostName);
+		LOG_INFO(WIFI, "Using host name %s\n", m_managerConfig.m_hostName);
 
 		//
 		// create instance of WiFi manager
 		//
 
-		#if (USING_ESP32_S2 || USING_ESP32_C3)
-		ESPAsync_WiFiManager manager(&m_httpServer, NULL, m_managerConfig.m_hostName);
-		#else
-		DNSServer m_dnsServer;
-		ESPAsync_WiFiManager manager(&m_httpServer, &m_dnsServer, m_managerConfig.m_hostName);
-		#endif
-
-		#if USE_CUSTOM_AP_IP
-		// set custom ip for portal
-		manager.setAPStaticIPConfig(m_apIpAddress, m_apGateway, m_apMask);
-		#endif
-
-		manager.setMinimumSignalQuality(-1);			// no minimum signal quality
-		manager.setConfigPortalChannel(0);				// Set config portal channel, default = 1. Use 0 => random channel from 1-13
-
-		#if USING_CORS_FEATURE
-		manager.setCORSHeader("Your Access-Control-Allow-Origin");
-		#endif
-
-		m_password = "";
+		createManager();
 
 		// if we have been previously connected to some network, specify 2 minute timeout for AP mode
-		if ((manager.WiFi_SSID() != "") || configDataLoaded) {
-			manager.setConfigPortalTimeout(120);
-			LOG_PRINTF("Got ESP Self-Stored WiFiMultiSSID::Credentials. Timeout 120s for Config Portal\n");
+		bool configured = (m_manager->WiFi_SSID() != "") || configDataLoaded;
+		if (configured) {
+			m_manager->setConfigPortalTimeout(120);
+			LOG_INFO(WIFI, "Got ESP Self-Stored WiFiMultiSSID::Credentials. Timeout 120s for Config Portal\n");
 		}
 
 		if (m_managerConfig.m_forceAp) {
-			LOG_PRINTF("AP forced\n");
+			LOG_INFO(WIFI, "AP forced\n");
 			shallRunAccessPoint = true;
 		}
 
 		// if we don't have valid credentials, force AP too
 		if (!m_managerConfig.m_credentials->m_ssid[0]) {
-			LOG_PRINTF("No valid WiFi credentials stored, AP forced\n");
+			LOG_WARN(WIFI, "No valid WiFi credentials stored, AP forced\n");
 			shallRunAccessPoint = true;
 		}
 
 		if (m_drd->detectDoubleReset()) {
-			// DRD, disable timeout.
-			manager.setConfigPortalTimeout(0);
-			LOG_PRINTF("Open Config Portal without Timeout: Double Reset Detected\n");
+			// DRD, longer timeout; the station isn't retried while the portal
+			// is open, so it only stays open for good if there is nothing to retry
+			m_manager->setConfigPortalTimeout(configured ? WIFI_DRD_PORTAL_TIMEOUT_S : 0);
+			LOG_INFO(WIFI, "Open Config Portal with Timeout %ds: Double Reset Detected\n", configured ? WIFI_DRD_PORTAL_TIMEOUT_S : 0);
 			shallRunAccessPoint = true;
 		}
 
-		ESPAsync_WMParameter customHostName("hostName",  "host name", m_managerConfig.m_hostName,  HOST_NAME_LEN);
-		manager.addParameter(&customHostName);
-
 		// register event handler for SYSTEM_EVENT_STA_CONNECTED message
 		// (so we can cache details about the last connection)
 		if (!m_wifiEventId) {
@@ -507,152 +1066,255 @@ public:
 				SYSTEM_EVENT_STA_CONNECTED);
 		}
 
+		// the server task waits for the configuration to learn whether a
+		// portal is going to own the web server
+		if (shallRunAccessPoint) {
+			m_portalActive = true;
+		}
+		readinessSet(READY_CONFIG_LOADED);
+
 		//
-		// shall we run AccesPoint?
+		// connect to configured WiFi network, the portal (if any) is started
+		// afterwards and runs next to the station
 		//
 
+		unsigned long startedAt = millis();
+
+		if (addConfiguredAPs() && WiFi.status() != WL_CONNECTED) {
+			LOG_DEBUG(WIFI, "ConnectMultiWiFi in setup\n");
+			setState(WIFI_STATE_CONNECTING);
+			span = bootTraceBegin("connect");
+			connectMultiWiFi();
+			bootTraceEnd(span);
+		}
+
+		LOG_INFO(WIFI, "After waiting %f secs more in setup(), connection result is \n", (float)(millis() - startedAt) / 1000);
+
+		// we can stop double reset detector
+		if (m_drd) {
+			m_drd->stop();
+		}
+
+		if (WiFi.status() == WL_CONNECTED) {
+			LOG_INFO(WIFI, "Connected. Local IP: %s\n", WiFi.localIP().toString().c_str());
+		}
+		else {
+			LOG_INFO(WIFI, "%s\n", m_manager->getStatus(WiFi.status()));
+		}
+
 		if (shallRunAccessPoint) {
+			startConfigPortal();
+		} else {
+			deleteManager();
+		}
 
-			// show orange color indicating we are in setup mode
-			setLedColor(COLOR_YELLOW);
+		// from now on the state machine keeps the connection alive
+		updateConnectedState();
+	}
 
-			// clear last wifi params
-			memset((void *)&m_lastWiFiParams, 0, sizeof(m_lastWiFiParams));
-			wifiSaveLastParams();
+	// add the stored credentials to the connection helper, returns their number
+	uint8_t addConfiguredAPs()
+	{
+		uint8_t count = 0;
 
-			#if USE_CUSTOM_AP_IP
-			LOG_PRINTF("Starting configuration portal @%s\n", m_apIpAddress);
-			#else
-			LOG_PRINTF("Starting configuration portal @%s\n", "192.168.4.1");
-			#endif
-
-			// configure our stored static ip config if available
-			manager.setSTAStaticIPConfig(m_clientConfig);
-			LOG_PRINTF("SSID = %s, PWD = %s\n", m_ssid.c_str(), m_password.length() ? m_password.c_str() : "<none>");
-
-			// Starts an access point (with disabled watchdog)
-			watchdogOverride([&]{
-				if (!manager.startConfigPortal((const char *)m_ssid.c_str(), m_password.c_str())){
-					LOG_PRINTF("Not connected to WiFi but continuing anyway.\n");
-				} else {
-					LOG_PRINTF("WiFi connected\n");
-				}
-			});
+		m_wifiMulti.clearAPs();
+		m_wifiMulti.setListenInterval(powerListenInterval());
 
-			// copy WiFi configuration from manager to our local structures
-			for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
-				String tempSSID = manager.getSSID(i);
-				String tempPW = manager.getPW(i);
-
-				if (tempSSID.length()) {
-					LOG_PRINTF("Updating WiFi credentials %d:\n", i);
-					LOG_PRINTF("SSID: %s -> %s\n", m_managerConfig.m_credentials[i].m_ssid[0] ? m_managerConfig.m_credentials[i].m_ssid : "<empty>", tempSSID.length() ? tempSSID.c_str() : "<empty>");
-					LOG_PRINTF("PASS: %s -> %s\n\n", PASSWORD_STR(m_managerConfig.m_credentials[i].m_password), PASSWORD_STR(tempPW.c_str()));
-
-					if (strlen(tempSSID.c_str()) < sizeof(m_managerConfig.m_credentials[i].m_ssid) - 1)
-						strcpy(m_managerConfig.m_credentials[i].m_ssid, tempSSID.c_str());
-					else
-						strncpy(m_managerConfig.m_credentials[i].m_ssid, tempSSID.c_str(), sizeof(m_managerConfig.m_credentials[i].m_ssid) - 1);
-
-					if (strlen(tempPW.c_str()) < sizeof(m_managerConfig.m_credentials[i].m_password) - 1)
-						strcpy(m_managerConfig.m_credentials[i].m_password, tempPW.c_str());
-					else
-						strncpy(m_managerConfig.m_credentials[i].m_password, tempPW.c_str(), sizeof(m_managerConfig.m_credentials[i].m_password) - 1);
-				} else {
-					LOG_PRINTF("No new credentials configured at position %d\n", i);
+		for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
+			// Don't permit NULL SSID and password len < MIN_AP_PASSWORD_SIZE (8)
+			if ((String(m_managerConfig.m_credentials[i].m_ssid) != "") && (strlen(m_managerConfig.m_credentials[i].m_password) >= MIN_AP_PASSWORD_SIZE)) {
+				LOG_DEBUG(WIFI, "* Add SSID = %s, pw = %s\n", m_managerConfig.m_credentials[i].m_ssid, PASSWORD_STR(m_managerConfig.m_credentials[i].m_password));
+				if (m_wifiMulti.addAP(m_managerConfig.m_credentials[i].m_ssid, m_managerConfig.m_credentials[i].m_password)) {
+					count++;
 				}
 			}
+		}
+		return count;
+	}
 
-			// read static IP address configuration from manager
-			manager.getSTAStaticIPConfig(m_clientConfig);
+	//
+	// configuration portal
+	//
+	// startConfigPortal() of the manager blocks until the portal is closed or
+	// times out, so it runs in a task of its own. The manager switches to
+	// AP+STA and the station stays on its network, so the state machine keeps
+	// running; the WiFi task picks up the result on WIFI_PORTAL_DONE_BIT. The
+	// portal task runs library code only and is not supervised by the
+	// watchdog.
+	//
+
+	void createManager()
+	{
+		#if (USING_ESP32_S2 || USING_ESP32_C3)
+		m_manager = new ESPAsync_WiFiManager(&m_httpServer, NULL, m_managerConfig.m_hostName);
+		#else
+		m_manager = new ESPAsync_WiFiManager(&m_httpServer, &m_dnsServer, m_managerConfig.m_hostName);
+		#endif
 
-			// read new host name from manager
-			strcpy(m_managerConfig.m_hostName, customHostName.getValue());
+		#if USE_CUSTOM_AP_IP
+		// set custom ip for portal
+		m_manager->setAPStaticIPConfig(m_apIpAddress, m_apGateway, m_apMask);
+		#endif
 
-			// clear force flag
-			m_managerConfig.m_forceAp = false;
+		m_manager->setMinimumSignalQuality(-1);			// no minimum signal quality
 
-			// store selected configuration
-			wifiSaveConfiguration();
+		#if USING_CORS_FEATURE
+		m_manager->setCORSHeader("Your Access-Control-Allow-Origin");
+		#endif
 
-			// hide AP notification
-			setLedColor(0);
-		}
+		m_password = "";
 
-		//
-		// if needed, load WiFi configuration from persistent memory
-		//
+		m_hostNameParam = new ESPAsync_WMParameter("hostName", "host name", m_managerConfig.m_hostName, HOST_NAME_LEN);
+		m_manager->addParameter(m_hostNameParam);
+	}
 
-		if (!configDataLoaded) {
-			wifiLoadConfiguration();
-			wifiLoadLastParams();
+	void deleteManager()
+	{
+		delete m_manager;
+		m_manager = NULL;
+		delete m_hostNameParam;
+		m_hostNameParam = NULL;
+	}
+
+	static void portalTask(void *pvParameters)
+	{
+		WiFiContext *ctx = (WiFiContext *)pvParameters;
+		ctx->m_portalConnected = ctx->m_manager->startConfigPortal(ctx->m_ssid.c_str(), ctx->m_password.c_str());
+		xEventGroupSetBits(ctx->m_events, WIFI_PORTAL_DONE_BIT);
+		vTaskDelete(NULL);
+	}
+
+	void startConfigPortal()
+	{
+		m_portalActive = true;
+		m_portalConnected = false;
+		m_portalSpan = bootTraceBegin("portal");
+
+		// show orange color indicating we are in setup mode
+		setLedColor(COLOR_YELLOW);
+
+		#if USE_CUSTOM_AP_IP
+		LOG_INFO(WIFI, "Starting configuration portal @%s\n", m_apIpAddress.toString().c_str());
+		#else
+		LOG_INFO(WIFI, "Starting configuration portal @%s\n", "192.168.4.1");
+		#endif
+
+		// configure our stored static ip config if available
+		m_manager->setSTAStaticIPConfig(m_clientConfig);
+
+		// the access point shares the radio with the station, so it has to
+		// use the station's channel; random channel 1-13 otherwise
+		m_manager->setConfigPortalChannel(WiFi.status() == WL_CONNECTED ? WiFi.channel() : 0);
+		LOG_INFO(WIFI, "SSID = %s, PWD = %s\n", m_ssid.c_str(), m_password.length() ? m_password.c_str() : "<none>");
+
+		xEventGroupClearBits(m_events, WIFI_PORTAL_DONE_BIT);
+		if (xTaskCreatePinnedToCore(portalTask, "portalTask", WIFI_PORTAL_STACK_SIZE, this, 1, NULL, ARDUINO_RUNNING_CORE) != pdPASS) {
+			LOG_ERROR(WIFI, "Failed to start the configuration portal task!\n");
+			xEventGroupSetBits(m_events, WIFI_PORTAL_DONE_BIT);
 		}
+	}
 
-		//
-		// add all configured access points
-		//
+	// take over what was configured in the portal
+	void finishConfigPortal()
+	{
+		bool changed = false;
+
+		if (m_portalConnected) {
+			LOG_INFO(WIFI, "Configuration portal closed, WiFi connected\n");
+		} else {
+			LOG_INFO(WIFI, "Configuration portal closed\n");
+		}
 
+		// copy WiFi configuration from manager to our local structures
 		for (uint8_t i = 0; i < NUM_WIFI_CREDENTIALS; i++) {
-			// Don't permit NULL SSID and password len < MIN_AP_PASSWORD_SIZE (8)
-			if ((String(m_managerConfig.m_credentials[i].m_ssid) != "") && (strlen(m_managerConfig.m_credentials[i].m_password) >= MIN_AP_PASSWORD_SIZE)) {
-				LOG_PRINTF("* Add SSID = %s, pw = %s\n", m_managerConfig.m_credentials[i].m_ssid, PASSWORD_STR(m_managerConfig.m_credentials[i].m_password));
-				m_wifiMulti.addAP(m_managerConfig.m_credentials[i].m_ssid, m_managerConfig.m_credentials[i].m_password);
+			String tempSSID = m_manager->getSSID(i);
+			String tempPW = m_manager->getPW(i);
+
+			if (tempSSID.length()) {
+				LOG_INFO(WIFI, "Updating WiFi credentials %d:\n", i);
+				LOG_INFO(WIFI, "SSID: %s -> %s\n", m_managerConfig.m_credentials[i].m_ssid[0] ? m_managerConfig.m_credentials[i].m_ssid : "<empty>", tempSSID.length() ? tempSSID.c_str() : "<empty>");
+				LOG_INFO(WIFI, "PASS: %s -> %s\n\n", PASSWORD_STR(m_managerConfig.m_credentials[i].m_password), PASSWORD_STR(tempPW.c_str()));
+
+				WiFiMultiSSID::Credentials previous = m_managerConfig.m_credentials[i];
+				strlcpy(m_managerConfig.m_credentials[i].m_ssid, tempSSID.c_str(), sizeof(m_managerConfig.m_credentials[i].m_ssid));
+				strlcpy(m_managerConfig.m_credentials[i].m_password, tempPW.c_str(), sizeof(m_managerConfig.m_credentials[i].m_password));
+				changed |= memcmp(&previous, &m_managerConfig.m_credentials[i], sizeof(previous)) != 0;
+			} else {
+				LOG_DEBUG(WIFI, "No new credentials configured at position %d\n", i);
 			}
 		}
 
-		//
-		// connect to configured WiFi network
-		//
+		// read static IP address configuration from manager
+		m_manager->getSTAStaticIPConfig(m_clientConfig);
 
-		unsigned long startedAt = millis();
+		// read new host name from manager
+		strlcpy(m_managerConfig.m_hostName, m_hostNameParam->getValue(), sizeof(m_managerConfig.m_hostName));
 
-		if (WiFi.status() != WL_CONNECTED) {
-			LOG_PRINTF("ConnectMultiWiFi in setup\n");
-			connectMultiWiFi();
-		}
+		// clear force flag
+		m_managerConfig.m_forceAp = false;
 
-		LOG_PRINTF("After waiting %f secs more in setup(), connection result is \n", (float)(millis() - startedAt) / 1000);
+		// store selected configuration
+		wifiSaveConfiguration();
+		deleteManager();
+		addConfiguredAPs();
 
-		// we can stop double reset detector
-		if (m_drd) {
-			m_drd->stop();
+		// the last access point belongs to the old credentials, unless the
+		// portal connected with the new ones already
+		if (changed && !m_portalConnected) {
+			memset((void *)&m_lastWiFiParams, 0, sizeof(m_lastWiFiParams));
+			wifiSaveLastParams();
 		}
 
-		if (WiFi.status() == WL_CONNECTED) {
-			// from now on we are connected
-			m_connected = true;
-			LOG_PRINTF("Connected. Local IP: %s\n", WiFi.localIP().toString().c_str());
-		}
-		else {
-			LOG_PRINTF(manager.getStatus(WiFi.status()));
+		// hide AP notification
+		setLedColor(0);
+		bootTraceEnd(m_portalSpan);
+		m_portalSpan = -1;
+		m_portalActive = false;
+
+		if (WiFi.status() == WL_CONNECTED && (m_portalConnected || !changed)) {
+			// still on the network, or on the new one the portal connected to
+			if (m_state != WIFI_STATE_CONNECTED) {
+				onConnected();
+			}
+		} else {
+			// reconnect using the new credentials
+			setState(WIFI_STATE_DISCONNECTED);
 		}
 	}
 
-	bool connected()
+	WiFiState state()
 	{
-		return m_connected;
+		return m_state;
 	}
 
-	// initiate reconfiguration and wait until it is finished
-	bool reconfigure()
+	bool portalActive()
 	{
-		m_shallReconfigure = true;
+		return m_portalActive;
+	}
 
-		// wait until reconfiguration is finished
-		while (m_shallReconfigure) {
-			delay(100);
+	// request the configuration portal, false if one is open already
+	bool reconfigure()
+	{
+		if (m_portalActive) {
+			return false;
 		}
+
+		m_portalActive = true;
+		m_shallReconfigure = true;
+		xEventGroupSetBits(m_events, WIFI_REQUEST_BIT);
 		return true;
 	}
 
+	// request erasing the configuration and the portal, false if a portal is open
 	bool reset()
 	{
-		m_shallReset = true;
-
-		// wait until reset is finished
-		while (m_shallReset) {
-			delay(100);
+		if (m_portalActive) {
+			return false;
 		}
+
+		m_portalActive = true;
+		m_shallReset = true;
+		xEventGroupSetBits(m_events, WIFI_REQUEST_BIT);
 		return true;
 	}
 
@@ -672,14 +1334,12 @@ public:
 			//
 
 			if (m_shallReconfigure) {
-				LOG_PRINTF("WiFi reconfiguration initiated!\n");
+				m_shallReconfigure = false;
+				LOG_INFO(WIFI, "WiFi reconfiguration initiated!\n");
 
 				// force ap in settings
 				m_managerConfig.m_forceAp = true;
 				wifiSaveConfiguration();
-
-				// disconnect from wifi
-				WiFi.disconnect();
 #if RESET_WHEN_RECONFIGURING_WIFI
 				// and reboot the board
 				watchdogScheduleReboot();
@@ -689,14 +1349,16 @@ public:
 					delay(100);
 				}
 #else
-				wifiStartManager();
+				// the station stays connected, the portal runs next to it
+				createManager();
+				m_manager->setConfigPortalTimeout(120);
+				startConfigPortal();
 #endif
-				LOG_PRINTF("WiFi reconfiguration finished\n");
-				m_shallReconfigure = false;
 			}
 
 			if (m_shallReset) {
-				LOG_PRINTF("WiFi reset initiated!\n");
+				m_shallReset = false;
+				LOG_INFO(WIFI, "WiFi reset initiated!\n");
 
 				// erase settings
 				wifiEraseConfiguration();
@@ -712,10 +1374,9 @@ public:
 					delay(100);
 				}
 #else
+				// no credentials left, starts the portal
 				wifiStartManager();
 #endif
-				LOG_PRINTF("WiFi reset finished\n");
-				m_shallReset = false;
 			}
 
 			// Call the double reset detector loop method every so often,
@@ -726,14 +1387,18 @@ public:
 				m_drd->loop();
 			}
 
-			wifiCheckStatus();
-			delay(100);
+			// sleep until something happens
+			EventBits_t bits = xEventGroupWaitBits(m_events, WIFI_WAKEUP_BITS, pdTRUE, pdFALSE, pdMS_TO_TICKS(waitMs()));
+			processEvents(bits);
 		}
 	}
 };
 
 void wifiTask(void *pvParameters __attribute__((unused)))
 {
+	watchdogRegister();
+	profilerRegister();
+
 	// init
 	WiFiContext::instance().wifiSetup();
 
@@ -751,16 +1416,29 @@ bool wifiReset()
 	return WiFiContext::instance().reset();
 }
 
+bool wifiPortalActive()
+{
+	return WiFiContext::instance().portalActive();
+}
+
 bool wifiIsConnected()
 {
-	return WiFiContext::instance().connected();
+	return readinessGet() & READY_NETWORK_UP;
 }
 
 void wifiWaitForConnection()
 {
-	while (!wifiIsConnected()) {
-		delay(500);
-	}
+	readinessWait(READY_NETWORK_UP);
+}
+
+WiFiState wifiState()
+{
+	return WiFiContext::instance().state();
+}
+
+WiFiStats wifiStats()
+{
+	return WiFiContext::instance().stats();
 }
 
 AsyncWebServer *wifiGetHttpServer()
@@ -772,9 +1450,9 @@ String wifiHostName()
 {
 	const char *hostName = WiFi.getHostname();
 	if (hostName) {
-		LOG_PRINTF("Retrieved WiFi hostname: %s\n", hostName);
+		LOG_DEBUG(WIFI, "Retrieved WiFi hostname: %s\n", hostName);
 		return hostName;
 	}
-	LOG_PRINTF("Unable to retrieve WiFi hostname!\n");
+	LOG_ERROR(WIFI, "Unable to retrieve WiFi hostname!\n");
 	return "";
 }
@@ -2,12 +2,53 @@
 
 #include <WiFi.h>
 #include <ESPAsyncWebServer.h>
+#include "WiFiMultiSSID.h"
+
+enum WiFiState {
+	WIFI_STATE_DISCONNECTED,	// reconnect right away
+	WIFI_STATE_CONNECTING,
+	WIFI_STATE_CONNECTED,		// connected and got an IP address
+	WIFI_STATE_BACKOFF,			// waiting before the next connection attempt
+	WIFI_STATE_ROAMING,			// switching to a stronger access point
+};
+
+struct WiFiRoamStats {
+	uint32_t m_scans;			// background scans started
+	uint32_t m_roams;			// successful switches to another BSSID
+	uint32_t m_failures;		// switches that ended in a regular reconnect
+	uint32_t m_lastDowntimeMs;	// link down time of the last switch
+	uint32_t m_maxDowntimeMs;
+	uint32_t m_totalDowntimeMs;
+};
+
+struct WiFiStats {
+	uint32_t m_connects;		// connection attempts
+	uint32_t m_lastConnectMs;	// duration of the last attempt
+	uint32_t m_maxConnectMs;	// worst case since boot
+	bool m_leaseInUse;
+	uint32_t m_leaseIp;
+	uint32_t m_leaseS;
+	uint32_t m_leaseRenewInS;
+	WiFiRoamStats m_roam;
+	WiFiMultiSSID::ScanStats m_scan;
+	WiFiHistory::Entry m_history[WIFI_HISTORY_SIZE];	// m_lastUsed 0 for unused entries
+	char m_historySSID[WIFI_HISTORY_SIZE][SSID_MAX_LEN];	// empty if no longer configured
+};
 
 void wifiTask(void *pvParameters __attribute__((unused)));
+
+// start the configuration portal next to the normal operation, erasing the
+// configuration first for wifiReset(); false if a portal is open already
 bool wifiReconfigure();
 bool wifiReset();
+
+// a portal was requested or is running, it owns the web server meanwhile
+bool wifiPortalActive();
+
 bool wifiIsConnected();
 void wifiWaitForConnection();
+WiFiState wifiState();
+WiFiStats wifiStats();
 AsyncWebServer *wifiGetHttpServer();
 String wifiHostName();
 
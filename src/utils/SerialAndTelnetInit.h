@@ -3,7 +3,7 @@
 #include <Arduino.h>
 #include "config.h"
 #include "utils.h"
-#include "../tasks/wifiTask.h"
+#include "telnetConsole.h"
 
 class SerialAndTelnetInit {
 private:
@@ -15,41 +15,23 @@ public:
 		// create semaphore for watchdog
 		m_mutex = xSemaphoreCreateMutex();
 
-#if BUILD_PICO_STAMP
-		SerialAndTelnet.setWelcomeMsg((char *)"CarbonDioxide server (M5Stamp variant) by Embedded Softworks, s.r.o.\n\n");
-#else
-		SerialAndTelnet.setWelcomeMsg((char *)"CarbonDioxide server (M5AtomLite variant) by Embedded Softworks, s.r.o.\n\n");
-#endif
-
-		SerialAndTelnet.setCallbackOnConnect([]{
-			SERIAL.println("Telnet connection established.");
-		});
-		SerialAndTelnet.setCallbackOnDisconnect([]{
-			SERIAL.println("Telnet connection closed.");
-		});
-
 		SERIAL.begin(115200);
 		SERIAL.flush();
 		delay(50);
 
-		// create task that will wait until Wifi is initialized and then handle all Telnet traffic
-		xTaskCreate(
-			[](void * parameter) {
-				// wait until the network is connected
-				wifiWaitForConnection();
+		// start telnet console, it waits for the network on its own
+#if BUILD_PICO_STAMP
+		telnetConsoleInit("CarbonDioxide server (M5Stamp variant) by Embedded Softworks, s.r.o.\n\n");
+#else
+		telnetConsoleInit("CarbonDioxide server (M5AtomLite variant) by Embedded Softworks, s.r.o.\n\n");
+#endif
+	}
 
-				while (1) {
-					// handle telnet
-					SerialAndTelnet.handle();
-					delay(50);
-				}
-			},
-			"telnetTask",
-			4096, // Stack size (bytes)
-			NULL, // Parameter
-			3,	  // Task priority
-			NULL  // Task handle
-		);
+	// write to serial and all telnet clients, call with lock held
+	static void print(const char *str)
+	{
+		SERIAL.print(str);
+		telnetConsoleWrite(str, strlen(str));
 	}
 
 	static bool lock()
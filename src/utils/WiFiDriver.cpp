@@ -0,0 +1,221 @@
+#include "WiFiDriver.h"
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include "utils.h"
+
+//
+// WiFiDriver on top of the Arduino WiFi library, with the ESP-IDF where the
+// library falls short (single channel scans, the listen interval)
+//
+
+class ArduinoWiFiDriver : public WiFiDriver {
+public:
+	ArduinoWiFiDriver()
+	{
+		m_scanEventId = WiFi.onEvent(
+			[this](system_event_id_t event, system_event_info_t info) -> void {
+				m_scanDone++;
+			},
+			SYSTEM_EVENT_SCAN_DONE);
+
+		m_associatedEventId = WiFi.onEvent(
+			[this](system_event_id_t event, system_event_info_t info) -> void {
+				m_associated++;
+			},
+			SYSTEM_EVENT_STA_CONNECTED);
+
+		m_disconnectedEventId = WiFi.onEvent(
+			[this](system_event_id_t event, system_event_info_t info) -> void {
+				m_disconnected++;
+			},
+			SYSTEM_EVENT_STA_DISCONNECTED);
+	}
+
+	virtual ~ArduinoWiFiDriver()
+	{
+		WiFi.removeEvent(m_scanEventId);
+		WiFi.removeEvent(m_associatedEventId);
+		WiFi.removeEvent(m_disconnectedEventId);
+	}
+
+	virtual uint32_t millis() override
+	{
+		return ::millis();
+	}
+
+	virtual void delay(const uint32_t &ms) override
+	{
+		::delay(ms);
+	}
+
+	virtual uint8_t status() override
+	{
+		return WiFi.status();
+	}
+
+	virtual void begin(const char *ssid, const char *password, const int32_t &channel, const uint8_t *bssid, const uint16_t &listenInterval) override
+	{
+		// WiFi.begin() rewrites the whole station config, the listen interval
+		// has to be set in between configuring and connecting
+		WiFi.begin(ssid, password, channel, bssid, false);
+
+		wifi_config_t config;
+		if (listenInterval && esp_wifi_get_config(WIFI_IF_STA, &config) == ESP_OK) {
+			config.sta.listen_interval = listenInterval;
+			esp_wifi_set_config(WIFI_IF_STA, &config);
+		}
+
+		esp_wifi_connect();
+	}
+
+	virtual void disconnect() override
+	{
+		WiFi.disconnect(false, false);
+	}
+
+	virtual void restart() override
+	{
+		WiFi.disconnect(true);	// Disconnect from the network
+		WiFi.mode(WIFI_OFF);	// Switch WiFi off
+		WiFi.disconnect(false);	// Reconnect the network
+		WiFi.mode(WIFI_STA);	// Switch WiFi on
+	}
+
+	virtual uint32_t associations() override
+	{
+		return m_associated;
+	}
+
+	virtual uint32_t disconnects() override
+	{
+		return m_disconnected;
+	}
+
+	virtual bool ssid(char *ssid, const size_t &size) override
+	{
+		if (WiFi.status() != WL_CONNECTED) {
+			return false;
+		}
+		strlcpy(ssid, WiFi.SSID().c_str(), size);
+		return true;
+	}
+
+	virtual bool bssid(uint8_t *bssid) override
+	{
+		uint8_t *current = WiFi.BSSID();
+		if (!current) {
+			return false;
+		}
+		memcpy(bssid, current, 6);
+		return true;
+	}
+
+	virtual int32_t rssi() override
+	{
+		return WiFi.RSSI();
+	}
+
+	virtual int32_t channel() override
+	{
+		return WiFi.channel();
+	}
+
+	virtual uint32_t localIP() override
+	{
+		return WiFi.localIP();
+	}
+
+	virtual bool scanStart(const uint8_t &channel, const uint32_t &dwellMs) override
+	{
+		if (!channel) {
+			m_channelScan = false;
+			int16_t result = WiFi.scanNetworks(true, false, false);
+			LOG_DEBUG(WIFI, "[WIFI]: scanNetworks() returned %d\n", result);
+			return result == WIFI_SCAN_RUNNING;
+		}
+
+		// WiFi.scanNetworks() can't limit the channels, the scan is started
+		// directly; the results are still collected by the WiFi library on
+		// SYSTEM_EVENT_SCAN_DONE
+		WiFi.enableSTA(true);
+
+		wifi_scan_config_t config;
+		memset(&config, 0, sizeof(config));
+		config.channel = channel;
+		config.scan_type = WIFI_SCAN_TYPE_ACTIVE;
+		config.scan_time.active.min = dwellMs;
+		config.scan_time.active.max = dwellMs;
+
+		m_channelScanDone = m_scanDone;
+		esp_err_t err = esp_wifi_scan_start(&config, false);
+		if (err != ESP_OK) {
+			LOG_WARN(WIFI, "[WIFI]: scan of channel %u failed (%d)\n", channel, err);
+			return false;
+		}
+
+		m_channelScan = true;
+		return true;
+	}
+
+	virtual void scanStop() override
+	{
+		esp_wifi_scan_stop();
+		m_channelScan = false;
+	}
+
+	virtual int16_t scanComplete() override
+	{
+		// WiFi.scanComplete() can't tell the result of a directly started
+		// scan from an old one, the SYSTEM_EVENT_SCAN_DONE counter can
+		if (m_channelScan) {
+			if (m_scanDone == m_channelScanDone) {
+				return WIFI_SCAN_RUNNING;
+			}
+			m_channelScan = false;
+		}
+		return WiFi.scanComplete();
+	}
+
+	virtual bool scanResult(const int16_t &index, ScanResult &result) override
+	{
+		String ssid;
+		uint8_t encryption;
+		uint8_t *bssid;
+
+		if (!WiFi.getNetworkInfo(index, ssid, encryption, result.m_rssi, bssid, result.m_channel)) {
+			return false;
+		}
+
+		strlcpy(result.m_ssid, ssid.c_str(), sizeof(result.m_ssid));
+		memcpy(result.m_bssid, bssid, sizeof(result.m_bssid));
+		result.m_open = (encryption == WIFI_AUTH_OPEN);
+		return true;
+	}
+
+	virtual void scanDelete() override
+	{
+		WiFi.scanDelete();
+	}
+
+private:
+	// SYSTEM_EVENT_SCAN_DONE, SYSTEM_EVENT_STA_CONNECTED and
+	// SYSTEM_EVENT_STA_DISCONNECTED counters
+	volatile uint32_t m_scanDone = 0;
+	volatile uint32_t m_associated = 0;
+	volatile uint32_t m_disconnected = 0;
+	wifi_event_id_t m_scanEventId = 0;
+	wifi_event_id_t m_associatedEventId = 0;
+	wifi_event_id_t m_disconnectedEventId = 0;
+
+	bool m_channelScan = false;
+	uint32_t m_channelScanDone = 0;
+};
+
+WiFiDriver &wifiArduinoDriver()
+{
+	static ArduinoWiFiDriver *driver = nullptr;
+	if (!driver) {
+		driver = new ArduinoWiFiDriver();
+	}
+	return *driver;
+}
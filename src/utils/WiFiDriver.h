@@ -0,0 +1,99 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+//
+// The station side of the WiFi stack as WiFiMultiSSID uses it.
+//
+// The firmware uses wifiArduinoDriver() on top of the Arduino WiFi library
+// and the ESP-IDF; WiFiSimDriver.h replaces it by a simulated environment,
+// so the connect and roam policy can be run (and timed) on a host. The clock
+// is part of the driver for the same reason: a simulation advances it in
+// delay() instead of waiting.
+//
+// Status codes are the Arduino wl_status_t ones, scanComplete() returns the
+// number of results or WIFI_SCAN_RUNNING / WIFI_SCAN_FAILED like
+// WiFi.scanComplete().
+//
+
+#ifdef ARDUINO
+#include <WiFiType.h>
+#else
+typedef enum {
+	WL_NO_SHIELD = 255,
+	WL_IDLE_STATUS = 0,
+	WL_NO_SSID_AVAIL = 1,
+	WL_SCAN_COMPLETED = 2,
+	WL_CONNECTED = 3,
+	WL_CONNECT_FAILED = 4,
+	WL_CONNECTION_LOST = 5,
+	WL_DISCONNECTED = 6
+} wl_status_t;
+
+#define WIFI_SCAN_RUNNING (-1)
+#define WIFI_SCAN_FAILED (-2)
+#endif
+
+#define WIFI_DRIVER_SSID_LEN 33		// 32 characters and the terminator
+
+class WiFiDriver {
+public:
+	struct ScanResult {
+		char m_ssid[WIFI_DRIVER_SSID_LEN];
+		uint8_t m_bssid[6];
+		int32_t m_channel;
+		int32_t m_rssi;
+		bool m_open;
+	};
+
+	virtual ~WiFiDriver() {}
+
+	// clock
+	virtual uint32_t millis() = 0;
+	virtual void delay(const uint32_t &ms) = 0;
+
+	//
+	// station
+	//
+
+	virtual uint8_t status() = 0;
+
+	// start connecting to the BSSID on the channel; listenInterval in beacons
+	// for the sleeping modem, 0 for the default
+	virtual void begin(const char *ssid, const char *password, const int32_t &channel, const uint8_t *bssid, const uint16_t &listenInterval) = 0;
+	virtual void disconnect() = 0;
+
+	// radio off and on again, after a failed attempt
+	virtual void restart() = 0;
+
+	// associations so far (SYSTEM_EVENT_STA_CONNECTED), the status only
+	// changes once there is an address
+	virtual uint32_t associations() = 0;
+
+	// disconnects so far (SYSTEM_EVENT_STA_DISCONNECTED), including the ones
+	// we cause, e.g. by connecting elsewhere
+	virtual uint32_t disconnects() = 0;
+
+	// the current link, false/invalid when not connected
+	virtual bool ssid(char *ssid, const size_t &size) = 0;
+	virtual bool bssid(uint8_t *bssid) = 0;
+	virtual int32_t rssi() = 0;
+	virtual int32_t channel() = 0;
+	virtual uint32_t localIP() = 0;
+
+	//
+	// active scans, the results stay until scanDelete()
+	//
+
+	// a single channel with the given dwell time, or all channels with
+	// the default one for channel 0; false if it could not be started
+	virtual bool scanStart(const uint8_t &channel, const uint32_t &dwellMs) = 0;
+	virtual void scanStop() = 0;
+	virtual int16_t scanComplete() = 0;
+	virtual bool scanResult(const int16_t &index, ScanResult &result) = 0;
+	virtual void scanDelete() = 0;
+};
+
+// the firmware driver, created on first use
+WiFiDriver &wifiArduinoDriver();
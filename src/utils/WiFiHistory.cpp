@@ -0,0 +1,115 @@
+#include "WiFiHistory.h"
+#include <string.h>
+
+#define WIFI_HISTORY_SATURATE 0xffff
+
+// moving average, the first sample is taken as is
+static uint32_t ewma(const uint32_t &average, const uint32_t &sample, const bool &first)
+{
+	if (first) {
+		return sample;
+	}
+	return (int64_t)average + ((int64_t)sample - (int64_t)average) / WIFI_HISTORY_WEIGHT;
+}
+
+static uint16_t increment(const uint16_t &counter)
+{
+	return (counter < WIFI_HISTORY_SATURATE) ? counter + 1 : counter;
+}
+
+WiFiHistory::WiFiHistory()
+{
+	memset(&m_table, 0, sizeof(m_table));
+	m_dirty = false;
+}
+
+const WiFiHistory::Entry *WiFiHistory::find(const uint32_t &ssidHash, const uint8_t *bssid) const
+{
+	for (uint8_t i = 0; i < WIFI_HISTORY_SIZE; i++) {
+		const Entry &entry = m_table.m_entries[i];
+		if (entry.m_lastUsed && entry.m_ssidHash == ssidHash && !memcmp(entry.m_bssid, bssid, sizeof(entry.m_bssid))) {
+			return &entry;
+		}
+	}
+	return NULL;
+}
+
+WiFiHistory::Entry &WiFiHistory::update(const uint32_t &ssidHash, const uint8_t *bssid)
+{
+	Entry *entry = (Entry *)find(ssidHash, bssid);
+
+	// a free entry or the least recently used one
+	if (!entry) {
+		entry = &m_table.m_entries[0];
+		for (uint8_t i = 1; i < WIFI_HISTORY_SIZE && entry->m_lastUsed; i++) {
+			if (m_table.m_entries[i].m_lastUsed < entry->m_lastUsed) {
+				entry = &m_table.m_entries[i];
+			}
+		}
+
+		memset(entry, 0, sizeof(*entry));
+		entry->m_ssidHash = ssidHash;
+		memcpy(entry->m_bssid, bssid, sizeof(entry->m_bssid));
+	}
+
+	entry->m_lastUsed = ++m_table.m_clock;
+	m_dirty = true;
+	return *entry;
+}
+
+void WiFiHistory::reportConnect(const uint32_t &ssidHash, const uint8_t *bssid, const uint32_t &connectMs)
+{
+	Entry &entry = update(ssidHash, bssid);
+
+	// a connect time of 0 ms can't happen, it marks no successful attempt yet
+	entry.m_connectMs = ewma(entry.m_connectMs, connectMs ? connectMs : 1, !entry.m_connectMs);
+	entry.m_failPermille = ewma(entry.m_failPermille, 0, !entry.m_attempts);
+	entry.m_attempts = increment(entry.m_attempts);
+}
+
+void WiFiHistory::reportFailure(const uint32_t &ssidHash, const uint8_t *bssid)
+{
+	Entry &entry = update(ssidHash, bssid);
+
+	entry.m_failPermille = ewma(entry.m_failPermille, 1000, !entry.m_attempts);
+	entry.m_attempts = increment(entry.m_attempts);
+}
+
+void WiFiHistory::reportSession(const uint32_t &ssidHash, const uint8_t *bssid, const uint32_t &sessionS)
+{
+	Entry &entry = update(ssidHash, bssid);
+
+	entry.m_sessionS = ewma(entry.m_sessionS, sessionS, !entry.m_sessions);
+	entry.m_sessions = increment(entry.m_sessions);
+}
+
+int32_t WiFiHistory::score(const uint32_t &ssidHash, const uint8_t *bssid, const int32_t &rssi) const
+{
+	const Entry *entry = find(ssidHash, bssid);
+	if (!entry) {
+		return rssi;
+	}
+
+	int32_t penalty = (int32_t)entry->m_failPermille * WIFI_HISTORY_FAIL_PENALTY_DB / 1000;
+
+	uint32_t connectPenalty = entry->m_connectMs / WIFI_HISTORY_CONNECT_MS_PER_DB;
+	penalty += (connectPenalty < WIFI_HISTORY_CONNECT_PENALTY_DB) ? connectPenalty : WIFI_HISTORY_CONNECT_PENALTY_DB;
+
+	if (entry->m_sessions && entry->m_sessionS < WIFI_HISTORY_SHORT_SESSION_S) {
+		penalty += (WIFI_HISTORY_SHORT_SESSION_S - entry->m_sessionS) * WIFI_HISTORY_SESSION_PENALTY_DB / WIFI_HISTORY_SHORT_SESSION_S;
+	}
+
+	return rssi - penalty;
+}
+
+bool WiFiHistory::fastReconnectAllowed(const uint32_t &ssidHash, const uint8_t *bssid) const
+{
+	const Entry *entry = find(ssidHash, bssid);
+
+	// too few attempts to judge
+	if (!entry || entry->m_attempts < WIFI_HISTORY_MIN_ATTEMPTS) {
+		return true;
+	}
+
+	return entry->m_failPermille <= WIFI_HISTORY_FAST_MAX_FAIL_PERMILLE;
+}
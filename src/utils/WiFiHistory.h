@@ -0,0 +1,77 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+//
+// Connection history of the access points, used to rank them beyond the
+// RSSI of the moment.
+//
+// Per SSID (by hash) and BSSID the time to connect, the failure rate and the
+// session length are kept as exponentially weighted moving averages; a new
+// sample counts 1/WIFI_HISTORY_WEIGHT. The penalties they add up to are in
+// dB, so score() can be compared like an RSSI: an access point that connects
+// slowly, fails often or drops the link after a short while loses against a
+// slightly weaker one that behaves. Access points without history get no
+// penalty.
+//
+// The table is a plain struct so it can be persisted as is. It holds
+// WIFI_HISTORY_SIZE entries, the least recently used one is replaced.
+//
+
+class WiFiHistory {
+public:
+	struct Entry {
+		uint32_t m_ssidHash;
+		uint8_t m_bssid[6];
+		uint16_t m_attempts;		// connection attempts, saturating
+		uint16_t m_sessions;		// finished sessions, saturating
+		uint16_t m_failPermille;	// EWMA of failed attempts
+		uint32_t m_connectMs;		// EWMA of the successful attempts
+		uint32_t m_sessionS;		// EWMA of the session length
+		uint32_t m_lastUsed;		// m_clock of the last update, 0 for a free entry
+	};
+
+	struct Table {
+		Entry m_entries[WIFI_HISTORY_SIZE];
+		uint32_t m_clock;			// counts the updates, orders the entries by use
+	};
+
+	WiFiHistory();
+
+	void reportConnect(const uint32_t &ssidHash, const uint8_t *bssid, const uint32_t &connectMs);
+	void reportFailure(const uint32_t &ssidHash, const uint8_t *bssid);
+	void reportSession(const uint32_t &ssidHash, const uint8_t *bssid, const uint32_t &sessionS);
+
+	// RSSI less the penalties of the history
+	int32_t score(const uint32_t &ssidHash, const uint8_t *bssid, const int32_t &rssi) const;
+
+	// false once the access point failed too often to be tried blindly
+	bool fastReconnectAllowed(const uint32_t &ssidHash, const uint8_t *bssid) const;
+
+	const Entry *find(const uint32_t &ssidHash, const uint8_t *bssid) const;
+
+	Table &table()
+	{
+		return m_table;
+	}
+
+	const Table &table() const
+	{
+		return m_table;
+	}
+
+	// changed since the last call
+	bool takeDirty()
+	{
+		bool dirty = m_dirty;
+		m_dirty = false;
+		return dirty;
+	}
+
+private:
+	Entry &update(const uint32_t &ssidHash, const uint8_t *bssid);
+
+	Table m_table;
+	bool m_dirty;
+};
@@ -1,15 +1,40 @@
 #include "WiFiMultiSSID.h"
 #include <limits.h>
 #include <string.h>
-#include "utils.h"
+#include "log.h"
 
-WiFiMultiSSID::WiFiMultiSSID()
+#define WIFI_MAX_CHANNEL 14
+
+WiFiMultiSSID::WiFiMultiSSID(WiFiDriver &driver)
+	: m_driver(driver)
 {
 }
 
 WiFiMultiSSID::~WiFiMultiSSID()
 {
 	m_apList.clear();
+	m_apHashes.clear();
+}
+
+// FNV-1a
+uint32_t WiFiMultiSSID::ssidHash(const char *ssid)
+{
+	uint32_t hash = 2166136261UL;
+	while (*ssid) {
+		hash = (hash ^ (uint8_t)*ssid++) * 16777619UL;
+	}
+	return hash;
+}
+
+int WiFiMultiSSID::findAP(const char *ssid) const
+{
+	uint32_t hash = ssidHash(ssid);
+	for (uint32_t x = 0; x < m_apHashes.size(); x++) {
+		if (m_apHashes[x] == hash && !strcmp(m_apList[x].m_ssid, ssid)) {
+			return x;
+		}
+	}
+	return -1;
 }
 
 bool WiFiMultiSSID::addAP(const char *ssid, const char *passphrase)
@@ -18,13 +43,13 @@ bool WiFiMultiSSID::addAP(const char *ssid, const char *passphrase)
 
 	if (!ssid || *ssid == 0x00 || strlen(ssid) > 31) {
 		// fail SSID too long or missing!
-		LOG_PRINTF("[WIFI][m_apListAdd] no ssid or ssid too long\n");
+		LOG_ERROR(WIFI, "[WIFI][m_apListAdd] no ssid or ssid too long\n");
 		return false;
 	}
 
 	if (passphrase && strlen(passphrase) > 63) {
 		// fail passphrase too long!
-		LOG_PRINTF("[WIFI][m_apListAdd] passphrase too long\n");
+		LOG_ERROR(WIFI, "[WIFI][m_apListAdd] passphrase too long\n");
 		return false;
 	}
 
@@ -37,81 +62,137 @@ bool WiFiMultiSSID::addAP(const char *ssid, const char *passphrase)
 	}
 
 	m_apList.push_back(newAP);
-	LOG_PRINTF("[WIFI][m_apListAdd] add SSID: %s\n", newAP.m_ssid);
+	m_apHashes.push_back(ssidHash(newAP.m_ssid));
+	LOG_DEBUG(WIFI, "[WIFI][m_apListAdd] add SSID: %s\n", newAP.m_ssid);
 	return true;
 }
 
-uint8_t WiFiMultiSSID::fastReconnect(const WiFiMultiSSID::LastParams &params, std::function<void(void)> periodicCb, uint32_t retries, uint32_t timeout)
+void WiFiMultiSSID::clearAPs()
+{
+	m_apList.clear();
+	m_apHashes.clear();
+
+	// the cache entries index m_apList
+	m_cacheSize = 0;
+}
+
+void WiFiMultiSSID::begin(const WiFiMultiSSID::LastParams &params)
+{
+	m_driver.begin(params.m_credentials.m_ssid, params.m_credentials.m_password, params.m_channel, params.m_bssid, m_listenInterval);
+}
+
+// the configured network we are connected to, -1 if none
+int WiFiMultiSSID::connectedAP()
+{
+	char ssid[WIFI_DRIVER_SSID_LEN];
+	if (!m_driver.ssid(ssid, sizeof(ssid))) {
+		return -1;
+	}
+	return findAP(ssid);
+}
+
+uint8_t WiFiMultiSSID::fastReconnect(const WiFiMultiSSID::LastParams &params, std::function<void(void)> periodicCb, uint32_t retries, uint32_t timeout, uint32_t authDeadline)
 {
 	if (!params.m_credentials.m_ssid[0] || !params.m_credentials.m_password[0] || !params.m_bssid[0]) {
-		LOG_PRINTF("[WIFI] fast reconnect not possible, parameters are invalid\n");
+		LOG_WARN(WIFI, "[WIFI] fast reconnect not possible, parameters are invalid\n");
 		return WL_CONNECT_FAILED;
 	}
 
 	// are we already connected?
-	uint8_t status = WiFi.status();
+	uint8_t status = m_driver.status();
 	if (status == WL_CONNECTED) {
 		// does the SSID we are currently connected to match one our requested
 		// SSIDs?
-		for (uint32_t x = 0; x < m_apList.size(); x++) {
-			if (WiFi.SSID() == m_apList[x].m_ssid) {
-				// it does, so we are connected
-				return status;
-			}
+		if (connectedAP() >= 0) {
+			// it does, so we are connected
+			return status;
 		}
 
 		// no match found, disconnect
-		WiFi.disconnect(false, false);
+		m_driver.disconnect();
 
 		// give it a bit of time and retrieve the Wifi status again
-		delay(10);
-		status = WiFi.status();
+		m_driver.delay(10);
+		status = m_driver.status();
 	}
 
 	// try to connect as many times are specified
 	while (retries--) {
-		LOG_PRINTF("[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X, SSID: %s, channel: %d\n", params.m_bssid[0], params.m_bssid[1], params.m_bssid[2], params.m_bssid[3], params.m_bssid[4], params.m_bssid[5], params.m_credentials.m_ssid, params.m_channel);
+		LOG_INFO(WIFI, "[WIFI] Connecting BSSID: %02X:%02X:%02X:%02X:%02X:%02X, SSID: %s, channel: %d\n", params.m_bssid[0], params.m_bssid[1], params.m_bssid[2], params.m_bssid[3], params.m_bssid[4], params.m_bssid[5], params.m_credentials.m_ssid, params.m_channel);
 
-		WiFi.begin(params.m_credentials.m_ssid, params.m_credentials.m_password, params.m_channel, params.m_bssid);
-		status = WiFi.status();
+		uint32_t associated = m_driver.associations();
+		begin(params);
+		status = m_driver.status();
 
-		auto startTime = millis();
+		auto startTime = m_driver.millis();
+		bool abandoned = false;
 
 		// wait for connection, fail, or timeout
-		while (status != WL_CONNECTED && status != WL_NO_SSID_AVAIL && status != WL_CONNECT_FAILED && (millis() - startTime) <= timeout) {
+		while (status != WL_CONNECTED && status != WL_NO_SSID_AVAIL && status != WL_CONNECT_FAILED && (m_driver.millis() - startTime) <= timeout) {
+
+			// an access point that is still there associates within a second or
+			// two, the rest of the timeout is for DHCP; don't wait for one that
+			// is gone, the scan finds a replacement sooner
+			if (authDeadline && m_driver.associations() == associated && (m_driver.millis() - startTime) > authDeadline) {
+				abandoned = true;
+				break;
+			}
 
 			// call periodic callback
 			if (periodicCb) {
 				periodicCb();
 			}
 
-			delay(10);
-			status = WiFi.status();
+			m_driver.delay(10);
+			status = m_driver.status();
+		}
+
+		uint32_t hash = ssidHash(params.m_credentials.m_ssid);
+		if (abandoned) {
+			LOG_WARN(WIFI, "[WIFI] Not associated within %u ms, giving up on this BSSID\n", authDeadline);
+			m_scanStats.m_authTimeouts++;
+			m_history.reportFailure(hash, params.m_bssid);
+
+			// stop connecting, the radio can't scan meanwhile
+			m_driver.disconnect();
+			return WL_NO_SSID_AVAIL;
+		}
+
+		if (status == WL_CONNECTED) {
+			m_history.reportConnect(hash, params.m_bssid, m_driver.millis() - startTime);
+		} else {
+			m_history.reportFailure(hash, params.m_bssid);
 		}
 
 		switch (status) {
 		case WL_CONNECTED:
-			LOG_PRINTF("[WIFI] Connecting done.\n");
-			LOG_PRINTF("[WIFI] SSID: %s\n", WiFi.SSID().c_str());
-			LOG_PRINTF("[WIFI] IP: %s\n", WiFi.localIP().toString().c_str());
-			LOG_PRINTF("[WIFI] MAC: %s\n", WiFi.BSSIDstr().c_str());
-			LOG_PRINTF("[WIFI] Channel: %d\n", WiFi.channel());
+			{
+				uint32_t ip = m_driver.localIP();
+				LOG_INFO(WIFI, "[WIFI] Connecting done.\n");
+				LOG_DEBUG(WIFI, "[WIFI] SSID: %s\n", params.m_credentials.m_ssid);
+				LOG_DEBUG(WIFI, "[WIFI] IP: %u.%u.%u.%u\n", ip & 0xff, (ip >> 8) & 0xff, (ip >> 16) & 0xff, ip >> 24);
+				LOG_DEBUG(WIFI, "[WIFI] MAC: %02X:%02X:%02X:%02X:%02X:%02X\n", params.m_bssid[0], params.m_bssid[1], params.m_bssid[2], params.m_bssid[3], params.m_bssid[4], params.m_bssid[5]);
+				LOG_DEBUG(WIFI, "[WIFI] Channel: %d\n", m_driver.channel());
+
+				// remember the channel for the next targeted scan
+				int ap = findAP(params.m_credentials.m_ssid);
+				if (ap >= 0) {
+					updateCache(ap, params.m_bssid, m_driver.channel(), m_driver.rssi(), false, m_driver.millis());
+				}
+			}
 			// we have been connected, we may leave
 			return status;
 		case WL_NO_SSID_AVAIL:
-			LOG_PRINTF("[WIFI] Connection Failed, AP not found.\n");
+			LOG_WARN(WIFI, "[WIFI] Connection Failed, AP not found.\n");
 			// hard error, SSID is not available, leave
 			return status;
 		case WL_CONNECT_FAILED:
-			LOG_PRINTF("[WIFI] Connection Failed.\n");
+			LOG_WARN(WIFI, "[WIFI] Connection Failed.\n");
 			// failure, let's repeat the reconnection
-			WiFi.disconnect(true);	// Disconnect from the network
-			WiFi.mode(WIFI_OFF);	// Switch WiFi off
-			WiFi.disconnect(false);	// Reconnect the network
-			WiFi.mode(WIFI_STA);	// Switch WiFi off
+			m_driver.restart();
 			break;
 		default:
-			LOG_PRINTF("[WIFI] Connection Failed (%d).\n", status);
+			LOG_WARN(WIFI, "[WIFI] Connection Failed (%d).\n", status);
 			// other error type, try reconnection
 			break;
 		}
@@ -123,145 +204,434 @@ uint8_t WiFiMultiSSID::fastReconnect(const WiFiMultiSSID::LastParams &params, st
 uint8_t WiFiMultiSSID::connect(std::function<void(void)> periodicCb, uint32_t retries, uint32_t timeout)
 {
 	// are we already connected?
-	uint8_t status = WiFi.status();
+	uint8_t status = m_driver.status();
 	if (status == WL_CONNECTED) {
 		// does the SSID we are currently connected to match one our requested
 		// SSIDs?
-		for (uint32_t x = 0; x < m_apList.size(); x++) {
-			if (WiFi.SSID() == m_apList[x].m_ssid) {
-				// it does, so we are connected
-				LOG_PRINTF("[WIFI]: currently connected SSID matches our requested SSID (%s)\n", m_apList[x].m_ssid);
-				return status;
-			}
+		int ap = connectedAP();
+		if (ap >= 0) {
+			// it does, so we are connected
+			LOG_DEBUG(WIFI, "[WIFI]: currently connected SSID matches our requested SSID (%s)\n", m_apList[ap].m_ssid);
+			return status;
 		}
 
 		// no match found, disconnect
-		LOG_PRINTF("[WIFI]: no match for selected SSID found, disconnecting\n");
-		WiFi.disconnect(false, false);
+		LOG_INFO(WIFI, "[WIFI]: no match for selected SSID found, disconnecting\n");
+		m_driver.disconnect();
 
 		// give it a bit of time and retrieve the Wifi status again
-		delay(10);
-		status = WiFi.status();
+		m_driver.delay(10);
+		status = m_driver.status();
+	}
+
+	uint32_t startMillis = m_driver.millis();
+	WiFiMultiSSID::LastParams params;
+	bool found = false;
+
+	expireCache(startMillis);
+
+	// scan only the channels known networks were seen on before, it takes
+	// a fraction of the full scan over all channels
+	uint16_t channels = cachedChannels();
+	if (channels) {
+		LOG_DEBUG(WIFI, "[WIFI]: Scanning channels 0x%04x (timeout = %d ms)\n", channels, timeout);
+		m_scanStats.m_targetedScans++;
+		m_scanStats.m_lastChannels = channels;
+
+		bool scanned = scanChannels(channels, periodicCb, startMillis, timeout);
+		if (m_driver.status() == WL_CONNECTED) {
+			LOG_DEBUG(WIFI, "[WIFI] connected in the meantime!\n");
+			return WL_CONNECTED;
+		}
+
+		found = scanned && bestCandidate(startMillis, params);
+		if (found) {
+			m_scanStats.m_targetedHits++;
+		} else {
+			LOG_INFO(WIFI, "[WIFI]: no known network on the cached channels\n");
+		}
+	}
+
+	// the access points may have moved, fall back to scanning everything
+	if (!found) {
+		uint32_t scanStartMillis = m_driver.millis();
+		LOG_DEBUG(WIFI, "[WIFI]: Initiating scan (timeout = %d ms)\n", timeout);
+		m_scanStats.m_fullScans++;
+		m_scanStats.m_lastChannels = 0;
+
+		int16_t scanResult = scanAll(periodicCb, scanStartMillis, timeout);
+
+		// if we are still scanning, leave with error (it means that timeout has expired)
+		if (scanResult == WIFI_SCAN_RUNNING) {
+			// scan is running
+			LOG_WARN(WIFI, "[WIFI]: scan is still running, timeout expired!\n");
+			return WL_NO_SSID_AVAIL;
+		} else if (scanResult < 0) {
+			// we had some other error...
+			if (m_driver.status() == WL_CONNECTED) {
+				LOG_DEBUG(WIFI, "[WIFI] connected in the meantime!\n");
+				return WL_CONNECTED;
+			}
+
+			LOG_WARN(WIFI, "[WIFI] scan failed\n");
+			return scanResult;
+		}
+
+		found = bestCandidate(scanStartMillis, params);
+	}
+
+	m_scanStats.m_lastScanMs = m_driver.millis() - startMillis;
+	m_scanStats.m_cacheEntries = m_cacheSize;
+
+	// did we find a ssid we have been looking for?
+	if (found) {
+		status = fastReconnect(params, periodicCb, retries, timeout);
+		if (status == WL_CONNECTED) {
+			m_scanStats.m_lastScanToConnectMs = m_driver.millis() - startMillis;
+			LOG_INFO(WIFI, "[WIFI] scan %u ms, scan to connect %u ms\n", m_scanStats.m_lastScanMs, m_scanStats.m_lastScanToConnectMs);
+		}
+	} else {
+		LOG_WARN(WIFI, "[WIFI] no matching wifi found!\n");
+	}
+
+	return status;
+}
+
+bool WiFiMultiSSID::scanChannels(const uint16_t &channels, std::function<void(void)> periodicCb, const uint32_t &startMillis, const uint32_t &timeout)
+{
+	m_driver.scanDelete();
+
+	for (uint8_t channel = 1; channel <= WIFI_MAX_CHANNEL; channel++) {
+		if (!(channels & (1 << channel))) {
+			continue;
+		}
+
+		if (!m_driver.scanStart(channel, WIFI_SCAN_MS_PER_CHAN)) {
+			return false;
+		}
+
+		// polling wait until it finishes
+		while (m_driver.scanComplete() == WIFI_SCAN_RUNNING) {
+			if ((m_driver.millis() - startMillis) >= timeout) {
+				LOG_WARN(WIFI, "[WIFI]: scan of channel %u timed out\n", channel);
+				m_driver.scanStop();
+				return false;
+			}
+
+			// see connect()
+			if (m_driver.status() == WL_CONNECTED) {
+				return false;
+			}
+
+			// call periodic callback
+			if (periodicCb) {
+				periodicCb();
+			}
+			m_driver.delay(10);
+		}
+
+		cacheScanResults(m_driver.millis());
+
+		// clean up ram
+		m_driver.scanDelete();
+
+		// connecting now beats finding a slightly better one on the next channel
+		WiFiMultiSSID::LastParams params;
+		int32_t score;
+		if (bestCandidate(startMillis, params, &score) && score >= WIFI_SCAN_GOOD_SCORE) {
+			if (channels >> (channel + 1)) {
+				m_scanStats.m_earlyStops++;
+				LOG_DEBUG(WIFI, "[WIFI]: good candidate on channel %u (score %d), scan stopped\n", channel, score);
+			}
+			break;
+		}
 	}
 
+	return true;
+}
+
+int16_t WiFiMultiSSID::scanAll(std::function<void(void)> periodicCb, const uint32_t &startMillis, const uint32_t &timeout)
+{
 	//
 	// asynchronous scan for wifi networks
 	//
 
-	uint32_t startMillis = millis();
-	LOG_PRINTF("[WIFI]: Initiating scan (timeout = %d ms)\n", timeout);
-	int16_t scanResult = WiFi.scanNetworks(true, false, false);
-	LOG_PRINTF("[WIFI]: scanNetworks() returned %d\n", scanResult);
+	int16_t scanResult = m_driver.scanStart(0, 0) ? WIFI_SCAN_RUNNING : WIFI_SCAN_FAILED;
 
 	// polling wait until it finishes.
 	// we will ignore WIFI_SCAN_FAILED erros as it may be incorrectly
 	// triggered even when the scan is about to finish fine 
-	while ((millis() - startMillis) < timeout) {
-		scanResult = WiFi.scanComplete();
+	while ((m_driver.millis() - startMillis) < timeout) {
+		scanResult = m_driver.scanComplete();
 		if (scanResult >= 0) {
 			// we got some results
-			LOG_PRINTF("[WIFI]: scan finished, num results = %d\n", scanResult);
+			LOG_DEBUG(WIFI, "[WIFI]: scan finished, num results = %d\n", scanResult);
 			break;
 		}
 
 		// let's check first if we have been connected in the meantime
 		// (this can happen, there is a race condition between scan and connect)
-		if (WiFi.status() == WL_CONNECTED) {
-			LOG_PRINTF("[WIFI] connected in the meantime!\n");
-			return WL_CONNECTED;
+		if (m_driver.status() == WL_CONNECTED) {
+			return WIFI_SCAN_FAILED;
 		}
 
 		// call periodic callback
 		if (periodicCb) {
 			periodicCb();
 		}
-		delay(100);
+		m_driver.delay(100);
 	};
 
-	// if we are still scanning, leave with error (it means that timeout has expired)
-	if (scanResult == WIFI_SCAN_RUNNING) {
-		// scan is running
-		LOG_PRINTF("[WIFI]: scan is still running, timeout expired!\n");
-		return WL_NO_SSID_AVAIL;
-	} else if (scanResult < 0) {
-		// we had some other error...
-		if (WiFi.status() == WL_CONNECTED) {
-			LOG_PRINTF("[WIFI] connected in the meantime!\n");
-			return WL_CONNECTED;
+	if (scanResult >= 0) {
+		if (scanResult == 0) {
+			LOG_INFO(WIFI, "[WIFI] no networks found\n");
+		} else {
+			LOG_DEBUG(WIFI, "[WIFI] %d networks found\n", scanResult);
 		}
+		cacheScanResults(m_driver.millis());
 
-		LOG_PRINTF("[WIFI] scan failed\n");
-		return scanResult;
-	} else if (scanResult >= 0) {
-		// scan done analyze
-		Credentials bestNetwork;
-		int bestNetworkDb = INT_MIN;
-		uint8_t bestBSSID[6];
-		int32_t bestChannel = 0;
+		// clean up ram
+		m_driver.scanDelete();
+	}
 
-		LOG_PRINTF("[WIFI] scan done\n");
+	return scanResult;
+}
 
-		if (scanResult == 0) {
-			LOG_PRINTF("[WIFI] no networks found\n");
-		} else {
-			LOG_PRINTF("[WIFI] %d networks found\n", scanResult);
-
-			for (int8_t i = 0; i < scanResult; ++i) {
-				String ssid_scan;
-				int32_t rssi_scan;
-				uint8_t sec_scan;
-				uint8_t *BSSID_scan;
-				int32_t chan_scan;
-
-				WiFi.getNetworkInfo(i, ssid_scan, sec_scan, rssi_scan, BSSID_scan, chan_scan);
-
-				bool known = false;
-				for (uint32_t x = 0; x < m_apList.size(); x++) {
-					Credentials entry = m_apList[x];
-
-					if (ssid_scan == entry.m_ssid) {
-						// SSID match
-						known = true;
-
-						if (rssi_scan > bestNetworkDb) {
-							// best network
-							if (sec_scan == WIFI_AUTH_OPEN || entry.m_password) {
-								// check for passphrase if not open wlan
-								bestNetworkDb = rssi_scan;
-								bestChannel = chan_scan;
-								memcpy((void *)&bestNetwork, (void *)&entry, sizeof(bestNetwork));
-								memcpy((void *)&bestBSSID, (void *)BSSID_scan, sizeof(bestBSSID));
-							}
-						}
-						break;
-					}
-				}
+//
+// scan cache
+//
 
-				if (known) {
-					LOG_PRINTF("[WIFI]  --->   %02d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c\n", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
-				} else {
-					LOG_PRINTF("[WIFI] 	   %02d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c\n", i, chan_scan, BSSID_scan[0], BSSID_scan[1], BSSID_scan[2], BSSID_scan[3], BSSID_scan[4], BSSID_scan[5], ssid_scan.c_str(), rssi_scan, (sec_scan == WIFI_AUTH_OPEN) ? ' ' : '*');
-				}
+void WiFiMultiSSID::expireCache(const uint32_t &nowMs)
+{
+	uint8_t kept = 0;
+	for (uint8_t i = 0; i < m_cacheSize; i++) {
+		if (nowMs - m_cache[i].m_seenMs <= WIFI_SCAN_CACHE_MAX_AGE_MS) {
+			m_cache[kept++] = m_cache[i];
+		}
+	}
+	m_cacheSize = kept;
+}
+
+void WiFiMultiSSID::updateCache(const uint8_t &ap, const uint8_t *bssid, const int32_t &channel, const int32_t &rssi, const bool &open, const uint32_t &nowMs)
+{
+	if (channel < 1 || channel > WIFI_MAX_CHANNEL) {
+		return;
+	}
+
+	// the access point itself, or the free slot, or the oldest one
+	uint8_t slot = m_cacheSize;
+	for (uint8_t i = 0; i < m_cacheSize; i++) {
+		if (!memcmp(m_cache[i].m_bssid, bssid, sizeof(m_cache[i].m_bssid))) {
+			slot = i;
+			break;
+		}
+	}
+
+	if (slot == WIFI_SCAN_CACHE_SIZE) {
+		slot = 0;
+		for (uint8_t i = 1; i < m_cacheSize; i++) {
+			if (nowMs - m_cache[i].m_seenMs > nowMs - m_cache[slot].m_seenMs) {
+				slot = i;
 			}
 		}
+	} else if (slot == m_cacheSize) {
+		m_cacheSize++;
+	}
 
-		// clean up ram
-		WiFi.scanDelete();
+	ScanCacheEntry &entry = m_cache[slot];
+	entry.m_seenMs = nowMs;
+	memcpy(entry.m_bssid, bssid, sizeof(entry.m_bssid));
+	entry.m_ap = ap;
+	entry.m_channel = channel;
+	entry.m_rssi = (rssi < -128) ? -128 : (rssi > 127) ? 127 : rssi;
+	entry.m_open = open;
+}
 
-		// did we find a ssid we have been looking for?
-		if (bestNetwork.m_ssid[0]) {
+void WiFiMultiSSID::cacheScanResults(const uint32_t &nowMs)
+{
+	int16_t scanResult = m_driver.scanComplete();
 
-			WiFiMultiSSID::LastParams params;
-			strcpy(params.m_credentials.m_ssid, bestNetwork.m_ssid);
-			strcpy(params.m_credentials.m_password, bestNetwork.m_password);
-			memcpy(params.m_bssid, bestBSSID, sizeof(bestBSSID));
-			params.m_channel = bestChannel;
+	for (int16_t i = 0; i < scanResult; i++) {
+		WiFiDriver::ScanResult result;
+		if (!m_driver.scanResult(i, result)) {
+			continue;
+		}
 
-			status = fastReconnect(params, periodicCb, retries, timeout);
+		const uint8_t *bssid = result.m_bssid;
+		int ap = findAP(result.m_ssid);
+		if (ap >= 0) {
+			updateCache(ap, bssid, result.m_channel, result.m_rssi, result.m_open, nowMs);
+			LOG_VERBOSE(WIFI, "[WIFI]  --->   %02d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c\n", i, result.m_channel, bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5], result.m_ssid, result.m_rssi, result.m_open ? ' ' : '*');
 		} else {
-			LOG_PRINTF("[WIFI] no matching wifi found!\n");
+			LOG_VERBOSE(WIFI, "[WIFI] 	   %02d: [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s (%d) %c\n", i, result.m_channel, bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5], result.m_ssid, result.m_rssi, result.m_open ? ' ' : '*');
+		}
+	}
+}
+
+uint16_t WiFiMultiSSID::cachedChannels() const
+{
+	uint16_t channels = 0;
+	for (uint8_t i = 0; i < m_cacheSize; i++) {
+		channels |= 1 << m_cache[i].m_channel;
+	}
+	return channels;
+}
+
+bool WiFiMultiSSID::bestCandidate(const uint32_t &sinceMs, WiFiMultiSSID::LastParams &params, int32_t *score) const
+{
+	const ScanCacheEntry *best = NULL;
+	int32_t bestScore = 0;
+
+	// only access points seen by the scan started at sinceMs
+	for (uint8_t i = 0; i < m_cacheSize; i++) {
+		const ScanCacheEntry &entry = m_cache[i];
+		if ((int32_t)(entry.m_seenMs - sinceMs) < 0) {
+			continue;
+		}
+
+		// check for passphrase if not open wlan
+		if (!entry.m_open && !m_apList[entry.m_ap].m_password[0]) {
+			continue;
+		}
+
+		// signal strength less the penalties of the connection history
+		int32_t score = m_history.score(m_apHashes[entry.m_ap], entry.m_bssid, entry.m_rssi);
+		LOG_VERBOSE(WIFI, "[WIFI] candidate [%d][%02X:%02X:%02X:%02X:%02X:%02X] %s, %d dBm, score %d\n", entry.m_channel, entry.m_bssid[0], entry.m_bssid[1], entry.m_bssid[2], entry.m_bssid[3], entry.m_bssid[4], entry.m_bssid[5], m_apList[entry.m_ap].m_ssid, entry.m_rssi, score);
+
+		if (!best || score > bestScore) {
+			best = &entry;
+			bestScore = score;
 		}
 	}
 
-	return status;
+	if (!best) {
+		return false;
+	}
+
+	if (score) {
+		*score = bestScore;
+	}
+
+	const Credentials &credentials = m_apList[best->m_ap];
+	strcpy(params.m_credentials.m_ssid, credentials.m_ssid);
+	strcpy(params.m_credentials.m_password, credentials.m_password);
+	memcpy(params.m_bssid, best->m_bssid, sizeof(params.m_bssid));
+	params.m_channel = best->m_channel;
+	return true;
+}
+
+bool WiFiMultiSSID::findRoamCandidate(int32_t hysteresis, WiFiMultiSSID::LastParams &candidate)
+{
+	int16_t scanResult = m_driver.scanComplete();
+	if (scanResult <= 0) {
+		return false;
+	}
+
+	// the background scan is as good as any other
+	cacheScanResults(m_driver.millis());
+
+	// we need the credentials of the current network
+	int ap = connectedAP();
+	if (ap < 0) {
+		return false;
+	}
+	const Credentials &credentials = m_apList[ap];
+
+	uint8_t currentBSSID[6];
+	if (!m_driver.bssid(currentBSSID)) {
+		return false;
+	}
+	int32_t currentRssi = m_driver.rssi();
+	int32_t bestRssi = currentRssi + hysteresis - 1;
+	bool found = false;
+
+	for (int16_t i = 0; i < scanResult; i++) {
+		WiFiDriver::ScanResult result;
+		if (!m_driver.scanResult(i, result)) {
+			continue;
+		}
+
+		const uint8_t *bssid = result.m_bssid;
+		if (strcmp(result.m_ssid, credentials.m_ssid) || !memcmp(bssid, currentBSSID, sizeof(currentBSSID))) {
+			continue;
+		}
+
+		LOG_VERBOSE(WIFI, "[WIFI] roam candidate [%d][%02X:%02X:%02X:%02X:%02X:%02X] %d dBm (current %d dBm)\n", result.m_channel, bssid[0], bssid[1], bssid[2], bssid[3], bssid[4], bssid[5], result.m_rssi, currentRssi);
+
+		if (result.m_rssi > bestRssi) {
+			bestRssi = result.m_rssi;
+			strcpy(candidate.m_credentials.m_ssid, credentials.m_ssid);
+			strcpy(candidate.m_credentials.m_password, credentials.m_password);
+			memcpy(candidate.m_bssid, bssid, sizeof(candidate.m_bssid));
+			candidate.m_channel = result.m_channel;
+			found = true;
+		}
+	}
+
+	return found;
+}
+
+//
+// connection history
+//
+
+bool WiFiMultiSSID::fastReconnectAllowed(const WiFiMultiSSID::LastParams &params) const
+{
+	return m_history.fastReconnectAllowed(ssidHash(params.m_credentials.m_ssid), params.m_bssid);
+}
+
+void WiFiMultiSSID::sessionStart()
+{
+	m_sessionDisconnects = m_driver.disconnects();
+
+	char ssid[WIFI_DRIVER_SSID_LEN];
+	uint8_t bssid[6];
+	if (!m_driver.ssid(ssid, sizeof(ssid)) || !m_driver.bssid(bssid)) {
+		return;
+	}
+	uint32_t hash = ssidHash(ssid);
+
+	// a roam ends the previous session
+	if (m_sessionActive) {
+		if (m_sessionHash == hash && !memcmp(m_sessionBSSID, bssid, sizeof(m_sessionBSSID))) {
+			return;
+		}
+		sessionEnd();
+	}
+
+	m_sessionActive = true;
+	m_sessionStartMs = m_driver.millis();
+	m_sessionHash = hash;
+	memcpy(m_sessionBSSID, bssid, sizeof(m_sessionBSSID));
+}
+
+void WiFiMultiSSID::sessionEnd(const bool &record)
+{
+	if (!m_sessionActive) {
+		return;
+	}
+
+	m_sessionActive = false;
+	if (!record) {
+		return;
+	}
+
+	uint32_t sessionS = (m_driver.millis() - m_sessionStartMs) / 1000;
+	m_history.reportSession(m_sessionHash, m_sessionBSSID, sessionS);
+	LOG_INFO(WIFI, "[WIFI] Session to %02X:%02X:%02X:%02X:%02X:%02X ended after %u s\n", m_sessionBSSID[0], m_sessionBSSID[1], m_sessionBSSID[2], m_sessionBSSID[3], m_sessionBSSID[4], m_sessionBSSID[5], sessionS);
+}
+
+bool WiFiMultiSSID::linkLost()
+{
+	return m_driver.disconnects() != m_sessionDisconnects;
+}
+
+const char *WiFiMultiSSID::historySSID(const WiFiHistory::Entry &entry) const
+{
+	for (uint32_t x = 0; x < m_apHashes.size(); x++) {
+		if (m_apHashes[x] == entry.m_ssidHash) {
+			return m_apList[x].m_ssid;
+		}
+	}
+	return NULL;
 }
@@ -1,13 +1,17 @@
 #pragma once
 
-#include "WiFi.h"
 #include <vector>
 #include <functional>
 #include "config.h"
+#include "WiFiDriver.h"
+#include "WiFiHistory.h"
 
 //
 // WiFiMulti alternative with many improvements
 //
+// All radio access goes through a WiFiDriver, the firmware one by default;
+// with the driver of WiFiSimDriver.h the policy runs on a host.
+//
 
 class WiFiMultiSSID {
 public:
@@ -23,14 +27,116 @@ public:
 		int m_channel = -1;
 	} WiFiLastParams;
 
-	WiFiMultiSSID();
+	struct ScanStats {
+		uint32_t m_targetedScans = 0;		// scans of the cached channels only
+		uint32_t m_targetedHits = 0;		// targeted scans that found a known network
+		uint32_t m_fullScans = 0;
+		uint32_t m_lastScanMs = 0;			// duration of the last scan
+		uint16_t m_lastChannels = 0;		// channel mask of the last scan, 0 for all
+		uint32_t m_lastScanToConnectMs = 0;	// from the scan start to connected
+		uint8_t m_cacheEntries = 0;
+		uint32_t m_authTimeouts = 0;		// fast reconnects given up before association
+		uint32_t m_earlyStops = 0;			// targeted scans stopped at a good candidate
+	};
+
+	WiFiMultiSSID(WiFiDriver &driver = wifiArduinoDriver());
 	~WiFiMultiSSID();
 
 	bool addAP(const char *ssid, const char *passphrase = NULL);
 
-	uint8_t fastReconnect(const WiFiMultiSSID::LastParams &params, std::function<void(void)> periodicCb = 0, uint32_t retries = 1, uint32_t timeout = 5000);
+	// forget the access points and the scan cache, e.g. for new credentials
+	void clearAPs();
+
+	// start connecting to the given BSSID, applying the listen interval
+	void begin(const WiFiMultiSSID::LastParams &params);
+
+	// beacons between the wakeups of the sleeping modem, 0 for the default
+	void setListenInterval(const uint16_t &interval)
+	{
+		m_listenInterval = interval;
+	}
+
+	// authDeadline: give up (WL_NO_SSID_AVAIL) if the access point has not
+	// associated within this many ms, 0 to wait for the timeout
+	uint8_t fastReconnect(const WiFiMultiSSID::LastParams &params, std::function<void(void)> periodicCb = 0, uint32_t retries = 1, uint32_t timeout = 5000, uint32_t authDeadline = 0);
 	uint8_t connect(std::function<void(void)> periodicCb = 0, uint32_t retries = 1, uint32_t timeout = 5000);
 
+	// pick a BSSID of the connected SSID from finished scan results that is
+	// at least hysteresis dB stronger than the current link
+	bool findRoamCandidate(int32_t hysteresis, WiFiMultiSSID::LastParams &candidate);
+
+	const ScanStats &scanStats() const
+	{
+		return m_scanStats;
+	}
+
+	//
+	// connection history, ranks the scan candidates and vetoes fast reconnects
+	// to access points that keep failing
+	//
+
+	bool fastReconnectAllowed(const WiFiMultiSSID::LastParams &params) const;
+
+	// the link came up or went down, measures the session length; a session
+	// we leave on purpose (e.g. to roam) says nothing about the access point
+	void sessionStart();
+	void sessionEnd(const bool &record = true);
+
+	// the station disconnected since the last sessionStart(); disconnects
+	// on the way there (a roam leaving the old access point) don't count
+	bool linkLost();
+
+	WiFiHistory &history()
+	{
+		return m_history;
+	}
+
+	// SSID of a history entry, NULL if it is no longer configured
+	const char *historySSID(const WiFiHistory::Entry &entry) const;
+
 private:
+	//
+	// Access points of known networks seen by the scans (or connected to),
+	// so the next connect only needs to scan their channels. Entries are
+	// dropped after WIFI_SCAN_CACHE_MAX_AGE_MS.
+	//
+	struct ScanCacheEntry {
+		uint32_t m_seenMs;
+		uint8_t m_bssid[6];
+		uint8_t m_ap;		// index into m_apList
+		uint8_t m_channel;
+		int8_t m_rssi;
+		bool m_open;
+	};
+
+	static uint32_t ssidHash(const char *ssid);
+	int findAP(const char *ssid) const;
+	int connectedAP();
+
+	void expireCache(const uint32_t &nowMs);
+	void updateCache(const uint8_t &ap, const uint8_t *bssid, const int32_t &channel, const int32_t &rssi, const bool &open, const uint32_t &nowMs);
+	void cacheScanResults(const uint32_t &nowMs);
+	uint16_t cachedChannels() const;
+	bool bestCandidate(const uint32_t &sinceMs, WiFiMultiSSID::LastParams &params, int32_t *score = NULL) const;
+
+	bool scanChannels(const uint16_t &channels, std::function<void(void)> periodicCb, const uint32_t &startMillis, const uint32_t &timeout);
+	int16_t scanAll(std::function<void(void)> periodicCb, const uint32_t &startMillis, const uint32_t &timeout);
+
+	WiFiDriver &m_driver;
+
 	std::vector<Credentials> m_apList;
+	std::vector<uint32_t> m_apHashes;	// ssidHash() of m_apList entries
+
+	ScanCacheEntry m_cache[WIFI_SCAN_CACHE_SIZE];
+	uint8_t m_cacheSize = 0;
+
+	ScanStats m_scanStats;
+	uint16_t m_listenInterval = 0;
+
+	WiFiHistory m_history;
+	bool m_sessionActive = false;
+	uint32_t m_sessionDisconnects = 0;
+	uint32_t m_sessionStartMs = 0;
+	uint32_t m_sessionHash = 0;
+	uint8_t m_sessionBSSID[6] = {0};
 };
@@ -0,0 +1,395 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "WiFiDriver.h"
+
+//
+// Deterministic WiFi environment for running WiFiMultiSSID on a host.
+//
+// The environment is a list of access points, each with an RSSI trace (the
+// RSSI steps to the given value at the given time, below WIFI_SIM_RSSI_FLOOR
+// it is out of range), the time from begin() to association and from
+// association to the address, and a failure rate of the attempts. Scans take
+// their dwell time per channel; like the real radio, no scan can be started
+// while a connection attempt is in progress.
+//
+// Time only advances in delay() (or advance()), so a run is reproducible for
+// a given seed and millis() tells the simulated time to connect. Nothing here
+// depends on Arduino or the ESP-IDF.
+//
+//	WiFiSimDriver sim;
+//	size_t ap = sim.addAP("home", "secret", 0x112233445566ULL, 6);
+//	sim.setRssi(ap, 0, -60);
+//	sim.setRssi(ap, 30000, -127);	// gone after 30 s
+//	WiFiMultiSSID multi(sim);
+//
+
+#define WIFI_SIM_RSSI_FLOOR -95
+#define WIFI_SIM_MAX_CHANNEL 14
+
+class WiFiSimDriver : public WiFiDriver {
+public:
+	struct AccessPoint {
+		std::string m_ssid;
+		std::string m_password;		// empty for an open network
+		uint8_t m_bssid[6];
+		int32_t m_channel;
+		std::vector<std::pair<uint32_t, int32_t>> m_rssi;	// (from ms, dBm), sorted
+		uint32_t m_authMs;			// begin() to association
+		uint32_t m_dhcpMs;			// association to address
+		uint32_t m_failPermille;	// attempts rejected after m_authMs
+	};
+
+	struct Timing {
+		uint32_t m_fullScanMsPerChannel = 120;
+		uint32_t m_noApMs = 3000;		// until an attempt to a missing AP fails
+		uint32_t m_restartMs = 100;		// radio off and on
+	};
+
+	struct Stats {
+		uint32_t m_attempts = 0;
+		uint32_t m_scans = 0;
+		uint32_t m_scanMs = 0;			// radio time spent scanning
+		uint32_t m_rejectedScans = 0;	// started while connecting
+	};
+
+	explicit WiFiSimDriver(const uint32_t &seed = 1)
+		: m_random(seed ? seed : 1)
+	{
+	}
+
+	//
+	// environment
+	//
+
+	size_t addAP(const char *ssid, const char *password, const uint64_t &bssid, const int32_t &channel, const uint32_t &authMs = 300, const uint32_t &dhcpMs = 200)
+	{
+		AccessPoint ap;
+		ap.m_ssid = ssid;
+		ap.m_password = password ? password : "";
+		for (uint8_t i = 0; i < 6; i++) {
+			ap.m_bssid[i] = bssid >> (8 * (5 - i));
+		}
+		ap.m_channel = channel;
+		ap.m_authMs = authMs;
+		ap.m_dhcpMs = dhcpMs;
+		ap.m_failPermille = 0;
+		m_aps.push_back(ap);
+		return m_aps.size() - 1;
+	}
+
+	AccessPoint &ap(const size_t &index)
+	{
+		return m_aps[index];
+	}
+
+	// the RSSI is rssi from atMs on
+	void setRssi(const size_t &index, const uint32_t &atMs, const int32_t &rssi)
+	{
+		std::vector<std::pair<uint32_t, int32_t>> &trace = m_aps[index].m_rssi;
+		size_t pos = trace.size();
+		while (pos > 0 && trace[pos - 1].first > atMs) {
+			pos--;
+		}
+		trace.insert(trace.begin() + pos, std::make_pair(atMs, rssi));
+	}
+
+	Timing &timing()
+	{
+		return m_timing;
+	}
+
+	const Stats &stats() const
+	{
+		return m_stats;
+	}
+
+	void advance(const uint32_t &ms)
+	{
+		m_nowMs += ms;
+		step();
+	}
+
+	//
+	// WiFiDriver
+	//
+
+	virtual uint32_t millis() override
+	{
+		return m_nowMs;
+	}
+
+	virtual void delay(const uint32_t &ms) override
+	{
+		advance(ms);
+	}
+
+	virtual uint8_t status() override
+	{
+		step();
+		return m_status;
+	}
+
+	// the modem never sleeps in the simulation, the listen interval is ignored
+	virtual void begin(const char *ssid, const char *password, const int32_t &channel, const uint8_t *bssid, const uint16_t & /* listenInterval */) override
+	{
+		static const uint8_t anyBSSID[6] = {0};
+
+		m_stats.m_attempts++;
+		dropLink();
+		m_scanning = false;
+		m_status = WL_DISCONNECTED;
+		m_state = STATE_CONNECTING;
+		m_target = -1;
+
+		// the strongest matching access point in range
+		int32_t bestRssi = WIFI_SIM_RSSI_FLOOR;
+		for (size_t i = 0; i < m_aps.size(); i++) {
+			const AccessPoint &ap = m_aps[i];
+			bool match = (ap.m_ssid == ssid) &&
+				(channel <= 0 || ap.m_channel == channel) &&
+				(!bssid || !memcmp(bssid, anyBSSID, 6) || !memcmp(bssid, ap.m_bssid, 6));
+			int32_t rssi = rssiAt(ap, m_nowMs);
+			if (match && rssi > bestRssi) {
+				m_target = i;
+				bestRssi = rssi;
+			}
+		}
+
+		if (m_target < 0) {
+			m_outcome = WL_NO_SSID_AVAIL;
+			m_nextMs = m_nowMs + m_timing.m_noApMs;
+			return;
+		}
+
+		const AccessPoint &ap = m_aps[m_target];
+		bool rejected = (ap.m_password != (password ? password : "")) || (nextRandom() % 1000 < ap.m_failPermille);
+		m_outcome = rejected ? WL_CONNECT_FAILED : WL_CONNECTED;
+		m_nextMs = m_nowMs + ap.m_authMs;
+	}
+
+	virtual void disconnect() override
+	{
+		dropLink();
+		m_state = STATE_IDLE;
+		m_status = WL_DISCONNECTED;
+		m_target = -1;
+	}
+
+	virtual void restart() override
+	{
+		disconnect();
+		m_scanning = false;
+		advance(m_timing.m_restartMs);
+	}
+
+	virtual uint32_t associations() override
+	{
+		step();
+		return m_associations;
+	}
+
+	virtual uint32_t disconnects() override
+	{
+		step();
+		return m_disconnects;
+	}
+
+	virtual bool ssid(char *ssid, const size_t &size) override
+	{
+		if (status() != WL_CONNECTED) {
+			return false;
+		}
+		strncpy(ssid, m_aps[m_target].m_ssid.c_str(), size - 1);
+		ssid[size - 1] = 0;
+		return true;
+	}
+
+	virtual bool bssid(uint8_t *bssid) override
+	{
+		if (status() != WL_CONNECTED) {
+			return false;
+		}
+		memcpy(bssid, m_aps[m_target].m_bssid, 6);
+		return true;
+	}
+
+	virtual int32_t rssi() override
+	{
+		return (status() == WL_CONNECTED) ? rssiAt(m_aps[m_target], m_nowMs) : 0;
+	}
+
+	virtual int32_t channel() override
+	{
+		return (status() == WL_CONNECTED) ? m_aps[m_target].m_channel : 0;
+	}
+
+	virtual uint32_t localIP() override
+	{
+		// 192.168.2.100 + AP, in network order like IPAddress
+		return (status() == WL_CONNECTED) ? (192 | 168 << 8 | 2 << 16 | (uint32_t)(100 + m_target) << 24) : 0;
+	}
+
+	virtual bool scanStart(const uint8_t &channel, const uint32_t &dwellMs) override
+	{
+		step();
+		if (m_state == STATE_CONNECTING || m_state == STATE_ASSOCIATED || m_scanning) {
+			m_stats.m_rejectedScans++;
+			return false;
+		}
+
+		uint32_t durationMs = channel ? dwellMs : WIFI_SIM_MAX_CHANNEL * m_timing.m_fullScanMsPerChannel;
+		m_stats.m_scans++;
+		m_stats.m_scanMs += durationMs;
+
+		m_scanning = true;
+		m_scanChannel = channel;
+		m_scanDoneMs = m_nowMs + durationMs;
+		m_results.clear();
+		m_resultsValid = false;
+		return true;
+	}
+
+	virtual void scanStop() override
+	{
+		m_scanning = false;
+	}
+
+	virtual int16_t scanComplete() override
+	{
+		step();
+		if (m_scanning) {
+			return WIFI_SCAN_RUNNING;
+		}
+		return m_resultsValid ? m_results.size() : WIFI_SCAN_FAILED;
+	}
+
+	virtual bool scanResult(const int16_t &index, ScanResult &result) override
+	{
+		if (!m_resultsValid || index < 0 || (size_t)index >= m_results.size()) {
+			return false;
+		}
+		result = m_results[index];
+		return true;
+	}
+
+	virtual void scanDelete() override
+	{
+		m_results.clear();
+		m_resultsValid = false;
+	}
+
+private:
+	enum State {
+		STATE_IDLE,
+		STATE_CONNECTING,		// waiting for association or the failure
+		STATE_ASSOCIATED,		// waiting for the address
+		STATE_CONNECTED,
+	};
+
+	static int32_t rssiAt(const AccessPoint &ap, const uint32_t &ms)
+	{
+		int32_t rssi = -127;
+		for (size_t i = 0; i < ap.m_rssi.size() && ap.m_rssi[i].first <= ms; i++) {
+			rssi = ap.m_rssi[i].second;
+		}
+		return rssi;
+	}
+
+	// xorshift32
+	uint32_t nextRandom()
+	{
+		m_random ^= m_random << 13;
+		m_random ^= m_random >> 17;
+		m_random ^= m_random << 5;
+		return m_random;
+	}
+
+	// catch up with the current time
+	void step()
+	{
+		if (m_scanning && (int32_t)(m_nowMs - m_scanDoneMs) >= 0) {
+			m_scanning = false;
+			collectResults();
+		}
+
+		if (m_state == STATE_CONNECTING && (int32_t)(m_nowMs - m_nextMs) >= 0) {
+			if (m_outcome == WL_CONNECTED) {
+				m_associations++;
+				m_state = STATE_ASSOCIATED;
+				m_nextMs += m_aps[m_target].m_dhcpMs;
+			} else {
+				m_state = STATE_IDLE;
+				m_status = m_outcome;
+			}
+		}
+
+		if (m_state == STATE_ASSOCIATED && (int32_t)(m_nowMs - m_nextMs) >= 0) {
+			m_state = STATE_CONNECTED;
+			m_status = WL_CONNECTED;
+		}
+
+		// the access point went out of range
+		if ((m_state == STATE_ASSOCIATED || m_state == STATE_CONNECTED) && rssiAt(m_aps[m_target], m_nowMs) <= WIFI_SIM_RSSI_FLOOR) {
+			m_disconnects++;
+			m_state = STATE_IDLE;
+			m_status = WL_CONNECTION_LOST;
+		}
+	}
+
+	// leaving an associated access point raises a disconnect
+	void dropLink()
+	{
+		step();
+		if (m_state == STATE_ASSOCIATED || m_state == STATE_CONNECTED) {
+			m_disconnects++;
+		}
+	}
+
+	void collectResults()
+	{
+		m_results.clear();
+		for (size_t i = 0; i < m_aps.size(); i++) {
+			const AccessPoint &ap = m_aps[i];
+			int32_t rssi = rssiAt(ap, m_nowMs);
+			if (rssi <= WIFI_SIM_RSSI_FLOOR || (m_scanChannel && ap.m_channel != m_scanChannel)) {
+				continue;
+			}
+
+			ScanResult result;
+			strncpy(result.m_ssid, ap.m_ssid.c_str(), sizeof(result.m_ssid) - 1);
+			result.m_ssid[sizeof(result.m_ssid) - 1] = 0;
+			memcpy(result.m_bssid, ap.m_bssid, sizeof(result.m_bssid));
+			result.m_channel = ap.m_channel;
+			result.m_rssi = rssi;
+			result.m_open = ap.m_password.empty();
+			m_results.push_back(result);
+		}
+		m_resultsValid = true;
+	}
+
+	std::vector<AccessPoint> m_aps;
+	Timing m_timing;
+	Stats m_stats;
+	uint32_t m_random;
+	uint32_t m_nowMs = 0;
+
+	// station
+	State m_state = STATE_IDLE;
+	uint8_t m_status = WL_DISCONNECTED;
+	uint8_t m_outcome = WL_DISCONNECTED;
+	int32_t m_target = -1;
+	uint32_t m_nextMs = 0;
+	uint32_t m_associations = 0;
+	uint32_t m_disconnects = 0;
+
+	// scan
+	bool m_scanning = false;
+	uint8_t m_scanChannel = 0;
+	uint32_t m_scanDoneMs = 0;
+	std::vector<ScanResult> m_results;
+	bool m_resultsValid = false;
+};
@@ -0,0 +1,98 @@
+#include <Arduino.h>
+#include "binlog.h"
+#include "config.h"
+
+#define BINLOG_WORDS (BINLOG_BUFFER_SIZE / sizeof(uint32_t))
+#define BINLOG_MASK (BINLOG_WORDS - 1)
+
+static_assert((BINLOG_WORDS & BINLOG_MASK) == 0, "BINLOG_BUFFER_SIZE must be a power of two");
+
+class BinlogContext {
+public:
+	uint32_t m_buffer[BINLOG_WORDS];
+
+	// free running word indexes, wrapped by BINLOG_MASK on access
+	uint32_t m_head = 0;
+	uint32_t m_tail = 0;
+
+	uint16_t m_seq = 0;
+	uint32_t m_dropped = 0;
+
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	uint32_t used() const
+	{
+		return m_head - m_tail;
+	}
+
+	void put(uint32_t word)
+	{
+		m_buffer[m_head++ & BINLOG_MASK] = word;
+	}
+
+	void dropOldest()
+	{
+		uint32_t header = m_buffer[m_tail & BINLOG_MASK];
+		m_tail += BINLOG_HEADER_WORDS + ((header >> 16) & 0xff);
+		m_dropped++;
+	}
+};
+
+static BinlogContext g_ctx;
+
+void binlogWrite(const char *fmt, const uint32_t *args, uint32_t numArgs)
+{
+	uint32_t len = BINLOG_HEADER_WORDS + numArgs;
+	uint32_t ts = millis();
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+
+	// make space by discarding the oldest records
+	while (BINLOG_WORDS - g_ctx.used() < len) {
+		g_ctx.dropOldest();
+	}
+
+	g_ctx.put((BINLOG_MAGIC << 24) | (numArgs << 16) | g_ctx.m_seq++);
+	g_ctx.put((uint32_t)(uintptr_t)fmt);
+	g_ctx.put(ts);
+	for (uint32_t i = 0; i < numArgs; i++) {
+		g_ctx.put(args[i]);
+	}
+
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
+
+size_t binlogDumpSize()
+{
+	// upper bound, dump header + whole ring
+	return 2 * sizeof(uint32_t) + BINLOG_BUFFER_SIZE;
+}
+
+size_t binlogDump(uint8_t *buf, size_t size)
+{
+	if (size < binlogDumpSize()) {
+		return 0;
+	}
+
+	uint32_t *out = (uint32_t *)buf;
+	size_t numWords = 0;
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	out[0] = BINLOG_DUMP_MAGIC;
+	out[1] = g_ctx.m_dropped;
+	numWords = g_ctx.used();
+	for (uint32_t i = 0; i < numWords; i++) {
+		out[2 + i] = g_ctx.m_buffer[(g_ctx.m_tail + i) & BINLOG_MASK];
+	}
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+
+	return (2 + numWords) * sizeof(uint32_t);
+}
+
+void binlogClear()
+{
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	g_ctx.m_tail = g_ctx.m_head;
+	g_ctx.m_dropped = 0;
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
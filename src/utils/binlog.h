@@ -0,0 +1,93 @@
+#pragma once
+
+#include <Arduino.h>
+#include <string.h>
+#include <type_traits>
+#include "config.h"
+
+//
+// Deferred-format ("defmt style") binary logging for hot paths.
+//
+// LOG_BINARY() does not format anything on the device. It only stores the
+// address of the format string (which lives in the flash .rodata section),
+// a millis() timestamp and the raw argument words into a RAM ring buffer.
+// The buffer is served at /binlog and decoded on the host by
+// tools/binlog_decode.py, which looks the format strings up in the firmware ELF.
+//
+// Arguments are stored as 32-bit words, 64-bit types (double, float, long long)
+// take two words. "%s" arguments are stored as pointers, so they can only be
+// decoded when they point to constant strings.
+//
+
+// record layout: [header][format address][timestamp][argument words...]
+#define BINLOG_MAGIC		0xB1
+#define BINLOG_HEADER_WORDS	3
+
+// dump layout: "BLG1", number of dropped records, records (oldest first)
+#define BINLOG_DUMP_MAGIC	0x31474c42
+
+void binlogWrite(const char *fmt, const uint32_t *args, uint32_t numArgs);
+size_t binlogDumpSize();
+size_t binlogDump(uint8_t *buf, size_t size);
+void binlogClear();
+
+//
+// argument packing
+//
+
+template <typename T>
+inline typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uint32_t *>::type
+binlogPack(uint32_t *p, T value)
+{
+	if (sizeof(T) > sizeof(uint32_t)) {
+		uint64_t raw = (uint64_t)value;
+		*p++ = (uint32_t)raw;
+		*p++ = (uint32_t)(raw >> 32);
+	} else {
+		*p++ = (uint32_t)value;
+	}
+	return p;
+}
+
+template <typename T>
+inline typename std::enable_if<std::is_pointer<T>::value, uint32_t *>::type
+binlogPack(uint32_t *p, T value)
+{
+	*p++ = (uint32_t)(uintptr_t)value;
+	return p;
+}
+
+inline uint32_t *binlogPack(uint32_t *p, double value)
+{
+	uint64_t raw;
+	memcpy(&raw, &value, sizeof(raw));
+	*p++ = (uint32_t)raw;
+	*p++ = (uint32_t)(raw >> 32);
+	return p;
+}
+
+inline uint32_t *binlogPack(uint32_t *p, float value)
+{
+	// varargs promote float to double, so does the decoder
+	return binlogPack(p, (double)value);
+}
+
+template <typename... Args>
+inline void binlogRecord(const char *fmt, Args... args)
+{
+	// every argument takes at most two words
+	uint32_t words[2 * sizeof...(Args) + 1];
+	uint32_t *p = words;
+
+	// braced initializer guarantees left-to-right packing
+	int unused[] = { 0, ((p = binlogPack(p, args)), 0)... };
+	(void)unused;
+
+	binlogWrite(fmt, words, p - words);
+}
+
+#if BINLOG_ENABLED
+#define LOG_BINARY(fmt, ...) binlogRecord(PSTR(fmt), ##__VA_ARGS__)
+#else
+#define LOG_BINARY(fmt, ...) LOG_PRINTF(fmt, ##__VA_ARGS__)
+#endif
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include "bootTrace.h"
+
+#define BOOT_TRACE_MAGIC 0x42545231	// "BTR1"
+
+// lives in RTC slow memory, not cleared on software reset
+static RTC_NOINIT_ATTR BootTrace g_rtcTrace;
+
+class BootTraceContext {
+public:
+	// snapshot of the previous boot, NULL if not available
+	BootTrace *m_previous = nullptr;
+	bool m_initialized = false;
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	int8_t add(const char *name, const uint32_t &durationUs, const bool &once = false)
+	{
+		int8_t span = -1;
+		uint32_t now = esp_timer_get_time();
+		const char *task = pcTaskGetTaskName(NULL);
+
+		portENTER_CRITICAL(&m_mux);
+		if (m_initialized && !g_rtcTrace.m_finished && g_rtcTrace.m_numSpans < BOOT_TRACE_MAX_SPANS && !(once && find(name))) {
+			span = g_rtcTrace.m_numSpans;
+
+			BootTraceSpan &entry = g_rtcTrace.m_spans[span];
+			strncpy(entry.m_name, name, sizeof(entry.m_name) - 1);
+			strncpy(entry.m_task, task, sizeof(entry.m_task) - 1);
+			entry.m_startUs = now;
+			entry.m_durationUs = durationUs;
+
+			// publish the span only once it is complete
+			g_rtcTrace.m_numSpans++;
+		}
+		portEXIT_CRITICAL(&m_mux);
+
+		return span;
+	}
+
+private:
+	static bool find(const char *name)
+	{
+		for (uint8_t i = 0; i < g_rtcTrace.m_numSpans; i++) {
+			if (!strncmp(g_rtcTrace.m_spans[i].m_name, name, sizeof(g_rtcTrace.m_spans[i].m_name) - 1)) {
+				return true;
+			}
+		}
+		return false;
+	}
+};
+
+static BootTraceContext g_ctx;
+
+void bootTraceInit()
+{
+	esp_reset_reason_t reason = esp_reset_reason();
+
+	// RTC memory content is random after power on
+	if ((g_rtcTrace.m_magic == BOOT_TRACE_MAGIC) && (reason != ESP_RST_POWERON) && (reason != ESP_RST_BROWNOUT) &&
+		(g_rtcTrace.m_numSpans <= BOOT_TRACE_MAX_SPANS)) {
+		g_ctx.m_previous = (BootTrace *)malloc(sizeof(BootTrace));
+		if (g_ctx.m_previous) {
+			memcpy(g_ctx.m_previous, &g_rtcTrace, sizeof(BootTrace));
+		}
+	}
+
+	memset(&g_rtcTrace, 0, sizeof(g_rtcTrace));
+	g_rtcTrace.m_magic = BOOT_TRACE_MAGIC;
+	g_ctx.m_initialized = true;
+}
+
+int8_t bootTraceBegin(const char *name)
+{
+	return g_ctx.add(name, BOOT_TRACE_OPEN);
+}
+
+void bootTraceEnd(const int8_t &span)
+{
+	if (span < 0 || span >= BOOT_TRACE_MAX_SPANS) {
+		return;
+	}
+
+	BootTraceSpan &entry = g_rtcTrace.m_spans[span];
+	entry.m_durationUs = (uint32_t)esp_timer_get_time() - entry.m_startUs;
+}
+
+void bootTraceMark(const char *name)
+{
+	g_ctx.add(name, 0);
+}
+
+bool bootTraceMarkOnce(const char *name)
+{
+	return g_ctx.add(name, 0, true) >= 0;
+}
+
+void bootTraceFinish(const char *name)
+{
+	if (g_rtcTrace.m_finished) {
+		return;
+	}
+
+	g_ctx.add(name, 0);
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	g_rtcTrace.m_finished = true;
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
+
+bool bootTraceGet(BootTrace &trace)
+{
+	if (!g_ctx.m_initialized) {
+		return false;
+	}
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	memcpy(&trace, &g_rtcTrace, sizeof(trace));
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+	return true;
+}
+
+bool bootTraceGetPrevious(BootTrace &trace)
+{
+	if (!g_ctx.m_previous) {
+		return false;
+	}
+
+	memcpy(&trace, g_ctx.m_previous, sizeof(trace));
+	return true;
+}
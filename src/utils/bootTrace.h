@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Boot timeline kept in RTC slow memory.
+//
+// Spans of the startup phases are recorded with esp_timer timestamps (us
+// since reset) from setup() until the first HTTP request is served, then
+// recording stops. Like the post-mortem log the trace survives software
+// resets, so the timeline of the previous boot can be served at /boot too.
+//
+
+// duration of a span that was not ended (yet)
+#define BOOT_TRACE_OPEN UINT32_MAX
+
+struct BootTraceSpan {
+	char m_name[BOOT_TRACE_NAME_LEN];
+	char m_task[12];			// task the span was recorded from
+	uint32_t m_startUs;
+	uint32_t m_durationUs;		// 0 for a mark
+};
+
+struct BootTrace {
+	uint32_t m_magic;
+	uint8_t m_numSpans;
+	bool m_finished;			// first request served, recording stopped
+	BootTraceSpan m_spans[BOOT_TRACE_MAX_SPANS];
+};
+
+void bootTraceInit();
+
+// returns the span id for bootTraceEnd(), -1 when not recording
+int8_t bootTraceBegin(const char *name);
+void bootTraceEnd(const int8_t &span);
+
+// zero length span
+void bootTraceMark(const char *name);
+
+// mark only the first occurrence, true if it was recorded
+bool bootTraceMarkOnce(const char *name);
+
+// record the last mark and stop recording
+void bootTraceFinish(const char *name);
+
+// copy of the trace, false if not available
+bool bootTraceGet(BootTrace &trace);
+bool bootTraceGetPrevious(BootTrace &trace);
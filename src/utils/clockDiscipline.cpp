@@ -0,0 +1,124 @@
+#include "clockDiscipline.h"
+
+#define PPB 1000000000LL
+
+static int64_t absUs(const int64_t &value)
+{
+	return value < 0 ? -value : value;
+}
+
+ClockDiscipline::ClockDiscipline()
+	: m_synced(false)
+	, m_haveFreqRef(false)
+	, m_haveFreq(false)
+	, m_freqRefWallUs(0)
+	, m_freqRefLocalUs(0)
+	, m_lastOffsetUs(0)
+	, m_intervalMs(NTP_UPDATE_INTERVAL_MS)
+{
+}
+
+int64_t ClockDiscipline::wallUs(const State &state, const int64_t &localUs)
+{
+	int64_t dt = localUs - state.m_localBaseUs;
+
+	// frequency corrected elapsed time
+	int64_t wall = state.m_wallBaseUs + dt + dt * state.m_freqPpb / PPB;
+
+	// slew the remaining offset in at a limited rate
+	int64_t maxSlew = dt * (CLOCK_SLEW_RATE_PPM * 1000LL) / PPB;
+	if (state.m_slewUs > maxSlew) {
+		wall += maxSlew;
+	} else if (state.m_slewUs < -maxSlew) {
+		wall -= maxSlew;
+	} else {
+		wall += state.m_slewUs;
+	}
+
+	return wall;
+}
+
+void ClockDiscipline::step(const int64_t &wallUs, const int64_t &localUs)
+{
+	m_state.m_localBaseUs = localUs;
+	m_state.m_wallBaseUs = wallUs;
+	m_state.m_slewUs = 0;
+}
+
+void ClockDiscipline::estimateFrequency(const int64_t &wallUs, const int64_t &localUs, const int64_t &precisionUs)
+{
+	if (!m_haveFreqRef) {
+		m_haveFreqRef = true;
+		m_freqRefWallUs = wallUs;
+		m_freqRefLocalUs = localUs;
+		return;
+	}
+
+	// wait until the sample precision allows the requested resolution,
+	// two samples with +-precisionUs each over dt give 2 * precisionUs / dt
+	int64_t dt = localUs - m_freqRefLocalUs;
+	if (dt <= 0 || (2 * precisionUs * PPB / dt) > CLOCK_FREQ_RESOLUTION_PPM * 1000LL) {
+		return;
+	}
+
+	// raw drift of the local clock against the reference
+	int64_t measuredPpb = ((wallUs - m_freqRefWallUs) - dt) * PPB / dt;
+
+	int64_t freqPpb = measuredPpb;
+	if (m_haveFreq) {
+		// exponential average to filter the sample jitter
+		freqPpb = m_state.m_freqPpb + (measuredPpb - m_state.m_freqPpb) / CLOCK_FREQ_AVERAGING;
+	}
+	m_haveFreq = true;
+
+	// limit to a sane crystal tolerance, before it is narrowed to 32 bits
+	int64_t maxPpb = CLOCK_MAX_FREQ_PPM * 1000LL;
+	if (freqPpb > maxPpb) {
+		freqPpb = maxPpb;
+	} else if (freqPpb < -maxPpb) {
+		freqPpb = -maxPpb;
+	}
+	m_state.m_freqPpb = freqPpb;
+
+	m_freqRefWallUs = wallUs;
+	m_freqRefLocalUs = localUs;
+}
+
+void ClockDiscipline::adaptInterval(const int64_t &offsetUs)
+{
+	// poll less often once the clock is well disciplined, more often when not
+	if (absUs(offsetUs) < CLOCK_GOOD_OFFSET_MS * 1000LL) {
+		m_intervalMs = (m_intervalMs < NTP_UPDATE_INTERVAL_MAX_MS / 2) ? m_intervalMs * 2 : NTP_UPDATE_INTERVAL_MAX_MS;
+	} else if (absUs(offsetUs) > CLOCK_BAD_OFFSET_MS * 1000LL) {
+		m_intervalMs = (m_intervalMs > NTP_UPDATE_INTERVAL_MS * 2) ? m_intervalMs / 2 : NTP_UPDATE_INTERVAL_MS;
+	}
+}
+
+void ClockDiscipline::sample(const int64_t &wallUs, const int64_t &localUs, const int64_t &precisionUs)
+{
+	if (!m_synced) {
+		// first sample, nothing to discipline yet
+		m_synced = true;
+		m_lastOffsetUs = 0;
+		step(wallUs, localUs);
+		estimateFrequency(wallUs, localUs, precisionUs);
+		return;
+	}
+
+	int64_t predictedUs = ClockDiscipline::wallUs(m_state, localUs);
+	m_lastOffsetUs = wallUs - predictedUs;
+
+	if (absUs(m_lastOffsetUs) > CLOCK_STEP_THRESHOLD_MS * 1000LL) {
+		// too far off to be slewed in reasonable time
+		step(wallUs, localUs);
+		m_intervalMs = NTP_UPDATE_INTERVAL_MS;
+	} else {
+		// rebase on the current (continuous) time and slew the offset in
+		m_state.m_localBaseUs = localUs;
+		m_state.m_wallBaseUs = predictedUs;
+		m_state.m_slewUs = m_lastOffsetUs;
+		adaptInterval(m_lastOffsetUs);
+	}
+
+	estimateFrequency(wallUs, localUs, precisionUs);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+//
+// Clock discipline for the NTP synchronized wall clock.
+//
+// Wall time is derived from the 64-bit esp_timer microsecond counter, so it
+// does not wrap like millis(). Every NTP sample is used to:
+//  - estimate the frequency error of the local crystal from successive samples,
+//  - slew the remaining offset in at no more than CLOCK_SLEW_RATE_PPM instead
+//    of stepping (only offsets above CLOCK_STEP_THRESHOLD_MS are stepped),
+//  - adapt the interval to the next sample once the offsets stay small.
+//
+// The class is pure integer arithmetic without any platform dependencies.
+//
+
+class ClockDiscipline {
+public:
+	// snapshot needed to convert local time to wall time
+	struct State {
+		int64_t m_localBaseUs = 0;	// local time of the base
+		int64_t m_wallBaseUs = 0;	// wall time at m_localBaseUs
+		int64_t m_slewUs = 0;		// offset still to be slewed in after the base
+		int32_t m_freqPpb = 0;		// local clock frequency correction
+	};
+
+	ClockDiscipline();
+
+	// convert local (esp_timer) time into wall time
+	static int64_t wallUs(const State &state, const int64_t &localUs);
+
+	// process a sample, wallUs is the reference time at localUs with given precision
+	void sample(const int64_t &wallUs, const int64_t &localUs, const int64_t &precisionUs);
+
+	const State &state() const
+	{
+		return m_state;
+	}
+
+	bool synced() const
+	{
+		return m_synced;
+	}
+
+	int64_t lastOffsetUs() const
+	{
+		return m_lastOffsetUs;
+	}
+
+	uint32_t intervalMs() const
+	{
+		return m_intervalMs;
+	}
+
+private:
+	void step(const int64_t &wallUs, const int64_t &localUs);
+	void estimateFrequency(const int64_t &wallUs, const int64_t &localUs, const int64_t &precisionUs);
+	void adaptInterval(const int64_t &offsetUs);
+
+	State m_state;
+	bool m_synced;
+
+	// reference sample for the frequency estimate
+	bool m_haveFreqRef;
+	bool m_haveFreq;
+	int64_t m_freqRefWallUs;
+	int64_t m_freqRefLocalUs;
+
+	int64_t m_lastOffsetUs;
+	uint32_t m_intervalMs;
+};
@@ -0,0 +1,341 @@
+#include <Arduino.h>
+#include <nvs.h>
+#include <SPIFFS.h>
+#include <rom/crc.h>
+#include "configStore.h"
+#include "bootTrace.h"
+#include "watchdog.h"
+#include "utils.h"
+
+#define CONFIG_RECORD_MAGIC 0x31474643	// "CFG1"
+
+// not defined by older IDF versions
+#ifndef NVS_KEY_NAME_MAX_SIZE
+#define NVS_KEY_NAME_MAX_SIZE 16
+#endif
+
+struct ConfigRecordHeader {
+	uint32_t m_magic;
+	uint32_t m_generation;		// incremented by every save
+	uint16_t m_version;			// schema version of the payload
+	uint16_t m_size;			// payload size
+	uint32_t m_crc;				// over the header (with m_crc = 0) and the payload
+};
+
+class ConfigStoreContext {
+private:
+	SemaphoreHandle_t m_mutex = NULL;
+	nvs_handle m_handle = 0;
+	bool m_opened = false;
+
+	// a mount of its own, formatting must not hold up the records
+	SemaphoreHandle_t m_fsMutex = NULL;
+	bool m_fsMounted = false;
+
+	static const ConfigRecordHeader *header(const uint8_t *record)
+	{
+		return (const ConfigRecordHeader *)record;
+	}
+
+	static uint32_t checksum(const ConfigRecordHeader &header, const uint8_t *payload)
+	{
+		ConfigRecordHeader copy = header;
+		copy.m_crc = 0;
+		uint32_t crc = crc32_le(0, (const uint8_t *)&copy, sizeof(copy));
+		return crc32_le(crc, payload, header.m_size);
+	}
+
+	static void slotKey(const char *name, const uint8_t &slot, char *key)
+	{
+		snprintf(key, NVS_KEY_NAME_MAX_SIZE, "%s%u", name, slot);
+	}
+
+	// the NVS namespace is opened by the first access
+	bool open()
+	{
+		if (m_opened) {
+			return true;
+		}
+
+		esp_err_t err = nvs_open(CONFIG_NVS_NAMESPACE, NVS_READWRITE, &m_handle);
+		if (err != ESP_OK) {
+			LOG_ERROR(CONFIG, "[CONFIG] Unable to open NVS namespace %s (%d)\n", CONFIG_NVS_NAMESPACE, err);
+			return false;
+		}
+		m_opened = true;
+		return true;
+	}
+
+	// header and payload of a slot, NULL if it is missing or corrupt
+	uint8_t *readSlot(const char *name, const uint8_t &slot)
+	{
+		char key[NVS_KEY_NAME_MAX_SIZE];
+		slotKey(name, slot, key);
+
+		size_t length = 0;
+		if (nvs_get_blob(m_handle, key, NULL, &length) != ESP_OK) {
+			return NULL;
+		}
+
+		if (length < sizeof(ConfigRecordHeader) || length > sizeof(ConfigRecordHeader) + CONFIG_MAX_RECORD_SIZE) {
+			LOG_ERROR(CONFIG, "[CONFIG] %s has an invalid size %u\n", key, length);
+			return NULL;
+		}
+
+		uint8_t *record = (uint8_t *)malloc(length);
+		if (!record) {
+			return NULL;
+		}
+
+		if (nvs_get_blob(m_handle, key, record, &length) != ESP_OK ||
+			header(record)->m_magic != CONFIG_RECORD_MAGIC ||
+			header(record)->m_size != length - sizeof(ConfigRecordHeader) ||
+			header(record)->m_crc != checksum(*header(record), record + sizeof(ConfigRecordHeader))) {
+			LOG_ERROR(CONFIG, "[CONFIG] %s is corrupt\n", key);
+			free(record);
+			return NULL;
+		}
+		return record;
+	}
+
+	// newest valid slot, -1 if there is none; the record is freed by the caller
+	int8_t readNewest(const char *name, uint8_t *&record)
+	{
+		uint8_t *slots[2] = { readSlot(name, 0), readSlot(name, 1) };
+		int8_t newest = -1;
+
+		if (slots[0] && slots[1]) {
+			newest = ((int32_t)(header(slots[1])->m_generation - header(slots[0])->m_generation) > 0) ? 1 : 0;
+		} else if (slots[0]) {
+			newest = 0;
+		} else if (slots[1]) {
+			newest = 1;
+		}
+
+		for (int8_t i = 0; i < 2; i++) {
+			if (i != newest) {
+				free(slots[i]);
+			}
+		}
+
+		record = (newest >= 0) ? slots[newest] : NULL;
+		return newest;
+	}
+
+	bool saveLocked(const char *name, const uint16_t &version, const void *data, const size_t &size)
+	{
+		uint8_t *current = NULL;
+		int8_t newest = readNewest(name, current);
+		uint32_t generation = 1;
+
+		if (current) {
+			// nothing to do if the newest copy is the same, saves flash wear
+			bool same = (header(current)->m_version == version) && (header(current)->m_size == size) &&
+				!memcmp(current + sizeof(ConfigRecordHeader), data, size);
+			generation = header(current)->m_generation + 1;
+			free(current);
+
+			if (same) {
+				return true;
+			}
+		}
+
+		uint8_t *record = (uint8_t *)malloc(sizeof(ConfigRecordHeader) + size);
+		if (!record) {
+			return false;
+		}
+
+		ConfigRecordHeader *recordHeader = (ConfigRecordHeader *)record;
+		recordHeader->m_magic = CONFIG_RECORD_MAGIC;
+		recordHeader->m_generation = generation;
+		recordHeader->m_version = version;
+		recordHeader->m_size = size;
+		memcpy(record + sizeof(ConfigRecordHeader), data, size);
+		recordHeader->m_crc = checksum(*recordHeader, record + sizeof(ConfigRecordHeader));
+
+		// write the other slot, the newest copy stays valid until committed
+		char key[NVS_KEY_NAME_MAX_SIZE];
+		slotKey(name, (newest == 0) ? 1 : 0, key);
+
+		esp_err_t err = nvs_set_blob(m_handle, key, record, sizeof(ConfigRecordHeader) + size);
+		if (err == ESP_OK) {
+			err = nvs_commit(m_handle);
+		}
+		free(record);
+
+		if (err != ESP_OK) {
+			LOG_ERROR(CONFIG, "[CONFIG] Unable to save %s (%d)\n", key, err);
+			return false;
+		}
+		return true;
+	}
+
+	bool lock()
+	{
+		if (!m_mutex || xSemaphoreTake(m_mutex, portMAX_DELAY) != pdTRUE) {
+			return false;
+		}
+
+		if (!open()) {
+			xSemaphoreGive(m_mutex);
+			return false;
+		}
+		return true;
+	}
+
+	void unlock()
+	{
+		xSemaphoreGive(m_mutex);
+	}
+
+public:
+	void init()
+	{
+		m_mutex = xSemaphoreCreateMutex();
+		m_fsMutex = xSemaphoreCreateMutex();
+	}
+
+	bool mountFs()
+	{
+		if (!m_fsMutex || xSemaphoreTake(m_fsMutex, portMAX_DELAY) != pdTRUE) {
+			return false;
+		}
+
+		if (!m_fsMounted) {
+			int8_t span = bootTraceBegin("spiffs");
+			int64_t startUs = esp_timer_get_time();
+
+			// formatting may take a long time
+			watchdogEnable(false);
+			m_fsMounted = SPIFFS.begin(true);
+			watchdogEnable(true);
+			bootTraceEnd(span);
+
+			if (m_fsMounted) {
+				LOG_INFO(CONFIG, "[CONFIG] SPIFFS mounted in %lld us, %u of %u bytes used\n", esp_timer_get_time() - startUs, SPIFFS.usedBytes(), SPIFFS.totalBytes());
+			} else {
+				LOG_ERROR(CONFIG, "[CONFIG] Unable to mount SPIFFS, even after formatting\n");
+			}
+		}
+
+		bool mounted = m_fsMounted;
+		xSemaphoreGive(m_fsMutex);
+		return mounted;
+	}
+
+	bool load(const char *name, const uint16_t &version, void *data, const size_t &size, ConfigMigrateFn migrate)
+	{
+		if (strlen(name) > NVS_KEY_NAME_MAX_SIZE - 2 || size > CONFIG_MAX_RECORD_SIZE || !lock()) {
+			return false;
+		}
+
+		int64_t startUs = esp_timer_get_time();
+		uint8_t *record = NULL;
+		bool ok = false;
+		bool migrated = false;
+
+		readNewest(name, record);
+
+		if (!record) {
+			LOG_INFO(CONFIG, "[CONFIG] %s not found\n", name);
+		} else if (header(record)->m_version == version) {
+			if (header(record)->m_size == size) {
+				memcpy(data, record + sizeof(ConfigRecordHeader), size);
+				ok = true;
+			} else {
+				LOG_WARN(CONFIG, "[CONFIG] %s v%u has %u bytes, expected %u\n", name, version, header(record)->m_size, size);
+			}
+		} else if (header(record)->m_version < version && migrate) {
+			size_t maxSize = max((size_t)header(record)->m_size, size);
+			size_t newSize = header(record)->m_size;
+			uint8_t *payload = (uint8_t *)calloc(1, maxSize);
+
+			if (payload) {
+				memcpy(payload, record + sizeof(ConfigRecordHeader), newSize);
+				if (migrate(header(record)->m_version, payload, newSize, maxSize) && newSize == size) {
+					LOG_INFO(CONFIG, "[CONFIG] %s migrated from v%u to v%u\n", name, header(record)->m_version, version);
+					memcpy(data, payload, size);
+					ok = true;
+					migrated = true;
+				} else {
+					LOG_ERROR(CONFIG, "[CONFIG] %s migration from v%u failed\n", name, header(record)->m_version);
+				}
+				free(payload);
+			}
+		} else {
+			LOG_ERROR(CONFIG, "[CONFIG] %s has unsupported version %u\n", name, header(record)->m_version);
+		}
+		free(record);
+
+		// keep the upgraded copy, the old one is still in the other slot
+		if (migrated) {
+			saveLocked(name, version, data, size);
+		}
+		unlock();
+
+		if (ok) {
+			LOG_DEBUG(CONFIG, "[CONFIG] Loaded %s v%u (%u bytes) in %lld us\n", name, version, size, esp_timer_get_time() - startUs);
+		}
+		return ok;
+	}
+
+	bool save(const char *name, const uint16_t &version, const void *data, const size_t &size)
+	{
+		if (strlen(name) > NVS_KEY_NAME_MAX_SIZE - 2 || size > CONFIG_MAX_RECORD_SIZE || !lock()) {
+			return false;
+		}
+
+		bool ok = saveLocked(name, version, data, size);
+		unlock();
+		return ok;
+	}
+
+	bool erase(const char *name)
+	{
+		if (strlen(name) > NVS_KEY_NAME_MAX_SIZE - 2 || !lock()) {
+			return false;
+		}
+
+		char key[NVS_KEY_NAME_MAX_SIZE];
+		for (uint8_t slot = 0; slot < 2; slot++) {
+			slotKey(name, slot, key);
+			nvs_erase_key(m_handle, key);
+		}
+		bool ok = (nvs_commit(m_handle) == ESP_OK);
+		unlock();
+		return ok;
+	}
+};
+
+static ConfigStoreContext g_ctx;
+
+void configStoreInit()
+{
+	g_ctx.init();
+}
+
+bool configLoad(const char *name, const uint16_t &version, void *data, const size_t &size, ConfigMigrateFn migrate)
+{
+	char traceName[BOOT_TRACE_NAME_LEN];
+	snprintf(traceName, sizeof(traceName), "cfg:%s", name);
+
+	int8_t span = bootTraceBegin(traceName);
+	bool ok = g_ctx.load(name, version, data, size, migrate);
+	bootTraceEnd(span);
+	return ok;
+}
+
+bool configSave(const char *name, const uint16_t &version, const void *data, const size_t &size)
+{
+	return g_ctx.save(name, version, data, size);
+}
+
+bool configErase(const char *name)
+{
+	return g_ctx.erase(name);
+}
+
+bool configFsMount()
+{
+	return g_ctx.mountFs();
+}
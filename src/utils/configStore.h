@@ -0,0 +1,41 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Versioned, CRC protected configuration records in NVS.
+//
+// A record is a plain struct stored under a name of up to 14 characters in
+// two slots ("<name>0" and "<name>1"). Each slot has a header with the schema
+// version, a generation counter and a CRC32 (ROM implementation) over the
+// header and the payload. A save always writes the slot that does not hold
+// the newest valid copy, so a reset in the middle of a write leaves the
+// previous generation intact; a load takes the newest slot that checks out.
+//
+// Records are read on demand, nothing is loaded at boot. A record stored with
+// an older schema version is handed to the migration hook of the caller and
+// written back once it was upgraded. A record with the current version but a
+// different size (a layout change without a version bump) is rejected.
+//
+// SPIFFS is not mounted at boot. configFsMount() mounts it for the first
+// caller that needs files (a legacy file check, the schedule); later calls
+// return right away.
+//
+
+// upgrade the payload in place from fromVersion to the current layout;
+// data holds the old payload of size bytes and has room for maxSize bytes,
+// size must be updated to the new payload size
+typedef bool (*ConfigMigrateFn)(const uint16_t &fromVersion, uint8_t *data, size_t &size, const size_t &maxSize);
+
+void configStoreInit();
+
+// false if the record does not exist, is corrupt or could not be migrated;
+// data is left untouched then
+bool configLoad(const char *name, const uint16_t &version, void *data, const size_t &size, ConfigMigrateFn migrate = NULL);
+bool configSave(const char *name, const uint16_t &version, const void *data, const size_t &size);
+bool configErase(const char *name);
+
+// mount SPIFFS if not mounted yet, formats an unusable partition (which can
+// take seconds, the watchdog is held off meanwhile)
+bool configFsMount();
@@ -0,0 +1,181 @@
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <lwip/sockets.h>
+#include "healthMonitor.h"
+#include "config.h"
+#include "utils.h"
+#include "watchdog.h"
+#include "taskProfiler.h"
+#include "../tasks/beeperTask.h"
+
+class HealthContext {
+public:
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	// trend, guarded by m_mux
+	HealthSample m_samples[HEALTH_TREND_SIZE];
+	uint8_t m_head = 0;
+	uint8_t m_numSamples = 0;
+
+	// reconnect results since the last sample, guarded by m_mux
+	uint16_t m_reconnects = 0;
+	uint16_t m_reconnectFailures = 0;
+
+	uint8_t m_unhealthyCnt = 0;
+	const char *volatile m_rebootReason = NULL;
+
+	static bool probeSocket()
+	{
+		// all sockets share one pool, a failing allocation means it is exhausted
+		int fd = lwip_socket(AF_INET, SOCK_STREAM, 0);
+		if (fd < 0) {
+			return false;
+		}
+		lwip_close(fd);
+		return true;
+	}
+
+	HealthSample takeSample()
+	{
+		HealthSample sample;
+		sample.m_uptimeS = esp_timer_get_time() / 1000000;
+		sample.m_freeHeap = ESP.getFreeHeap();
+		sample.m_largestBlock = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+		sample.m_socketOk = probeSocket();
+
+		portENTER_CRITICAL(&m_mux);
+		sample.m_reconnects = m_reconnects;
+		sample.m_reconnectFailures = m_reconnectFailures;
+		m_reconnects = 0;
+		m_reconnectFailures = 0;
+
+		m_samples[m_head] = sample;
+		m_head = (m_head + 1) % HEALTH_TREND_SIZE;
+		if (m_numSamples < HEALTH_TREND_SIZE) {
+			m_numSamples++;
+		}
+		portEXIT_CRITICAL(&m_mux);
+
+		return sample;
+	}
+
+	// reconnect results over the last HEALTH_RECONNECT_WINDOW samples
+	void reconnectStats(uint32_t &attempts, uint32_t &failures)
+	{
+		attempts = 0;
+		failures = 0;
+
+		portENTER_CRITICAL(&m_mux);
+		for (uint8_t i = 0; i < min(m_numSamples, (uint8_t)HEALTH_RECONNECT_WINDOW); i++) {
+			const HealthSample &sample = m_samples[(m_head + HEALTH_TREND_SIZE - 1 - i) % HEALTH_TREND_SIZE];
+			attempts += sample.m_reconnects;
+			failures += sample.m_reconnectFailures;
+		}
+		portEXIT_CRITICAL(&m_mux);
+	}
+
+	// first crossed threshold, NULL if healthy
+	const char *check(const HealthSample &sample)
+	{
+		if (sample.m_freeHeap < HEALTH_MIN_FREE_HEAP) {
+			return "Health: low heap";
+		}
+
+		if (sample.m_largestBlock < HEALTH_MIN_LARGEST_BLOCK) {
+			return "Health: heap fragmented";
+		}
+
+		if (!sample.m_socketOk) {
+			return "Health: sockets exhausted";
+		}
+
+		uint32_t attempts, failures;
+		reconnectStats(attempts, failures);
+		if (failures >= HEALTH_MIN_RECONNECT_FAILURES && failures * 100 >= attempts * HEALTH_MAX_RECONNECT_FAIL_PERCENT) {
+			return "Health: reconnects failing";
+		}
+
+		return NULL;
+	}
+
+	void task()
+	{
+		uint32_t lastSampleMs = millis();
+
+		watchdogRegister();
+		profilerRegister();
+
+		while (1) {
+			if (!m_rebootReason && (millis() - lastSampleMs) >= HEALTH_INTERVAL_MS) {
+				lastSampleMs = millis();
+
+				HealthSample sample = takeSample();
+				const char *reason = check(sample);
+
+				// ignore short dips, e.g. while a large response is being sent
+				m_unhealthyCnt = reason ? m_unhealthyCnt + 1 : 0;
+
+				if (reason) {
+					LOG_WARN(HEALTH, "%s (heap %u, largest block %u, %u/%u)\n", reason, sample.m_freeHeap, sample.m_largestBlock, m_unhealthyCnt, HEALTH_UNHEALTHY_SAMPLES);
+				}
+
+				if (m_unhealthyCnt >= HEALTH_UNHEALTHY_SAMPLES) {
+					LOG_ERROR(HEALTH, "%s, rebooting once the beeper is idle\n", reason);
+					m_rebootReason = reason;
+				}
+			}
+
+			// never cut off a running alarm or bell
+			if (m_rebootReason && beeperIsIdle()) {
+				watchdogScheduleReboot(m_rebootReason);
+			}
+
+			watchdogReset();
+			delay(1000);
+		}
+	}
+};
+
+static HealthContext g_ctx;
+
+void healthInit()
+{
+	xTaskCreate(
+		[](void *parameter) {
+			g_ctx.task();
+		},
+		"healthTask",
+		3072, // Stack size (bytes)
+		NULL, // Parameter
+		0,	  // Task priority
+		NULL
+	);
+}
+
+void healthReportReconnect(const bool &success)
+{
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	g_ctx.m_reconnects++;
+	if (!success) {
+		g_ctx.m_reconnectFailures++;
+	}
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
+
+const char *healthRebootReason()
+{
+	return g_ctx.m_rebootReason;
+}
+
+uint8_t healthNumSamples()
+{
+	return g_ctx.m_numSamples;
+}
+
+HealthSample healthSample(const uint8_t &index)
+{
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	HealthSample sample = g_ctx.m_samples[(g_ctx.m_head + HEALTH_TREND_SIZE - g_ctx.m_numSamples + index) % HEALTH_TREND_SIZE];
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+	return sample;
+}
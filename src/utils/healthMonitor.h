@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Health monitor deciding when the board has to be rebooted.
+//
+// Every HEALTH_INTERVAL_MS a sample of the free heap, the largest free heap
+// block, a socket allocation probe and the WiFi reconnect results since the
+// previous sample is taken and kept in a trend ring buffer. When a threshold
+// stays crossed for HEALTH_UNHEALTHY_SAMPLES samples in a row, a reboot is
+// requested, but it is deferred until the beeper is idle so a running alarm
+// or bell is never cut off.
+//
+
+struct HealthSample {
+	uint32_t m_uptimeS;
+	uint32_t m_freeHeap;
+	uint32_t m_largestBlock;		// largest allocatable block
+	uint16_t m_reconnects;			// reconnect attempts since the previous sample
+	uint16_t m_reconnectFailures;
+	bool m_socketOk;				// a socket could be allocated
+};
+
+void healthInit();
+
+// reported by the WiFi task for every reconnect attempt
+void healthReportReconnect(const bool &success);
+
+// reason of the pending reboot, NULL if healthy
+const char *healthRebootReason();
+
+// samples oldest first
+uint8_t healthNumSamples();
+HealthSample healthSample(const uint8_t &index);
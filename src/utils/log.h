@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// The logging macros without the rest of utils.h, for code that has to
+// build without Arduino as well (see test/host). The implementation of
+// printf_internal() is in utils.cpp, the host tests bring their own.
+//
+
+#ifndef PSTR
+#define PSTR(s) (s)
+#endif
+
+#define LOG_PRINTF(fmt, ...) printf_internal(PSTR(fmt), ##__VA_ARGS__)
+void printf_internal(const char *fmt, ...);
+
+// per-module log levels
+#include "logLevel.h"
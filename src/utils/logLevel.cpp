@@ -0,0 +1,80 @@
+#include <strings.h>
+#include "logLevel.h"
+#include "config.h"
+
+static const char *g_moduleNames[LOG_MODULE_COUNT] = {
+	"main",
+	"wifi",
+	"server",
+	"ntp",
+	"ota",
+	"watchdog",
+	"config",
+	"sched",
+	"power",
+	"health",
+	"syslog",
+};
+
+static const uint8_t g_moduleMaxLevels[LOG_MODULE_COUNT] = {
+	LOG_LEVEL_MAIN,
+	LOG_LEVEL_WIFI,
+	LOG_LEVEL_SERVER,
+	LOG_LEVEL_NTP,
+	LOG_LEVEL_OTA,
+	LOG_LEVEL_WATCHDOG,
+	LOG_LEVEL_CONFIG,
+	LOG_LEVEL_SCHED,
+	LOG_LEVEL_POWER,
+	LOG_LEVEL_HEALTH,
+	LOG_LEVEL_SYSLOG,
+};
+
+volatile uint8_t g_logLevels[LOG_MODULE_COUNT] = {
+	LOG_LEVEL_MAIN,
+	LOG_LEVEL_WIFI,
+	LOG_LEVEL_SERVER,
+	LOG_LEVEL_NTP,
+	LOG_LEVEL_OTA,
+	LOG_LEVEL_WATCHDOG,
+	LOG_LEVEL_CONFIG,
+	LOG_LEVEL_SCHED,
+	LOG_LEVEL_POWER,
+	LOG_LEVEL_HEALTH,
+	LOG_LEVEL_SYSLOG,
+};
+
+const char *logModuleName(uint8_t module)
+{
+	return (module < LOG_MODULE_COUNT) ? g_moduleNames[module] : "";
+}
+
+uint8_t logModuleMaxLevel(uint8_t module)
+{
+	return (module < LOG_MODULE_COUNT) ? g_moduleMaxLevels[module] : LOG_LEVEL_NONE;
+}
+
+int logModuleFind(const char *name)
+{
+	for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+		if (!strcasecmp(name, g_moduleNames[i])) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+bool logSetLevel(uint8_t module, uint8_t level)
+{
+	if (module >= LOG_MODULE_COUNT) {
+		return false;
+	}
+
+	// levels compiled out can't be enabled at runtime
+	if (level > g_moduleMaxLevels[module]) {
+		level = g_moduleMaxLevels[module];
+	}
+
+	g_logLevels[module] = level;
+	return true;
+}
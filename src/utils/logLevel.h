@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+//
+// Per-module log levels.
+//
+// Each module has a compile-time maximum level (LOG_LEVEL_<MODULE> in config.h)
+// and a runtime level which can be changed via HTTP (/loglevel), but never
+// above the compile-time maximum. Calls above the compile-time level are
+// removed by the compiler entirely, including evaluation of their arguments.
+//
+// Usage: LOG_DEBUG(SERVER, "request from %s\n", ip.toString().c_str());
+//
+
+#define LOG_LEVEL_NONE		0
+#define LOG_LEVEL_ERROR		1
+#define LOG_LEVEL_WARN		2
+#define LOG_LEVEL_INFO		3
+#define LOG_LEVEL_DEBUG		4
+#define LOG_LEVEL_VERBOSE	5
+
+enum LogModule {
+	LOG_MODULE_MAIN = 0,
+	LOG_MODULE_WIFI,
+	LOG_MODULE_SERVER,
+	LOG_MODULE_NTP,
+	LOG_MODULE_OTA,
+	LOG_MODULE_WATCHDOG,
+	LOG_MODULE_CONFIG,
+	LOG_MODULE_SCHED,
+	LOG_MODULE_POWER,
+	LOG_MODULE_HEALTH,
+	LOG_MODULE_SYSLOG,
+	LOG_MODULE_COUNT
+};
+
+// runtime levels, indexed by LogModule
+extern volatile uint8_t g_logLevels[LOG_MODULE_COUNT];
+
+#define LOG_AT(module, level, fmt, ...)														\
+	do {																					\
+		if ((LOG_LEVEL_##module >= (level)) && (g_logLevels[LOG_MODULE_##module] >= (level))) {	\
+			printf_internal(PSTR(fmt), ##__VA_ARGS__);										\
+		}																					\
+	} while (0)
+
+#define LOG_ERROR(module, fmt, ...)		LOG_AT(module, LOG_LEVEL_ERROR, fmt, ##__VA_ARGS__)
+#define LOG_WARN(module, fmt, ...)		LOG_AT(module, LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define LOG_INFO(module, fmt, ...)		LOG_AT(module, LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define LOG_DEBUG(module, fmt, ...)		LOG_AT(module, LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_VERBOSE(module, fmt, ...)	LOG_AT(module, LOG_LEVEL_VERBOSE, fmt, ##__VA_ARGS__)
+
+const char *logModuleName(uint8_t module);
+uint8_t logModuleMaxLevel(uint8_t module);
+int logModuleFind(const char *name);
+bool logSetLevel(uint8_t module, uint8_t level);
@@ -0,0 +1,130 @@
+#include <Arduino.h>
+#include "postmortem.h"
+#include "config.h"
+
+#define POSTMORTEM_MAGIC 0x504d4f31
+
+struct PostmortemState {
+	uint32_t m_magic;
+	// number of records written, free running
+	uint32_t m_head;
+	// uptime when the reset cause was recorded
+	uint32_t m_resetUptime;
+	char m_resetCause[POSTMORTEM_RECORD_SIZE];
+	PostmortemRecord m_records[POSTMORTEM_NUM_RECORDS];
+};
+
+// lives in RTC slow memory, not cleared on software reset
+static RTC_NOINIT_ATTR PostmortemState g_rtcState;
+
+class PostmortemContext {
+public:
+	// snapshot of the previous boot, NULL if not available
+	PostmortemState *m_previous = nullptr;
+	esp_reset_reason_t m_resetReason = ESP_RST_UNKNOWN;
+	bool m_initialized = false;
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+};
+
+static PostmortemContext g_ctx;
+
+static const char *resetReasonStr(esp_reset_reason_t reason)
+{
+	switch (reason) {
+	case ESP_RST_POWERON:	return "power on";
+	case ESP_RST_EXT:		return "external pin";
+	case ESP_RST_SW:		return "software reset";
+	case ESP_RST_PANIC:		return "panic";
+	case ESP_RST_INT_WDT:	return "interrupt watchdog";
+	case ESP_RST_TASK_WDT:	return "task watchdog";
+	case ESP_RST_WDT:		return "other watchdog";
+	case ESP_RST_DEEPSLEEP:	return "deep sleep";
+	case ESP_RST_BROWNOUT:	return "brownout";
+	case ESP_RST_SDIO:		return "sdio";
+	default:				return "unknown";
+	}
+}
+
+void postmortemInit()
+{
+	g_ctx.m_resetReason = esp_reset_reason();
+
+	// RTC memory content is random after power on
+	if ((g_rtcState.m_magic == POSTMORTEM_MAGIC) && (g_ctx.m_resetReason != ESP_RST_POWERON) && (g_ctx.m_resetReason != ESP_RST_BROWNOUT)) {
+		g_ctx.m_previous = (PostmortemState *)malloc(sizeof(PostmortemState));
+		if (g_ctx.m_previous) {
+			memcpy(g_ctx.m_previous, &g_rtcState, sizeof(PostmortemState));
+			g_ctx.m_previous->m_resetCause[sizeof(g_ctx.m_previous->m_resetCause) - 1] = 0;
+		}
+	}
+
+	// start over
+	memset(&g_rtcState, 0, sizeof(g_rtcState));
+	g_rtcState.m_magic = POSTMORTEM_MAGIC;
+	g_ctx.m_initialized = true;
+}
+
+void postmortemLog(const uint64_t &ts, const char *text)
+{
+	if (!g_ctx.m_initialized) {
+		return;
+	}
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	PostmortemRecord &record = g_rtcState.m_records[g_rtcState.m_head++ % POSTMORTEM_NUM_RECORDS];
+	record.m_ts = ts;
+	strncpy(record.m_text, text, sizeof(record.m_text) - 1);
+	record.m_text[sizeof(record.m_text) - 1] = 0;
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
+
+void postmortemSetResetCause(const char *reason)
+{
+	if (!g_ctx.m_initialized) {
+		return;
+	}
+
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	strncpy(g_rtcState.m_resetCause, reason, sizeof(g_rtcState.m_resetCause) - 1);
+	g_rtcState.m_resetUptime = millis();
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+}
+
+bool postmortemAvailable()
+{
+	return g_ctx.m_previous != nullptr;
+}
+
+const char *postmortemResetReason()
+{
+	return resetReasonStr(g_ctx.m_resetReason);
+}
+
+const char *postmortemResetCause()
+{
+	return g_ctx.m_previous ? g_ctx.m_previous->m_resetCause : "";
+}
+
+uint32_t postmortemResetUptime()
+{
+	return g_ctx.m_previous ? g_ctx.m_previous->m_resetUptime : 0;
+}
+
+uint32_t postmortemNumRecords()
+{
+	if (!g_ctx.m_previous) {
+		return 0;
+	}
+	return min(g_ctx.m_previous->m_head, (uint32_t)POSTMORTEM_NUM_RECORDS);
+}
+
+const PostmortemRecord *postmortemRecord(uint32_t index)
+{
+	// index 0 is the oldest record
+	if (index >= postmortemNumRecords()) {
+		return nullptr;
+	}
+
+	uint32_t first = g_ctx.m_previous->m_head - postmortemNumRecords();
+	return &g_ctx.m_previous->m_records[(first + index) % POSTMORTEM_NUM_RECORDS];
+}
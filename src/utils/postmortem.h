@@ -0,0 +1,30 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Post-mortem log kept in RTC slow memory.
+//
+// The last POSTMORTEM_NUM_RECORDS log lines and the reason of an intentional
+// reset survive software resets (watchdog, ESP.restart(), panics), but not
+// power loss. On boot the previous contents are snapshotted so they can be
+// served at /postmortem, and the ring starts over. Nothing is written to flash.
+//
+
+struct PostmortemRecord {
+	uint64_t m_ts;
+	char m_text[POSTMORTEM_RECORD_SIZE];
+};
+
+void postmortemInit();
+void postmortemLog(const uint64_t &ts, const char *text);
+void postmortemSetResetCause(const char *reason);
+
+// previous boot information
+bool postmortemAvailable();
+const char *postmortemResetReason();
+const char *postmortemResetCause();
+uint32_t postmortemResetUptime();
+uint32_t postmortemNumRecords();
+const PostmortemRecord *postmortemRecord(uint32_t index);
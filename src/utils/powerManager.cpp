@@ -0,0 +1,306 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <esp_wifi.h>
+#include <lwip/sockets.h>
+#include <lwip/icmp.h>
+#include <lwip/inet_chksum.h>
+#include <lwip/ip.h>
+#include "powerManager.h"
+#include "configStore.h"
+#include "utils.h"
+#include "watchdog.h"
+#include "taskProfiler.h"
+#include "../tasks/beeperTask.h"
+#include "../tasks/wifiTask.h"
+
+#define POWER_RECORD "power"
+#define POWER_VERSION 1
+
+#define POWER_PROBE_ID 0x5042			// "PB"
+#define POWER_PROBE_TIMEOUT_MS 1000
+
+class PowerContext {
+public:
+	TaskHandle_t m_task = NULL;
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	volatile PowerMode m_mode = POWER_MODE;
+	volatile uint32_t m_lastActivityMs = 0;
+
+	// owned by the task
+	bool m_sleeping = false;
+	bool m_applied = false;			// m_sleeping is in effect for the current connection
+	int64_t m_sleepStartUs = 0;
+	uint16_t m_probeSeq = 0;
+	uint32_t m_lastProbeMs = 0;
+
+	// guarded by m_mux
+	int64_t m_sleepUs = 0;
+	PowerStats m_stats;
+
+	static uint16_t listenInterval()
+	{
+		return max(POWER_LATENCY_BUDGET_MS / POWER_BEACON_INTERVAL_MS, 1);
+	}
+
+	bool busy()
+	{
+		return !beeperIsIdle() || (millis() - m_lastActivityMs) < POWER_IDLE_MS;
+	}
+
+	bool shallSleep()
+	{
+		switch (m_mode) {
+		case POWER_MODE_ADAPTIVE:
+			return !busy();
+		case POWER_MODE_SAVING:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	void apply(const bool &sleep)
+	{
+		// the driver resets power save when the station restarts,
+		// so it is applied again for every connection
+		if (m_applied && sleep == m_sleeping) {
+			return;
+		}
+
+		esp_err_t err = esp_wifi_set_ps(sleep ? WIFI_PS_MAX_MODEM : WIFI_PS_NONE);
+		if (err != ESP_OK) {
+			LOG_ERROR(POWER, "[POWER] Unable to set power save (%d)\n", err);
+			return;
+		}
+
+		if (sleep != m_sleeping) {
+			LOG_INFO(POWER, "[POWER] Modem sleep %s\n", sleep ? "on" : "off");
+			accountSleep();
+			m_sleeping = sleep;
+		}
+		m_applied = true;
+	}
+
+	void accountSleep()
+	{
+		int64_t now = esp_timer_get_time();
+
+		portENTER_CRITICAL(&m_mux);
+		if (m_sleeping) {
+			m_sleepUs += now - m_sleepStartUs;
+		}
+		m_sleepStartUs = now;
+		portEXIT_CRITICAL(&m_mux);
+	}
+
+	// round trip of an ICMP echo to the gateway in ms, -1 without a reply
+	int32_t probeGateway()
+	{
+		uint32_t gateway = WiFi.gatewayIP();
+		if (!gateway) {
+			return -1;
+		}
+
+		int fd = lwip_socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+		if (fd < 0) {
+			return -1;
+		}
+
+		struct timeval timeout;
+		timeout.tv_sec = POWER_PROBE_TIMEOUT_MS / 1000;
+		timeout.tv_usec = (POWER_PROBE_TIMEOUT_MS % 1000) * 1000;
+		lwip_setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		struct icmp_echo_hdr echo;
+		memset(&echo, 0, sizeof(echo));
+		ICMPH_TYPE_SET(&echo, ICMP_ECHO);
+		ICMPH_CODE_SET(&echo, 0);
+		echo.id = htons(POWER_PROBE_ID);
+		echo.seqno = htons(++m_probeSeq);
+		echo.chksum = inet_chksum(&echo, sizeof(echo));
+
+		struct sockaddr_in to;
+		memset(&to, 0, sizeof(to));
+		to.sin_family = AF_INET;
+		to.sin_addr.s_addr = gateway;
+
+		int32_t rttMs = -1;
+		int64_t startUs = esp_timer_get_time();
+
+		if (lwip_sendto(fd, &echo, sizeof(echo), 0, (struct sockaddr *)&to, sizeof(to)) == sizeof(echo)) {
+			uint8_t buffer[64];
+
+			// skip replies to other echoes until the timeout
+			while ((esp_timer_get_time() - startUs) / 1000 < POWER_PROBE_TIMEOUT_MS) {
+				int len = lwip_recv(fd, buffer, sizeof(buffer), 0);
+				if (len < 0) {
+					break;
+				}
+
+				// raw sockets receive the IP header too
+				const struct ip_hdr *ip = (const struct ip_hdr *)buffer;
+				size_t headerLen = IPH_HL(ip) * 4;
+				if ((size_t)len < headerLen + sizeof(struct icmp_echo_hdr)) {
+					continue;
+				}
+
+				const struct icmp_echo_hdr *reply = (const struct icmp_echo_hdr *)(buffer + headerLen);
+				if (ICMPH_TYPE(reply) == ICMP_ER && reply->id == echo.id && reply->seqno == echo.seqno) {
+					rttMs = (esp_timer_get_time() - startUs) / 1000;
+					break;
+				}
+			}
+		}
+
+		lwip_close(fd);
+		return rttMs;
+	}
+
+	void probe()
+	{
+		int32_t rttMs = probeGateway();
+		bool overBudget = m_sleeping && rttMs > POWER_LATENCY_BUDGET_MS;
+
+		portENTER_CRITICAL(&m_mux);
+		PowerLatency &latency = m_sleeping ? m_stats.m_asleep : m_stats.m_awake;
+		latency.m_probes++;
+		if (rttMs < 0) {
+			latency.m_timeouts++;
+		} else {
+			latency.m_lastMs = rttMs;
+			latency.m_maxMs = max(latency.m_maxMs, (uint32_t)rttMs);
+			latency.m_totalMs += rttMs;
+		}
+		if (overBudget) {
+			m_stats.m_overBudget++;
+		}
+		portEXIT_CRITICAL(&m_mux);
+
+		if (overBudget) {
+			LOG_WARN(POWER, "[POWER] Gateway round trip %d ms exceeds the budget of %u ms\n", rttMs, POWER_LATENCY_BUDGET_MS);
+		} else {
+			LOG_DEBUG(POWER, "[POWER] Gateway round trip %d ms (%s)\n", rttMs, m_sleeping ? "asleep" : "awake");
+		}
+	}
+
+	void task()
+	{
+		PowerMode mode;
+		if (configLoad(POWER_RECORD, POWER_VERSION, &mode, sizeof(mode)) && mode < POWER_MODE_COUNT) {
+			m_mode = mode;
+		}
+		LOG_INFO(POWER, "[POWER] Mode %s, listen interval %u\n", powerModeName((PowerMode)m_mode), listenInterval());
+
+		watchdogRegister();
+		profilerRegister();
+
+		while (1) {
+			if (wifiIsConnected()) {
+				apply(shallSleep());
+
+				if ((millis() - m_lastProbeMs) >= POWER_PROBE_INTERVAL_MS) {
+					m_lastProbeMs = millis();
+					probe();
+				}
+			} else {
+				// the driver keeps the radio on while connecting anyway
+				m_applied = false;
+			}
+
+			watchdogReset();
+
+			// woken up early by activity and mode changes
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(POWER_CHECK_INTERVAL_MS));
+		}
+	}
+
+	void notify()
+	{
+		if (m_task) {
+			xTaskNotifyGive(m_task);
+		}
+	}
+
+	PowerStats stats()
+	{
+		accountSleep();
+
+		portENTER_CRITICAL(&m_mux);
+		PowerStats stats = m_stats;
+		int64_t sleepUs = m_sleepUs;
+		portEXIT_CRITICAL(&m_mux);
+
+		stats.m_mode = m_mode;
+		stats.m_sleeping = m_sleeping;
+		stats.m_listenInterval = listenInterval();
+		stats.m_budgetMs = POWER_LATENCY_BUDGET_MS;
+		stats.m_expectedLatencyMs = listenInterval() * POWER_BEACON_INTERVAL_MS;
+		stats.m_sleepPermille = sleepUs * 1000 / max(esp_timer_get_time(), 1LL);
+		return stats;
+	}
+};
+
+static PowerContext g_ctx;
+
+void powerInit()
+{
+	memset(&g_ctx.m_stats, 0, sizeof(g_ctx.m_stats));
+
+	xTaskCreate(
+		[](void *parameter) {
+			g_ctx.task();
+		},
+		"powerTask",
+		3072, // Stack size (bytes)
+		NULL, // Parameter
+		1,	  // Task priority
+		&g_ctx.m_task
+	);
+}
+
+void powerNotifyActivity()
+{
+	g_ctx.m_lastActivityMs = millis();
+
+	// wake the modem up right away, not only at the next check
+	if (g_ctx.m_sleeping && g_ctx.m_mode == POWER_MODE_ADAPTIVE) {
+		g_ctx.notify();
+	}
+}
+
+bool powerSetMode(const PowerMode &mode)
+{
+	if (mode >= POWER_MODE_COUNT) {
+		return false;
+	}
+
+	g_ctx.m_mode = mode;
+	g_ctx.notify();
+	return configSave(POWER_RECORD, POWER_VERSION, &mode, sizeof(mode));
+}
+
+PowerMode powerMode()
+{
+	return g_ctx.m_mode;
+}
+
+const char *powerModeName(const PowerMode &mode)
+{
+	switch (mode) {
+	case POWER_MODE_PERFORMANCE:	return "performance";
+	case POWER_MODE_ADAPTIVE:		return "adaptive";
+	case POWER_MODE_SAVING:			return "saving";
+	default:						return "unknown";
+	}
+}
+
+uint16_t powerListenInterval()
+{
+	return PowerContext::listenInterval();
+}
+
+PowerStats powerStats()
+{
+	return g_ctx.stats();
+}
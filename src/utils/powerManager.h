@@ -0,0 +1,60 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Adaptive WiFi modem sleep.
+//
+// While idle the modem sleeps and only wakes up for every listen interval-th
+// beacon (WIFI_PS_MAX_MODEM); frames for the station are buffered by the
+// access point meanwhile. The listen interval is derived from the latency
+// budget, i.e. POWER_LATENCY_BUDGET_MS / POWER_BEACON_INTERVAL_MS beacons.
+// In the adaptive mode sleep is turned off while the bell or alarm sounds
+// and for POWER_IDLE_MS after the last request or OTA transfer.
+//
+// The latency the sleep costs is measured by ICMP echo round trips to the
+// gateway, kept separately for the awake and the sleeping modem and compared
+// against the budget.
+//
+
+enum PowerMode {
+	POWER_MODE_PERFORMANCE,		// modem sleep always off
+	POWER_MODE_ADAPTIVE,		// modem sleep while idle
+	POWER_MODE_SAVING,			// modem sleep always on
+	POWER_MODE_COUNT
+};
+
+struct PowerLatency {
+	uint32_t m_probes;
+	uint32_t m_timeouts;
+	uint32_t m_lastMs;
+	uint32_t m_maxMs;
+	uint32_t m_totalMs;			// of the answered probes
+};
+
+struct PowerStats {
+	PowerMode m_mode;
+	bool m_sleeping;
+	uint16_t m_listenInterval;
+	uint32_t m_budgetMs;
+	uint32_t m_expectedLatencyMs;	// listen interval in ms
+	uint32_t m_sleepPermille;		// of the uptime spent with the modem asleep
+	uint32_t m_overBudget;			// sleeping probes slower than the budget
+	PowerLatency m_awake;
+	PowerLatency m_asleep;
+};
+
+void powerInit();
+
+// traffic is flowing, keep the modem awake for POWER_IDLE_MS
+void powerNotifyActivity();
+
+bool powerSetMode(const PowerMode &mode);
+PowerMode powerMode();
+const char *powerModeName(const PowerMode &mode);
+
+// beacons between the wakeups of the sleeping modem
+uint16_t powerListenInterval();
+
+PowerStats powerStats();
@@ -0,0 +1,33 @@
+#include <Arduino.h>
+#include "readiness.h"
+
+static StaticEventGroup_t g_readinessBuffer;
+static EventGroupHandle_t g_readiness = NULL;
+
+void readinessInit()
+{
+	if (!g_readiness) {
+		g_readiness = xEventGroupCreateStatic(&g_readinessBuffer);
+	}
+}
+
+void readinessSet(const EventBits_t &bits)
+{
+	xEventGroupSetBits(g_readiness, bits);
+}
+
+void readinessClear(const EventBits_t &bits)
+{
+	xEventGroupClearBits(g_readiness, bits);
+}
+
+EventBits_t readinessGet()
+{
+	return xEventGroupGetBits(g_readiness);
+}
+
+bool readinessWait(const EventBits_t &bits, const uint32_t &timeoutMs)
+{
+	TickType_t ticks = (timeoutMs == READINESS_WAIT_FOREVER) ? portMAX_DELAY : pdMS_TO_TICKS(timeoutMs);
+	return (xEventGroupWaitBits(g_readiness, bits, pdFALSE, pdTRUE, ticks) & bits) == bits;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <Arduino.h>
+
+//
+// System readiness flags in a FreeRTOS event group.
+//
+// Tasks depending on a service block on its bit instead of polling and are
+// released the moment it is set. Bits are cleared again when the service
+// goes away (e.g. NETWORK_UP on a disconnect), so a task can suspend itself
+// until it comes back.
+//
+
+#define READY_NETWORK_UP	BIT0	// connected with an IP address
+#define READY_TIME_SYNCED	BIT1	// local time synchronized by NTP, or restored from the RTC after a reset
+#define READY_CONFIG_LOADED	BIT2	// configuration loaded
+
+#define READINESS_WAIT_FOREVER UINT32_MAX
+
+// before any task is started
+void readinessInit();
+
+void readinessSet(const EventBits_t &bits);
+void readinessClear(const EventBits_t &bits);
+EventBits_t readinessGet();
+
+// wait until all of the bits are set, false on timeout
+bool readinessWait(const EventBits_t &bits, const uint32_t &timeoutMs = READINESS_WAIT_FOREVER);
@@ -0,0 +1,110 @@
+#include "schedule.h"
+
+#define MS_PER_DAY 86400000LL
+#define MS_PER_MINUTE 60000LL
+
+static int64_t floorDiv(int64_t a, int64_t b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+Schedule::Schedule()
+	: m_numRules(0)
+	, m_heapSize(0)
+{
+}
+
+bool Schedule::ruleValid(const uint32_t &rule)
+{
+	return (ruleMinute(rule) < 24 * 60) && ruleDays(rule) && ruleDurationS(rule) && !(rule >> 27);
+}
+
+int64_t Schedule::nextFireMs(const uint32_t &rule, const int64_t &afterMs)
+{
+	if (!ruleValid(rule)) {
+		return INT64_MAX;
+	}
+
+	int64_t day = floorDiv(afterMs, MS_PER_DAY);
+
+	// today's slot may already be gone, so look one day past a full week
+	for (int i = 0; i <= 7; i++, day++) {
+		// 1970-01-01 was a Thursday
+		int weekday = (int)(((day + 4) % 7 + 7) % 7);
+		int64_t fireMs = day * MS_PER_DAY + ruleMinute(rule) * MS_PER_MINUTE;
+
+		if ((ruleDays(rule) & (1 << weekday)) && fireMs > afterMs) {
+			return fireMs;
+		}
+	}
+	return INT64_MAX;
+}
+
+void Schedule::setRules(const uint32_t *rules, const uint8_t &numRules, const int64_t &nowMs)
+{
+	m_numRules = 0;
+	m_heapSize = 0;
+
+	for (uint8_t i = 0; i < numRules && m_numRules < SCHEDULE_MAX_RULES; i++) {
+		if (!ruleValid(rules[i])) {
+			continue;
+		}
+
+		Event event;
+		event.m_rule = m_numRules;
+		event.m_fireMs = nextFireMs(rules[i], nowMs);
+		m_rules[m_numRules++] = rules[i];
+		push(event);
+	}
+}
+
+bool Schedule::pop(const int64_t &nowMs, Event &event)
+{
+	if (!m_heapSize || m_heap[0].m_fireMs > nowMs) {
+		return false;
+	}
+
+	event = m_heap[0];
+
+	// reuse the top slot for the next occurrence; scheduling after now
+	// (not after the fire time) skips occurrences missed by a clock jump
+	m_heap[0].m_fireMs = nextFireMs(m_rules[event.m_rule], nowMs);
+	siftDown(0);
+	return true;
+}
+
+void Schedule::push(const Event &event)
+{
+	uint8_t pos = m_heapSize++;
+
+	while (pos > 0) {
+		uint8_t parent = (pos - 1) / 2;
+		if (m_heap[parent].m_fireMs <= event.m_fireMs) {
+			break;
+		}
+		m_heap[pos] = m_heap[parent];
+		pos = parent;
+	}
+	m_heap[pos] = event;
+}
+
+void Schedule::siftDown(uint8_t pos)
+{
+	Event event = m_heap[pos];
+
+	while (1) {
+		uint8_t child = 2 * pos + 1;
+		if (child >= m_heapSize) {
+			break;
+		}
+		if (child + 1 < m_heapSize && m_heap[child + 1].m_fireMs < m_heap[child].m_fireMs) {
+			child++;
+		}
+		if (event.m_fireMs <= m_heap[child].m_fireMs) {
+			break;
+		}
+		m_heap[pos] = m_heap[child];
+		pos = child;
+	}
+	m_heap[pos] = event;
+}
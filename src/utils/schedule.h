@@ -0,0 +1,91 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+//
+// Weekly bell/alarm timetable.
+//
+// A rule is packed into 32 bits:
+//   bits  0..10  minute of the day (0..1439)
+//   bits 11..17  weekday mask, bit 0 = Sunday
+//   bits 18..25  duration in seconds (1..255)
+//   bit  26      action, 0 = bell, 1 = alarm
+//
+// Every rule has exactly one pending event in a min-heap keyed by its next
+// fire time, so the earliest deadline is always at the top. Times are local
+// milliseconds since the epoch as returned by compensatedMillis(); the class
+// never reads a clock itself, the caller passes the current time in.
+//
+
+class Schedule {
+public:
+	struct Event {
+		int64_t m_fireMs;
+		uint8_t m_rule;		// index into the rules
+	};
+
+	static uint32_t packRule(const uint8_t &days, const uint16_t &minute, const uint8_t &durationS, const bool &alarm)
+	{
+		return (minute & 0x7ff) | ((uint32_t)(days & 0x7f) << 11) | ((uint32_t)durationS << 18) | ((uint32_t)(alarm ? 1 : 0) << 26);
+	}
+
+	static uint16_t ruleMinute(const uint32_t &rule)
+	{
+		return rule & 0x7ff;
+	}
+
+	static uint8_t ruleDays(const uint32_t &rule)
+	{
+		return (rule >> 11) & 0x7f;
+	}
+
+	static uint8_t ruleDurationS(const uint32_t &rule)
+	{
+		return (rule >> 18) & 0xff;
+	}
+
+	static bool ruleAlarm(const uint32_t &rule)
+	{
+		return (rule >> 26) & 1;
+	}
+
+	static bool ruleValid(const uint32_t &rule);
+
+	// first fire time of the rule strictly after given local time
+	static int64_t nextFireMs(const uint32_t &rule, const int64_t &afterMs);
+
+	Schedule();
+
+	// replace all rules and schedule them relative to nowMs
+	void setRules(const uint32_t *rules, const uint8_t &numRules, const int64_t &nowMs);
+
+	// earliest pending fire time, INT64_MAX if there is none
+	int64_t nextDeadlineMs() const
+	{
+		return m_heapSize ? m_heap[0].m_fireMs : INT64_MAX;
+	}
+
+	// take the earliest event if it is due and schedule its rule again
+	bool pop(const int64_t &nowMs, Event &event);
+
+	uint8_t numRules() const
+	{
+		return m_numRules;
+	}
+
+	uint32_t rule(const uint8_t &index) const
+	{
+		return m_rules[index];
+	}
+
+private:
+	void push(const Event &event);
+	void siftDown(uint8_t pos);
+
+	uint32_t m_rules[SCHEDULE_MAX_RULES];
+	uint8_t m_numRules;
+
+	Event m_heap[SCHEDULE_MAX_RULES];
+	uint8_t m_heapSize;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// Sequence lock around a plain copyable value: readers never block and never
+// write, they retry if a write overlapped their copy. The sequence number is
+// odd while the writer updates the value.
+//
+// There must be only one writer at a time, and on a single core a reader
+// must not interrupt the writer (it would spin forever); the firmware writes
+// inside a critical section for both. Nothing here depends on the platform,
+// so the lock is tested on a host (test/host/test_clock_state.cpp).
+//
+
+template <typename T>
+class SeqLock {
+public:
+	void write(const T &value)
+	{
+		m_seq++;
+		__sync_synchronize();
+		m_value = value;
+		__sync_synchronize();
+		m_seq++;
+	}
+
+	T read() const
+	{
+		uint32_t seq;
+		T value;
+
+		// retry if the value was being updated while we read it
+		do {
+			seq = m_seq;
+			__sync_synchronize();
+			value = m_value;
+			__sync_synchronize();
+		} while ((seq & 1) || (seq != m_seq));
+
+		return value;
+	}
+
+	// number of writes so far
+	uint32_t writes() const
+	{
+		return m_seq / 2;
+	}
+
+private:
+	volatile uint32_t m_seq = 0;
+	T m_value;
+};
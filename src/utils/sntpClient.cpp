@@ -0,0 +1,285 @@
+#ifdef ARDUINO
+#include <Arduino.h>
+#include <lwip/sockets.h>
+#include <lwip/dns.h>
+#include "utils.h"
+#else
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "log.h"
+
+// the lwip socket API is the BSD one
+#define lwip_socket socket
+#define lwip_bind bind
+#define lwip_close close
+#define lwip_sendto sendto
+#define lwip_recv recv
+#define lwip_setsockopt setsockopt
+
+static int64_t esp_timer_get_time()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+static uint32_t esp_random()
+{
+	return random();
+}
+#endif
+
+#include "sntpClient.h"
+#include "config.h"
+
+#define NTP_PACKET_SIZE 48
+#define NTP_PORT 123
+
+static const char *const g_servers[] = NTP_SERVERS;
+
+#define NUM_SERVERS (sizeof(g_servers) / sizeof(g_servers[0]))
+static_assert(NUM_SERVERS <= NTP_MAX_SERVERS, "NTP_SERVERS has more than NTP_MAX_SERVERS entries");
+
+#ifdef ARDUINO
+// A lookup outlives a timed out resolve(), so its state is static (there is
+// a single client); a late answer is picked up by the next query.
+struct DnsLookup {
+	volatile uint32_t m_address;	// network byte order, 0 if not found
+	SemaphoreHandle_t m_done;
+};
+
+static DnsLookup g_lookups[NTP_MAX_SERVERS];
+
+static void dnsFound(const char *name, const ip_addr_t *address, void *arg)
+{
+	DnsLookup *lookup = (DnsLookup *)arg;
+	lookup->m_address = address ? ip_2_ip4(address)->addr : 0;
+	xSemaphoreGive(lookup->m_done);
+}
+#endif
+
+static uint64_t readU64(const uint8_t *p)
+{
+	uint64_t value = 0;
+	for (uint8_t i = 0; i < 8; i++) {
+		value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+static void writeU64(uint8_t *p, uint64_t value)
+{
+	for (int8_t i = 7; i >= 0; i--) {
+		p[i] = value & 0xff;
+		value >>= 8;
+	}
+}
+
+SntpClient::SntpClient()
+	: SntpClient(g_servers, NUM_SERVERS, NTP_PORT, NTP_LOCAL_PORT)
+{
+}
+
+SntpClient::SntpClient(const char *const *names, const uint8_t &numServers, const uint16_t &serverPort, const uint16_t &localPort)
+	: m_names(names)
+	, m_numServers((numServers < NTP_MAX_SERVERS) ? numServers : NTP_MAX_SERVERS)
+	, m_serverPort(serverPort)
+	, m_localPort(localPort)
+	, m_socket(-1)
+	, m_filter(names, m_numServers)
+	, m_numRequests(0)
+{
+	memset(m_addresses, 0, sizeof(m_addresses));
+}
+
+const char *SntpClient::serverName(const int8_t &index) const
+{
+	return (index >= 0 && index < m_numServers) ? m_names[index] : "";
+}
+
+bool SntpClient::begin()
+{
+	if (m_socket >= 0) {
+		return true;
+	}
+
+	int fd = lwip_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct sockaddr_in local;
+	memset(&local, 0, sizeof(local));
+	local.sin_family = AF_INET;
+	local.sin_port = htons(m_localPort);
+	local.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (lwip_bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+		lwip_close(fd);
+		return false;
+	}
+
+	m_socket = fd;
+	return true;
+}
+
+bool SntpClient::resolve(const uint8_t &server)
+{
+#ifdef ARDUINO
+	DnsLookup &lookup = g_lookups[server];
+	if (!lookup.m_done) {
+		lookup.m_done = xSemaphoreCreateBinary();
+	}
+
+	// the answer of a lookup that timed out last time
+	if (xSemaphoreTake(lookup.m_done, 0) == pdTRUE && lookup.m_address) {
+		m_addresses[server] = lookup.m_address;
+	}
+
+	// numeric addresses and cached names are answered right away
+	ip_addr_t address;
+	err_t err = dns_gethostbyname(m_names[server], &address, dnsFound, &lookup);
+	if (err == ERR_OK) {
+		m_addresses[server] = ip_2_ip4(&address)->addr;
+		return true;
+	}
+
+	if (err == ERR_INPROGRESS && xSemaphoreTake(lookup.m_done, pdMS_TO_TICKS(NTP_DNS_TIMEOUT_MS)) == pdTRUE && lookup.m_address) {
+		m_addresses[server] = lookup.m_address;
+		return true;
+	}
+	return false;
+#else
+	struct in_addr address;
+	if (inet_pton(AF_INET, m_names[server], &address) == 1) {
+		m_addresses[server] = address.s_addr;
+		return true;
+	}
+
+	struct addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_INET;
+	struct addrinfo *info = NULL;
+	if (getaddrinfo(m_names[server], NULL, &hints, &info) || !info) {
+		return false;
+	}
+	m_addresses[server] = ((struct sockaddr_in *)info->ai_addr)->sin_addr.s_addr;
+	freeaddrinfo(info);
+	return true;
+#endif
+}
+
+void SntpClient::send()
+{
+	uint8_t packet[NTP_PACKET_SIZE];
+	m_numRequests = 0;
+
+	for (int8_t server = 0; server < m_numServers; server++) {
+		if (!resolve(server)) {
+			if (!m_addresses[server]) {
+				LOG_WARN(NTP, "[NTP] Unable to resolve %s\n", m_names[server]);
+				continue;
+			}
+			LOG_WARN(NTP, "[NTP] Unable to resolve %s, using its last address\n", m_names[server]);
+		}
+
+		struct sockaddr_in to;
+		memset(&to, 0, sizeof(to));
+		to.sin_family = AF_INET;
+		to.sin_port = htons(m_serverPort);
+		to.sin_addr.s_addr = m_addresses[server];
+
+		Request &request = m_requests[m_numRequests];
+
+		// random transmit timestamp, echoed back as the originate timestamp
+		request.m_nonce = ((uint64_t)esp_random() << 32) | esp_random();
+		request.m_server = server;
+
+		memset(packet, 0, sizeof(packet));
+		packet[0] = 0x23;	// LI = 0, version 4, mode 3 (client)
+		writeU64(&packet[40], request.m_nonce);
+
+		request.m_sentUs = esp_timer_get_time();
+		if (lwip_sendto(m_socket, packet, sizeof(packet), 0, (struct sockaddr *)&to, sizeof(to)) == sizeof(packet)) {
+			m_numRequests++;
+		}
+	}
+}
+
+void SntpClient::receive()
+{
+	uint8_t packet[NTP_PACKET_SIZE];
+	int64_t start = esp_timer_get_time();
+	uint8_t pending = m_numRequests;
+
+	while (pending) {
+		int64_t remainingUs = NTP_QUERY_TIMEOUT_MS * 1000LL - (esp_timer_get_time() - start);
+		if (remainingUs <= 0) {
+			break;
+		}
+
+		// sleep until a reply arrives or the query times out
+		struct timeval timeout;
+		timeout.tv_sec = remainingUs / 1000000;
+		timeout.tv_usec = remainingUs % 1000000;
+		lwip_setsockopt(m_socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+		int len = lwip_recv(m_socket, packet, sizeof(packet), 0);
+		int64_t receivedUs = esp_timer_get_time();
+		if (len < 0) {
+			break;
+		}
+
+		// server mode, not a kiss-o'-death packet
+		if (len < NTP_PACKET_SIZE || (packet[0] & 0x07) != 4 || packet[1] == 0) {
+			continue;
+		}
+
+		// match the reply to our request
+		uint64_t originate = readU64(&packet[24]);
+		for (uint8_t i = 0; i < m_numRequests; i++) {
+			Request &request = m_requests[i];
+			if (request.m_nonce != originate || request.m_server < 0) {
+				continue;
+			}
+
+			m_filter.add(request.m_server, request.m_sentUs, sntpToUnixUs(readU64(&packet[32])), sntpToUnixUs(readU64(&packet[40])), receivedUs);
+
+			// every request is answered only once
+			request.m_server = -1;
+			pending--;
+			break;
+		}
+	}
+}
+
+bool SntpClient::query(SntpSample &result)
+{
+	if (!begin()) {
+		LOG_ERROR(NTP, "[NTP] Unable to open UDP socket\n");
+		return false;
+	}
+
+	// drop stale replies of previous queries
+	uint8_t packet[NTP_PACKET_SIZE];
+	while (lwip_recv(m_socket, packet, sizeof(packet), MSG_DONTWAIT) >= 0) {
+	}
+
+	m_filter.reset();
+	send();
+	receive();
+
+	for (uint8_t i = 0; i < m_numServers; i++) {
+		const SntpSample &best = m_filter.best(i);
+		if (best.m_server >= 0) {
+			LOG_DEBUG(NTP, "[NTP] %s: offset %lld us, delay %lld us\n", m_names[i], (long long)best.m_offsetUs, (long long)best.m_delayUs);
+		}
+	}
+
+	return m_filter.select(result);
+}
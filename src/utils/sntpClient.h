@@ -0,0 +1,62 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+#include "sntpFilter.h"
+
+//
+// Multi-server SNTP client.
+//
+// A query sends a single request to every server in NTP_SERVERS at once
+// over a single UDP socket and collects the replies without blocking on any
+// particular server; public pools ask for no more than one packet per poll.
+// The replies go through SntpFilter: outliers rejected, the lowest delay
+// survivor returned.
+//
+// Server names are resolved before every query, each lookup waits at most
+// NTP_DNS_TIMEOUT_MS; a server that doesn't resolve in time is queried at
+// its last known address. The socket is read with a receive timeout, so the
+// task sleeps until a reply arrives and the receive time is taken right
+// when it does. Offsets are relative to the local esp_timer clock, so the
+// result can be fed into ClockDiscipline directly.
+//
+// The networking is plain BSD sockets, the same code runs against a local
+// stand-in server on a host (test/host/test_sntp_client.cpp).
+//
+
+class SntpClient {
+public:
+	// NTP_SERVERS on the NTP port
+	SntpClient();
+	SntpClient(const char *const *names, const uint8_t &numServers, const uint16_t &serverPort, const uint16_t &localPort);
+
+	bool query(SntpSample &result);
+
+	const char *serverName(const int8_t &index) const;
+
+private:
+	struct Request {
+		uint64_t m_nonce;
+		int64_t m_sentUs;
+		int8_t m_server;
+	};
+
+	bool begin();
+	bool resolve(const uint8_t &server);
+	void send();
+	void receive();
+
+	const char *const *m_names;
+	uint8_t m_numServers;
+	uint16_t m_serverPort;
+	uint16_t m_localPort;
+
+	int m_socket;
+	SntpFilter m_filter;
+
+	// last resolved addresses in network byte order, 0 if never resolved
+	uint32_t m_addresses[NTP_MAX_SERVERS];
+
+	Request m_requests[NTP_MAX_SERVERS];
+	uint8_t m_numRequests;
+};
@@ -0,0 +1,101 @@
+#include "sntpFilter.h"
+#include "log.h"
+
+// seconds between 1900 (NTP era 0) and 1970 (unix epoch)
+#define NTP_UNIX_OFFSET 2208988800LL
+#define NTP_ERA_SECONDS (1LL << 32)
+
+static int64_t absUs(const int64_t &value)
+{
+	return value < 0 ? -value : value;
+}
+
+int64_t sntpToUnixUs(const uint64_t &ts)
+{
+	int64_t seconds = ts >> 32;
+	if (!(seconds & 0x80000000LL)) {
+		seconds += NTP_ERA_SECONDS;
+	}
+
+	int64_t fraction = ((ts & 0xffffffffULL) * 1000000ULL) >> 32;
+	return (seconds - NTP_UNIX_OFFSET) * 1000000LL + fraction;
+}
+
+SntpFilter::SntpFilter(const char *const *names, const uint8_t &numServers)
+	: m_names(names)
+	, m_numServers((numServers < NTP_MAX_SERVERS) ? numServers : NTP_MAX_SERVERS)
+{
+	reset();
+}
+
+void SntpFilter::reset()
+{
+	for (uint8_t i = 0; i < NTP_MAX_SERVERS; i++) {
+		m_best[i].m_server = -1;
+	}
+}
+
+void SntpFilter::add(const int8_t &server, const int64_t &t1, const int64_t &t2, const int64_t &t3, const int64_t &t4)
+{
+	if (server < 0 || server >= m_numServers) {
+		return;
+	}
+
+	SntpSample sample;
+	sample.m_localUs = t4;
+	sample.m_offsetUs = ((t2 - t1) + (t3 - t4)) / 2;
+	sample.m_delayUs = (t4 - t1) - (t3 - t2);
+	sample.m_server = server;
+
+	// clock filter, keep the lowest delay sample of each server
+	SntpSample &serverBest = m_best[server];
+	if (sample.m_delayUs >= 0 && (serverBest.m_server < 0 || sample.m_delayUs < serverBest.m_delayUs)) {
+		serverBest = sample;
+	}
+}
+
+bool SntpFilter::select(SntpSample &result) const
+{
+	// all samples come from one short query window, drift between them is negligible
+	int64_t offsets[NTP_MAX_SERVERS];
+	uint8_t num = 0;
+
+	// sorted by insertion, there are only a few servers
+	for (uint8_t i = 0; i < m_numServers; i++) {
+		if (m_best[i].m_server < 0) {
+			continue;
+		}
+
+		uint8_t pos = num++;
+		while (pos > 0 && offsets[pos - 1] > m_best[i].m_offsetUs) {
+			offsets[pos] = offsets[pos - 1];
+			pos--;
+		}
+		offsets[pos] = m_best[i].m_offsetUs;
+	}
+
+	if (!num) {
+		return false;
+	}
+
+	int64_t median = offsets[num / 2];
+
+	bool found = false;
+	for (uint8_t i = 0; i < m_numServers; i++) {
+		if (m_best[i].m_server < 0) {
+			continue;
+		}
+
+		// reject falsetickers
+		if (absUs(m_best[i].m_offsetUs - median) > NTP_OUTLIER_MS * 1000LL) {
+			LOG_WARN(NTP, "[NTP] Rejecting %s, offset %lld ms from median\n", m_names[i], (long long)(m_best[i].m_offsetUs - median) / 1000);
+			continue;
+		}
+
+		if (!found || m_best[i].m_delayUs < result.m_delayUs) {
+			result = m_best[i];
+			found = true;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdint.h>
+#include "config.h"
+
+//
+// Sample selection of the SNTP client, without the networking so it can be
+// tested on a host.
+//
+// Every reply of a query is added as its four timestamps. Per server only
+// the reply with the lowest round trip delay is kept (clock filter, the
+// error of a sample is at most half its delay). select() then rejects the
+// servers whose offset is further than NTP_OUTLIER_MS from the median and
+// returns the lowest delay survivor.
+//
+
+struct SntpSample {
+	int64_t m_localUs;		// local time the sample was taken at
+	int64_t m_offsetUs;		// wall time minus local time
+	int64_t m_delayUs;		// round trip delay
+	int8_t m_server;		// index into NTP_SERVERS, -1 for none
+};
+
+// NTP timestamp (32.32 fixed point since 1900) to unix microseconds; the
+// seconds wrap in 2036, timestamps with the top bit clear are taken as the
+// next era (2036..2104, see RFC 4330)
+int64_t sntpToUnixUs(const uint64_t &ts);
+
+class SntpFilter {
+public:
+	// names are used for the log only
+	SntpFilter(const char *const *names, const uint8_t &numServers);
+
+	void reset();
+
+	// t1 request sent and t4 reply received in local time, t2 request
+	// received and t3 reply sent in server (unix) time
+	void add(const int8_t &server, const int64_t &t1, const int64_t &t2, const int64_t &t3, const int64_t &t4);
+
+	// the best sample of a server so far, m_server is -1 if there is none
+	const SntpSample &best(const uint8_t &server) const
+	{
+		return m_best[server];
+	}
+
+	bool select(SntpSample &result) const;
+
+private:
+	const char *const *m_names;
+	uint8_t m_numServers;
+	SntpSample m_best[NTP_MAX_SERVERS];
+};
@@ -0,0 +1,165 @@
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include "syslogClient.h"
+#include "syslogQueue.h"
+#include "config.h"
+#include "utils.h"
+#include "../tasks/wifiTask.h"
+#include "../tasks/ntpTask.h"
+
+// longest message: "<14>1 " + timestamp + host name + " buzzer - - - " + text
+#define SYSLOG_MESSAGE_MAX (SYSLOG_RECORD_MAX + 128)
+
+class SyslogContext {
+public:
+	// guarded by m_mux
+	SyslogQueue m_queue;
+	SyslogStats m_stats = {};
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	TaskHandle_t m_task = NULL;
+	WiFiUDP m_udp;
+	IPAddress m_server;
+
+	char m_record[SYSLOG_RECORD_MAX + 1];
+	char m_message[SYSLOG_MESSAGE_MAX];
+
+	uint32_t used()
+	{
+		portENTER_CRITICAL(&m_mux);
+		uint32_t used = m_queue.used();
+		portEXIT_CRITICAL(&m_mux);
+		return used;
+	}
+
+	uint32_t pendingSince()
+	{
+		portENTER_CRITICAL(&m_mux);
+		uint32_t since = m_queue.pendingSince();
+		portEXIT_CRITICAL(&m_mux);
+		return since;
+	}
+
+	bool append(const char *text)
+	{
+		bool synced = ntpTimeSynced();
+		uint64_t utcMs = synced ? compensatedUtcMillis() : 0;
+		uint32_t now = millis();
+		bool notify = false;
+
+		portENTER_CRITICAL(&m_mux);
+		if (m_queue.push(text, utcMs, synced, now)) {
+			m_stats.m_queued++;
+
+			// wake up the sender once enough is waiting
+			notify = m_queue.used() >= SYSLOG_FLUSH_BYTES;
+		} else {
+			m_stats.m_dropped++;
+		}
+		portEXIT_CRITICAL(&m_mux);
+
+		return notify;
+	}
+
+	// one message per datagram (RFC 5426), the collector needs no framing
+	void flush()
+	{
+		const char *hostName = WiFi.getHostname();
+		if (!hostName) {
+			hostName = HOST_NAME_BASE;
+		}
+
+		while (1) {
+			SyslogQueue::Header header;
+
+			portENTER_CRITICAL(&m_mux);
+			bool popped = m_queue.pop(header, m_record);
+			portEXIT_CRITICAL(&m_mux);
+
+			if (!popped) {
+				break;
+			}
+
+			size_t len = SyslogQueue::format(header, m_record, hostName, m_message, sizeof(m_message));
+			bool ok = m_udp.beginPacket(m_server, SYSLOG_PORT) && (m_udp.write((const uint8_t *)m_message, len) == len) && m_udp.endPacket();
+
+			portENTER_CRITICAL(&m_mux);
+			if (ok) {
+				m_stats.m_sent++;
+			} else {
+				m_stats.m_lost++;
+			}
+			portEXIT_CRITICAL(&m_mux);
+		}
+	}
+
+	void task()
+	{
+		// wait until the network is connected
+		wifiWaitForConnection();
+
+		if (!m_server.fromString(SYSLOG_SERVER) && !WiFi.hostByName(SYSLOG_SERVER, m_server)) {
+			LOG_ERROR(SYSLOG, "[SYSLOG] Unable to resolve %s, syslog disabled\n", SYSLOG_SERVER);
+			vTaskDelete(NULL);
+			return;
+		}
+
+		LOG_INFO(SYSLOG, "[SYSLOG] Shipping logs to %s:%d\n", m_server.toString().c_str(), SYSLOG_PORT);
+
+		while (1) {
+			// sleep until enough is queued or the flush interval elapses
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SYSLOG_FLUSH_INTERVAL_MS));
+
+			if (!used()) {
+				continue;
+			}
+
+			// keep buffering while the network is down
+			if (!wifiIsConnected()) {
+				wifiWaitForConnection();
+			}
+
+			if (used() >= SYSLOG_FLUSH_BYTES || (millis() - pendingSince()) >= SYSLOG_FLUSH_INTERVAL_MS) {
+				flush();
+			}
+		}
+	}
+};
+
+static SyslogContext g_ctx;
+
+void syslogInit()
+{
+#if SYSLOG_ENABLED
+	xTaskCreate(
+		[](void *parameter) {
+			g_ctx.task();
+		},
+		"syslogTask",
+		4096, // Stack size (bytes)
+		NULL, // Parameter
+		1,	  // Task priority
+		&g_ctx.m_task
+	);
+#endif
+}
+
+void syslogAppend(const char *text)
+{
+	if (!g_ctx.m_task) {
+		return;
+	}
+
+	if (g_ctx.append(text)) {
+		xTaskNotifyGive(g_ctx.m_task);
+	}
+}
+
+SyslogStats syslogStats()
+{
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	SyslogStats stats = g_ctx.m_stats;
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+	return stats;
+}
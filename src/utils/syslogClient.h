@@ -0,0 +1,32 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Batched UDP syslog shipping.
+//
+// Log records are queued into a RAM ring buffer (see syslogQueue.h) without
+// blocking the caller and sent by a background task to SYSLOG_SERVER. The
+// task wakes up once SYSLOG_FLUSH_BYTES are queued or
+// SYSLOG_FLUSH_INTERVAL_MS after the oldest queued record and sends all of
+// them, one RFC 5424 message per datagram as RFC 5426 requires. Records that
+// don't fit into the buffer are dropped and counted.
+//
+// Timestamps are UTC, taken when the record is queued; records queued before
+// the clock is synchronized carry the nil timestamp "-" and the collector
+// fills in the time of arrival.
+//
+// Quick test with a local listener: nc -klu 514
+//
+
+struct SyslogStats {
+	uint32_t m_queued;		// records accepted into the buffer
+	uint32_t m_dropped;		// records dropped because the buffer was full
+	uint32_t m_sent;		// records sent
+	uint32_t m_lost;		// records lost due to failed sends
+};
+
+void syslogInit();
+void syslogAppend(const char *text);
+SyslogStats syslogStats();
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "syslogQueue.h"
+
+#define SYSLOG_MASK (SYSLOG_BUFFER_SIZE - 1)
+
+static_assert((SYSLOG_BUFFER_SIZE & SYSLOG_MASK) == 0, "SYSLOG_BUFFER_SIZE must be a power of two");
+
+// facility user (1), severity informational (6)
+#define SYSLOG_PRIORITY 14
+
+void SyslogQueue::put(const void *data, const uint32_t &len)
+{
+	for (uint32_t i = 0; i < len; i++) {
+		m_buffer[m_head++ & SYSLOG_MASK] = ((const uint8_t *)data)[i];
+	}
+}
+
+void SyslogQueue::peek(const uint32_t &pos, void *data, const uint32_t &len) const
+{
+	for (uint32_t i = 0; i < len; i++) {
+		((uint8_t *)data)[i] = m_buffer[(pos + i) & SYSLOG_MASK];
+	}
+}
+
+bool SyslogQueue::push(const char *text, const uint64_t &utcMs, const bool &synced, const uint32_t &nowMs)
+{
+	Header header;
+	header.m_synced = synced;
+	header.m_utcMs = synced ? utcMs : 0;
+	header.m_queuedMs = nowMs;
+	size_t len = strlen(text);
+	header.m_len = (len < SYSLOG_RECORD_MAX) ? len : SYSLOG_RECORD_MAX;
+
+	// a message is a single line
+	if (header.m_len && text[header.m_len - 1] == '\n') {
+		header.m_len--;
+	}
+
+	if (SYSLOG_BUFFER_SIZE - used() < sizeof(header) + header.m_len) {
+		return false;
+	}
+
+	if (!used()) {
+		m_pendingSince = nowMs;
+	}
+	put(&header, sizeof(header));
+	put(text, header.m_len);
+	return true;
+}
+
+bool SyslogQueue::pop(Header &header, char *text)
+{
+	if (!used()) {
+		return false;
+	}
+
+	peek(m_tail, &header, sizeof(header));
+	peek(m_tail + sizeof(header), text, header.m_len);
+	text[header.m_len] = 0;
+	m_tail += sizeof(header) + header.m_len;
+
+	// the flush interval runs from the oldest record still queued
+	if (used()) {
+		Header next;
+		peek(m_tail, &next, sizeof(next));
+		m_pendingSince = next.m_queuedMs;
+	}
+	return true;
+}
+
+size_t SyslogQueue::format(const Header &header, const char *text, const char *hostName, char *buf, const size_t &size)
+{
+	// RFC 5424 timestamp in UTC, the nil value until the clock is synchronized
+	// room for out of range fields too, the compiler checks for it
+	char timeBuf[80] = "-";
+	if (header.m_synced) {
+		time_t s = header.m_utcMs / 1000;
+		struct tm tm;
+		gmtime_r(&s, &tm);
+		snprintf(timeBuf, sizeof(timeBuf), "%04d-%02d-%02dT%02d:%02d:%02d.%03uZ", tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+			tm.tm_hour, tm.tm_min, tm.tm_sec, (unsigned)(header.m_utcMs % 1000));
+	}
+
+	// PRI VERSION TIMESTAMP HOSTNAME APP-NAME PROCID MSGID STRUCTURED-DATA MSG
+	int len = snprintf(buf, size, "<%d>1 %s %s buzzer - - - %s", SYSLOG_PRIORITY, timeBuf, hostName, text);
+	if (len < 0) {
+		return 0;
+	}
+	return ((size_t)len < size) ? len : size - 1;
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "config.h"
+
+//
+// Record queue and message format of the syslog client, without the
+// networking so it can be tested on a host.
+//
+// Records are kept in a ring buffer of SYSLOG_BUFFER_SIZE bytes as a header
+// followed by the text. Each record becomes one RFC 5424 message:
+//
+//   <14>1 2025-01-31T12:34:56.789Z hostname buzzer - - - text
+//
+// with the UTC time the record was queued, or the nil timestamp "-" if the
+// clock wasn't synchronized. The class does no locking and reads no clock,
+// the caller passes the time in.
+//
+
+// maximum text length of a single record
+#define SYSLOG_RECORD_MAX 256
+
+class SyslogQueue {
+public:
+	struct Header {
+		uint64_t m_utcMs;
+		uint32_t m_queuedMs;	// millis() when queued, for the flush interval
+		uint16_t m_len;
+		uint8_t m_synced;		// m_utcMs is wall clock time
+	} __attribute__((packed));
+
+	// false if the record doesn't fit; a trailing new line is dropped and
+	// the text is cut at SYSLOG_RECORD_MAX
+	bool push(const char *text, const uint64_t &utcMs, const bool &synced, const uint32_t &nowMs);
+
+	// take the oldest record, text has room for SYSLOG_RECORD_MAX + 1
+	bool pop(Header &header, char *text);
+
+	// one record as a message, returns its length (cut at size - 1)
+	static size_t format(const Header &header, const char *text, const char *hostName, char *buf, const size_t &size);
+
+	// bytes queued
+	uint32_t used() const
+	{
+		return m_head - m_tail;
+	}
+
+	// millis() when the oldest queued record was queued
+	uint32_t pendingSince() const
+	{
+		return m_pendingSince;
+	}
+
+private:
+	void put(const void *data, const uint32_t &len);
+	void peek(const uint32_t &pos, void *data, const uint32_t &len) const;
+
+	// records: [Header][text], free running byte indexes
+	uint8_t m_buffer[SYSLOG_BUFFER_SIZE];
+	uint32_t m_head = 0;
+	uint32_t m_tail = 0;
+	uint32_t m_pendingSince = 0;
+};
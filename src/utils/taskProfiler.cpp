@@ -0,0 +1,204 @@
+#include <Arduino.h>
+#include "taskProfiler.h"
+#include "config.h"
+#include "utils.h"
+
+#define PROFILER_AVAILABLE (configUSE_TRACE_FACILITY == 1)
+#define PROFILER_CPU_AVAILABLE (PROFILER_AVAILABLE && configGENERATE_RUN_TIME_STATS == 1)
+
+class ProfilerContext {
+public:
+	SemaphoreHandle_t m_mutex = NULL;
+
+	// result of the last interval, guarded by m_mutex
+	ProfilerTask m_tasks[PROFILER_MAX_TASKS];
+	uint8_t m_numTasks = 0;
+	ProfilerStats m_stats = {};
+	uint32_t m_prevMs = 0;
+
+	// publish the result of an interval
+	void publish(const ProfilerTask *tasks, const uint8_t &num, const int64_t &start)
+	{
+		uint32_t now = millis();
+		ProfilerStats stats;
+		stats.m_available = true;
+		stats.m_allTasks = PROFILER_AVAILABLE;
+		stats.m_cpuAvailable = PROFILER_CPU_AVAILABLE;
+		stats.m_intervalMs = now - m_prevMs;
+		stats.m_sampleUs = esp_timer_get_time() - start;
+		m_prevMs = now;
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			memcpy(m_tasks, tasks, num * sizeof(ProfilerTask));
+			m_numTasks = num;
+			m_stats = stats;
+			xSemaphoreGive(m_mutex);
+		}
+	}
+
+#if PROFILER_AVAILABLE
+	TaskStatus_t m_status[PROFILER_MAX_TASKS];
+
+	// run time counters of the previous sample, matched by task number
+	struct Previous {
+		UBaseType_t m_number;
+		uint32_t m_runTime;
+	};
+	Previous m_prev[PROFILER_MAX_TASKS];
+	uint8_t m_numPrev = 0;
+	uint32_t m_prevTotal = 0;
+
+	uint32_t previousRunTime(const UBaseType_t &number, const uint32_t &runTime)
+	{
+		for (uint8_t i = 0; i < m_numPrev; i++) {
+			if (m_prev[i].m_number == number) {
+				return m_prev[i].m_runTime;
+			}
+		}
+
+		// new task, count it from now on
+		return runTime;
+	}
+
+	void sample()
+	{
+		int64_t start = esp_timer_get_time();
+		uint32_t total = 0;
+		UBaseType_t num = uxTaskGetSystemState(m_status, PROFILER_MAX_TASKS, &total);
+
+		if (!num) {
+			LOG_WARN(MAIN, "[PROF] More than %u tasks, increase PROFILER_MAX_TASKS\n", PROFILER_MAX_TASKS);
+		}
+
+		// counters are 32-bit, deltas survive a single wrap
+		uint32_t totalDelta = total - m_prevTotal;
+		ProfilerTask tasks[PROFILER_MAX_TASKS];
+
+		for (UBaseType_t i = 0; i < num; i++) {
+			const TaskStatus_t &status = m_status[i];
+			ProfilerTask &task = tasks[i];
+
+			strlcpy(task.m_name, status.pcTaskName, sizeof(task.m_name));
+			task.m_stackFree = status.usStackHighWaterMark;
+			task.m_priority = status.uxCurrentPriority;
+			task.m_state = status.eCurrentState;
+			task.m_cpuPermille = 0;
+
+#if PROFILER_CPU_AVAILABLE
+			uint32_t delta = status.ulRunTimeCounter - previousRunTime(status.xTaskNumber, status.ulRunTimeCounter);
+			if (m_numPrev && totalDelta) {
+				task.m_cpuPermille = (uint64_t)delta * 1000 / totalDelta;
+			}
+#endif
+		}
+
+		// remember counters for the next interval
+		for (UBaseType_t i = 0; i < num; i++) {
+			m_prev[i].m_number = m_status[i].xTaskNumber;
+			m_prev[i].m_runTime = m_status[i].ulRunTimeCounter;
+		}
+		m_numPrev = num;
+		m_prevTotal = total;
+
+		publish(tasks, num, start);
+	}
+#else
+	// tasks that called profilerRegister(), guarded by m_mutex
+	TaskHandle_t m_handles[PROFILER_MAX_TASKS];
+	uint8_t m_numHandles = 0;
+
+	void sample()
+	{
+		int64_t start = esp_timer_get_time();
+		TaskHandle_t handles[PROFILER_MAX_TASKS];
+		uint8_t num = 0;
+
+		if (xSemaphoreTake(m_mutex, portMAX_DELAY) == pdTRUE) {
+			num = m_numHandles;
+			memcpy(handles, m_handles, num * sizeof(TaskHandle_t));
+			xSemaphoreGive(m_mutex);
+		}
+
+		ProfilerTask tasks[PROFILER_MAX_TASKS];
+		for (uint8_t i = 0; i < num; i++) {
+			ProfilerTask &task = tasks[i];
+
+			strlcpy(task.m_name, pcTaskGetTaskName(handles[i]), sizeof(task.m_name));
+			task.m_stackFree = uxTaskGetStackHighWaterMark(handles[i]);
+			task.m_priority = uxTaskPriorityGet(handles[i]);
+			task.m_state = eTaskGetState(handles[i]);
+			task.m_cpuPermille = 0;
+		}
+
+		publish(tasks, num, start);
+	}
+#endif
+
+	void task()
+	{
+		m_prevMs = millis();
+		while (1) {
+			sample();
+			delay(PROFILER_INTERVAL_MS);
+		}
+	}
+};
+
+static ProfilerContext g_ctx;
+
+void profilerInit()
+{
+	g_ctx.m_mutex = xSemaphoreCreateMutex();
+
+#if !PROFILER_AVAILABLE
+	LOG_WARN(MAIN, "[PROF] No trace facility, stack usage of registered tasks only\n");
+#endif
+
+#if PROFILER_ENABLED
+	xTaskCreate(
+		[](void *parameter) {
+			g_ctx.task();
+		},
+		"profilerTask",
+		4096, // Stack size (bytes)
+		NULL, // Parameter
+		0,	  // Task priority
+		NULL
+	);
+#endif
+}
+
+void profilerRegister()
+{
+#if !PROFILER_AVAILABLE
+	if (xSemaphoreTake(g_ctx.m_mutex, portMAX_DELAY) == pdTRUE) {
+		if (g_ctx.m_numHandles < PROFILER_MAX_TASKS) {
+			g_ctx.m_handles[g_ctx.m_numHandles++] = xTaskGetCurrentTaskHandle();
+		}
+		xSemaphoreGive(g_ctx.m_mutex);
+	}
+#endif
+}
+
+ProfilerStats profilerStats()
+{
+	ProfilerStats stats = {};
+
+	if (xSemaphoreTake(g_ctx.m_mutex, portMAX_DELAY) == pdTRUE) {
+		stats = g_ctx.m_stats;
+		xSemaphoreGive(g_ctx.m_mutex);
+	}
+	return stats;
+}
+
+uint8_t profilerGetTasks(ProfilerTask *tasks, const uint8_t &maxTasks)
+{
+	uint8_t num = 0;
+
+	if (xSemaphoreTake(g_ctx.m_mutex, portMAX_DELAY) == pdTRUE) {
+		num = min(g_ctx.m_numTasks, maxTasks);
+		memcpy(tasks, g_ctx.m_tasks, num * sizeof(ProfilerTask));
+		xSemaphoreGive(g_ctx.m_mutex);
+	}
+	return num;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Per-task CPU usage and stack high-water marks.
+//
+// A low priority task samples uxTaskGetSystemState() every
+// PROFILER_INTERVAL_MS and keeps the result of the last interval. CPU usage
+// is the share of a single core, so on a dual core chip the sum over all
+// tasks (idle tasks included) is 200%. Taking a sample costs a few tens of
+// microseconds, far below 0.1% of the interval; the cost of the last sample
+// is reported for reference.
+//
+// Needs configUSE_TRACE_FACILITY, CPU usage additionally needs
+// configGENERATE_RUN_TIME_STATS in the FreeRTOS configuration; both are set
+// in sdkconfig.m5stack-atom. The run time counter reads the esp_timer on
+// every context switch, which has not been measured on the device yet.
+// FreeRTOS comes precompiled with the PlatformIO Arduino framework and
+// can't be reconfigured by build flags; without the trace facility only
+// the stack high-water marks of tasks that called profilerRegister() are
+// reported.
+//
+
+struct ProfilerTask {
+	char m_name[configMAX_TASK_NAME_LEN];
+	uint32_t m_stackFree;		// stack high-water mark (bytes never used)
+	uint16_t m_cpuPermille;		// of a single core over the last interval
+	uint8_t m_priority;
+	uint8_t m_state;			// eTaskState
+};
+
+struct ProfilerStats {
+	bool m_available;			// sampled at least once
+	bool m_allTasks;			// trace facility present, otherwise registered tasks only
+	bool m_cpuAvailable;		// run time stats present
+	uint32_t m_intervalMs;		// length of the last interval
+	uint32_t m_sampleUs;		// time taken by the last sample
+};
+
+void profilerInit();
+
+// the calling task is reported without the trace facility too
+void profilerRegister();
+ProfilerStats profilerStats();
+uint8_t profilerGetTasks(ProfilerTask *tasks, const uint8_t &maxTasks);
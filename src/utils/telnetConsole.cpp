@@ -0,0 +1,293 @@
+#include <Arduino.h>
+#include <AsyncTCP.h>
+#include "telnetConsole.h"
+#include "config.h"
+#include "utils.h"
+#include "../tasks/wifiTask.h"
+
+#define TELNET_MASK (TELNET_CLIENT_BUFFER_SIZE - 1)
+
+static_assert((TELNET_CLIENT_BUFFER_SIZE & TELNET_MASK) == 0, "TELNET_CLIENT_BUFFER_SIZE must be a power of two");
+
+class TelnetClientSlot {
+public:
+	AsyncClient *m_client = nullptr;
+
+	// output ring, free running byte indexes
+	uint8_t m_buffer[TELNET_CLIENT_BUFFER_SIZE];
+	uint32_t m_head = 0;
+	uint32_t m_tail = 0;
+
+	// bytes skipped since the last marker, and since when
+	uint32_t m_skipped = 0;
+	uint32_t m_stalledSince = 0;
+
+	uint32_t used() const
+	{
+		return m_head - m_tail;
+	}
+
+	uint32_t space() const
+	{
+		return TELNET_CLIENT_BUFFER_SIZE - used();
+	}
+
+	void put(uint8_t c)
+	{
+		m_buffer[m_head++ & TELNET_MASK] = c;
+	}
+
+	void reset(AsyncClient *client)
+	{
+		m_client = client;
+		m_head = m_tail = 0;
+		m_skipped = 0;
+		m_stalledSince = 0;
+	}
+};
+
+class TelnetConsoleContext {
+public:
+	TelnetClientSlot m_slots[TELNET_MAX_CLIENTS];
+	const char *m_welcomeMsg = "";
+
+	AsyncServer m_server;
+	TaskHandle_t m_task = NULL;
+
+	// protects the ring buffers, held only while copying bytes
+	portMUX_TYPE m_mux = portMUX_INITIALIZER_UNLOCKED;
+
+	// protects client pointers while the sending task uses them, recursive
+	// as closing a client invokes the disconnect callback synchronously
+	SemaphoreHandle_t m_clientMutex = NULL;
+
+	TelnetConsoleContext()
+		: m_server(TELNET_PORT)
+	{
+	}
+
+	void wakeup()
+	{
+		if (m_task) {
+			xTaskNotifyGive(m_task);
+		}
+	}
+
+	// copy data into a slot, converting "\n" to "\r\n", must be called with m_mux held
+	void copy(TelnetClientSlot &slot, const char *data, size_t len)
+	{
+		size_t needed = len;
+		for (size_t i = 0; i < len; i++) {
+			if (data[i] == '\n') {
+				needed++;
+			}
+		}
+
+		if (needed > slot.space()) {
+			// slow client, skip the data rather than blocking the writer
+			slot.m_skipped += len;
+			if (!slot.m_stalledSince) {
+				slot.m_stalledSince = millis() | 1;
+			}
+			return;
+		}
+
+		for (size_t i = 0; i < len; i++) {
+			if (data[i] == '\n') {
+				slot.put('\r');
+			}
+			slot.put(data[i]);
+		}
+	}
+
+	void write(const char *data, size_t len)
+	{
+		bool any = false;
+
+		portENTER_CRITICAL(&m_mux);
+		for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++) {
+			if (m_slots[i].m_client) {
+				copy(m_slots[i], data, len);
+				any = true;
+			}
+		}
+		portEXIT_CRITICAL(&m_mux);
+
+		if (any) {
+			wakeup();
+		}
+	}
+
+	void onConnect(AsyncClient *client)
+	{
+		xSemaphoreTakeRecursive(m_clientMutex, portMAX_DELAY);
+
+		int index = -1;
+		for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++) {
+			if (!m_slots[i].m_client) {
+				index = i;
+				break;
+			}
+		}
+
+		if (index < 0) {
+			xSemaphoreGiveRecursive(m_clientMutex);
+			client->write("Too many telnet connections.\r\n");
+			client->close(true);
+			delete client;
+			return;
+		}
+
+		TelnetClientSlot &slot = m_slots[index];
+
+		client->onDisconnect([](void *arg, AsyncClient *client) {
+			((TelnetConsoleContext *)arg)->onDisconnect(client);
+		}, this);
+
+		client->onAck([](void *arg, AsyncClient *client, size_t len, uint32_t time) {
+			// more space in the TCP window, continue sending
+			((TelnetConsoleContext *)arg)->wakeup();
+		}, this);
+
+		client->onTimeout([](void *arg, AsyncClient *client, uint32_t time) {
+			client->close(true);
+		}, this);
+
+		portENTER_CRITICAL(&m_mux);
+		slot.reset(client);
+		copy(slot, m_welcomeMsg, strlen(m_welcomeMsg));
+		portEXIT_CRITICAL(&m_mux);
+
+		xSemaphoreGiveRecursive(m_clientMutex);
+
+		LOG_INFO(MAIN, "Telnet connection established from %s.\n", client->remoteIP().toString().c_str());
+		wakeup();
+	}
+
+	void onDisconnect(AsyncClient *client)
+	{
+		xSemaphoreTakeRecursive(m_clientMutex, portMAX_DELAY);
+		for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++) {
+			if (m_slots[i].m_client == client) {
+				portENTER_CRITICAL(&m_mux);
+				m_slots[i].reset(nullptr);
+				portEXIT_CRITICAL(&m_mux);
+			}
+		}
+		xSemaphoreGiveRecursive(m_clientMutex);
+
+		delete client;
+		LOG_INFO(MAIN, "Telnet connection closed.\n");
+	}
+
+	// send as much buffered data of a slot as the TCP window allows
+	void drain(TelnetClientSlot &slot)
+	{
+		AsyncClient *client = slot.m_client;
+		char chunk[512];
+
+		while (client->connected() && client->canSend()) {
+			size_t len = 0;
+			size_t space = min(client->space(), sizeof(chunk));
+			uint32_t skipped = 0;
+
+			portENTER_CRITICAL(&m_mux);
+			while (len < space && slot.used()) {
+				chunk[len++] = slot.m_buffer[slot.m_tail++ & TELNET_MASK];
+			}
+
+			if (!slot.used() && slot.m_skipped) {
+				skipped = slot.m_skipped;
+				slot.m_skipped = 0;
+				slot.m_stalledSince = 0;
+			}
+			portEXIT_CRITICAL(&m_mux);
+
+			// the client caught up, tell it how much it has missed
+			if (skipped) {
+				char marker[48];
+				int markerLen = snprintf(marker, sizeof(marker), "\n[%u bytes skipped]\n", skipped);
+
+				portENTER_CRITICAL(&m_mux);
+				copy(slot, marker, markerLen);
+				portEXIT_CRITICAL(&m_mux);
+			}
+
+			if (!len) {
+				break;
+			}
+
+			client->add(chunk, len);
+			client->send();
+		}
+
+		// drop clients which can't keep up for too long
+		if (slot.m_stalledSince && (millis() - slot.m_stalledSince) > TELNET_STALLED_TIMEOUT_MS) {
+			LOG_WARN(MAIN, "Telnet client %s too slow, disconnecting\n", client->remoteIP().toString().c_str());
+			client->close(true);
+		}
+	}
+
+	void task()
+	{
+		// wait until the network is connected
+		wifiWaitForConnection();
+
+		m_server.onClient([](void *arg, AsyncClient *client) {
+			((TelnetConsoleContext *)arg)->onConnect(client);
+		}, this);
+		m_server.setNoDelay(true);
+		m_server.begin();
+
+		while (1) {
+			// sleep until data is written or acknowledged
+			ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(TELNET_STALLED_TIMEOUT_MS));
+
+			xSemaphoreTakeRecursive(m_clientMutex, portMAX_DELAY);
+			for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++) {
+				if (m_slots[i].m_client) {
+					drain(m_slots[i]);
+				}
+			}
+			xSemaphoreGiveRecursive(m_clientMutex);
+		}
+	}
+};
+
+static TelnetConsoleContext g_ctx;
+
+void telnetConsoleInit(const char *welcomeMsg)
+{
+	g_ctx.m_welcomeMsg = welcomeMsg;
+	g_ctx.m_clientMutex = xSemaphoreCreateRecursiveMutex();
+
+	// create task that will wait until Wifi is initialized and then handle all Telnet traffic
+	xTaskCreate(
+		[](void *parameter) {
+			g_ctx.task();
+		},
+		"telnetTask",
+		4096, // Stack size (bytes)
+		NULL, // Parameter
+		1,	  // Task priority
+		&g_ctx.m_task
+	);
+}
+
+void telnetConsoleWrite(const char *data, size_t len)
+{
+	g_ctx.write(data, len);
+}
+
+uint32_t telnetConsoleNumClients()
+{
+	uint32_t num = 0;
+	portENTER_CRITICAL(&g_ctx.m_mux);
+	for (uint8_t i = 0; i < TELNET_MAX_CLIENTS; i++) {
+		if (g_ctx.m_slots[i].m_client) {
+			num++;
+		}
+	}
+	portEXIT_CRITICAL(&g_ctx.m_mux);
+	return num;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <Arduino.h>
+#include "config.h"
+
+//
+// Event driven, multi-client telnet log console.
+//
+// Every client has its own bounded output buffer. Writers only copy into
+// those buffers and never wait for the network: when a client's buffer is
+// full the data is skipped for that client (and a marker with the number of
+// skipped bytes is sent once it catches up). A client that stays stalled for
+// TELNET_STALLED_TIMEOUT_MS is disconnected.
+//
+// The sending task sleeps until data is written or a client acknowledges
+// sent data, there is no periodic polling.
+//
+
+void telnetConsoleInit(const char *welcomeMsg);
+void telnetConsoleWrite(const char *data, size_t len);
+uint32_t telnetConsoleNumClients();
@@ -0,0 +1,272 @@
+#include <string.h>
+#include <ctype.h>
+#include "timezone.h"
+
+#define SECONDS_PER_DAY 86400LL
+
+//
+// calendar helpers (proleptic Gregorian calendar)
+//
+
+static bool isLeap(int year)
+{
+	return ((year % 4) == 0 && (year % 100) != 0) || (year % 400) == 0;
+}
+
+// days since 1970-01-01
+static int64_t daysFromCivil(int year, int month, int day)
+{
+	year -= month <= 2;
+	const int64_t era = (year >= 0 ? year : year - 399) / 400;
+	const int64_t yoe = year - era * 400;
+	const int64_t doy = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+	const int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+	return era * 146097 + doe - 719468;
+}
+
+static int yearFromDays(int64_t days)
+{
+	days += 719468;
+	const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+	const int64_t doe = days - era * 146097;
+	const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+	const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+	const int64_t mp = (5 * doy + 2) / 153;
+	const int64_t month = mp + (mp < 10 ? 3 : -9);
+	return (int)(yoe + era * 400 + (month <= 2));
+}
+
+// 0 = Sunday
+static int weekday(int64_t days)
+{
+	int wd = (int)((days + 4) % 7);
+	return wd < 0 ? wd + 7 : wd;
+}
+
+static int64_t floorDiv(int64_t a, int64_t b)
+{
+	return (a >= 0) ? a / b : -((-a + b - 1) / b);
+}
+
+Timezone::Timezone()
+	: m_stdOffsetS(0)
+	, m_dstOffsetS(0)
+	, m_hasDst(false)
+{
+	strcpy(m_stdName, "UTC");
+	m_dstName[0] = 0;
+}
+
+const char *Timezone::parseName(const char *p, char *name, int size)
+{
+	int len = 0;
+
+	if (*p == '<') {
+		p++;
+		while (*p && *p != '>') {
+			if (len < size - 1) {
+				name[len++] = *p;
+			}
+			p++;
+		}
+		if (*p != '>') {
+			return nullptr;
+		}
+		p++;
+	} else {
+		while (isalpha((unsigned char)*p)) {
+			if (len < size - 1) {
+				name[len++] = *p;
+			}
+			p++;
+		}
+	}
+
+	name[len] = 0;
+	return (len >= 3) ? p : nullptr;
+}
+
+const char *Timezone::parseTime(const char *p, int32_t &seconds)
+{
+	int sign = 1;
+	if (*p == '+' || *p == '-') {
+		sign = (*p == '-') ? -1 : 1;
+		p++;
+	}
+
+	if (!isdigit((unsigned char)*p)) {
+		return nullptr;
+	}
+
+	int32_t parts[3] = { 0, 0, 0 };
+	for (int i = 0; i < 3; i++) {
+		while (isdigit((unsigned char)*p)) {
+			parts[i] = parts[i] * 10 + (*p++ - '0');
+		}
+		if (i < 2 && *p == ':' && isdigit((unsigned char)p[1])) {
+			p++;
+		} else {
+			break;
+		}
+	}
+
+	seconds = sign * (parts[0] * 3600 + parts[1] * 60 + parts[2]);
+	return p;
+}
+
+static const char *parseNumber(const char *p, int16_t &value)
+{
+	if (!isdigit((unsigned char)*p)) {
+		return nullptr;
+	}
+	value = 0;
+	while (isdigit((unsigned char)*p)) {
+		value = value * 10 + (*p++ - '0');
+	}
+	return p;
+}
+
+const char *Timezone::parseRule(const char *p, Rule &rule)
+{
+	if (*p == 'M') {
+		rule.m_type = 'M';
+		if (!(p = parseNumber(p + 1, rule.m_month)) || *p++ != '.' ||
+			!(p = parseNumber(p, rule.m_week)) || *p++ != '.' ||
+			!(p = parseNumber(p, rule.m_day))) {
+			return nullptr;
+		}
+		if (rule.m_month < 1 || rule.m_month > 12 || rule.m_week < 1 || rule.m_week > 5 || rule.m_day > 6) {
+			return nullptr;
+		}
+	} else if (*p == 'J') {
+		rule.m_type = 'J';
+		if (!(p = parseNumber(p + 1, rule.m_day)) || rule.m_day < 1 || rule.m_day > 365) {
+			return nullptr;
+		}
+	} else {
+		rule.m_type = 'D';
+		if (!(p = parseNumber(p, rule.m_day)) || rule.m_day > 365) {
+			return nullptr;
+		}
+	}
+
+	rule.m_timeS = 7200;
+	if (*p == '/') {
+		p = parseTime(p + 1, rule.m_timeS);
+	}
+	return p;
+}
+
+bool Timezone::parse(const char *tz)
+{
+	const char *p = tz;
+	int32_t offset;
+
+	m_hasDst = false;
+
+	if (!(p = parseName(p, m_stdName, sizeof(m_stdName))) || !(p = parseTime(p, offset))) {
+		return false;
+	}
+
+	// POSIX offsets are positive west of Greenwich
+	m_stdOffsetS = -offset;
+	m_dstOffsetS = m_stdOffsetS;
+	m_dstName[0] = 0;
+
+	if (!*p) {
+		return true;
+	}
+
+	if (!(p = parseName(p, m_dstName, sizeof(m_dstName)))) {
+		return false;
+	}
+
+	m_hasDst = true;
+	m_dstOffsetS = m_stdOffsetS + 3600;
+
+	if (*p && *p != ',') {
+		if (!(p = parseTime(p, offset))) {
+			return false;
+		}
+		m_dstOffsetS = -offset;
+	}
+
+	if (!*p) {
+		// no rules given, use the POSIX default (US rules)
+		p = ",M3.2.0,M11.1.0";
+	}
+
+	if (*p++ != ',' || !(p = parseRule(p, m_start)) || *p++ != ',' || !(p = parseRule(p, m_end))) {
+		m_hasDst = false;
+		return false;
+	}
+
+	return *p == 0;
+}
+
+int64_t Timezone::transitionS(const Rule &rule, int year, int32_t offsetS)
+{
+	int64_t days = daysFromCivil(year, 1, 1);
+
+	if (rule.m_type == 'J') {
+		// February 29 is never counted
+		days += rule.m_day - 1 + ((isLeap(year) && rule.m_day >= 60) ? 1 : 0);
+	} else if (rule.m_type == 'D') {
+		days += rule.m_day;
+	} else {
+		int64_t first = daysFromCivil(year, rule.m_month, 1);
+		int64_t next = (rule.m_month == 12) ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, rule.m_month + 1, 1);
+
+		// first given weekday of the month, then the requested week (5 = last)
+		days = first + (rule.m_day - weekday(first) + 7) % 7 + 7 * (rule.m_week - 1);
+		while (days >= next) {
+			days -= 7;
+		}
+	}
+
+	return days * SECONDS_PER_DAY + rule.m_timeS - offsetS;
+}
+
+Timezone::Window Timezone::window(const int64_t &utcMs) const
+{
+	Window window;
+	window.m_offsetS = m_stdOffsetS;
+	window.m_nextOffsetS = m_stdOffsetS;
+
+	if (!m_hasDst) {
+		return window;
+	}
+
+	int64_t utcS = floorDiv(utcMs, 1000);
+	int year = yearFromDays(floorDiv(utcS + m_stdOffsetS, SECONDS_PER_DAY));
+
+	// transitions of the surrounding years, in time order
+	// (the DST period may span the new year on the southern hemisphere)
+	int64_t times[6];
+	int32_t offsets[6];
+	int num = 0;
+
+	for (int y = year - 1; y <= year + 1; y++) {
+		int64_t start = transitionS(m_start, y, m_stdOffsetS);
+		int64_t end = transitionS(m_end, y, m_dstOffsetS);
+
+		if (start < end) {
+			times[num] = start; offsets[num++] = m_dstOffsetS;
+			times[num] = end; offsets[num++] = m_stdOffsetS;
+		} else {
+			times[num] = end; offsets[num++] = m_stdOffsetS;
+			times[num] = start; offsets[num++] = m_dstOffsetS;
+		}
+	}
+
+	for (int i = 0; i < num; i++) {
+		if (utcS < times[i]) {
+			window.m_nextTransitionMs = times[i] * 1000LL;
+			window.m_nextOffsetS = offsets[i];
+			window.m_offsetS = (i > 0) ? offsets[i - 1] : (offsets[i] == m_dstOffsetS ? m_stdOffsetS : m_dstOffsetS);
+			break;
+		}
+	}
+
+	return window;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stdint.h>
+
+//
+// POSIX TZ string based timezone engine, e.g. "CET-1CEST,M3.5.0,M10.5.0/3".
+//
+// The rules are evaluated only when a Window is computed. A Window holds the
+// current UTC offset and the next transition, so converting UTC to local time
+// is a single compare plus add until the window is refreshed (which has to
+// happen before the transition after the next one, i.e. within months).
+//
+// Supported: quoted (<+03>) and alphabetic names, [+-]hh[:mm[:ss]] offsets,
+// optional DST offset, Mm.w.d, Jn and n rules with optional /time.
+//
+
+class Timezone {
+public:
+	struct Window {
+		int64_t m_nextTransitionMs = INT64_MAX;
+		int32_t m_offsetS = 0;
+		int32_t m_nextOffsetS = 0;
+	};
+
+	Timezone();
+
+	bool parse(const char *tz);
+
+	// offsets and the next transition valid at given UTC time
+	Window window(const int64_t &utcMs) const;
+
+	static int64_t toLocalMs(const Window &window, const int64_t &utcMs)
+	{
+		int32_t offsetS = (utcMs < window.m_nextTransitionMs) ? window.m_offsetS : window.m_nextOffsetS;
+		return utcMs + offsetS * 1000LL;
+	}
+
+	const char *name(bool dst) const
+	{
+		return dst ? m_dstName : m_stdName;
+	}
+
+private:
+	struct Rule {
+		char m_type = 'M';		// 'M' month.week.day, 'J' julian 1..365 without Feb 29, 'D' zero based day of year
+		int16_t m_month = 0;
+		int16_t m_week = 0;
+		int16_t m_day = 0;
+		int32_t m_timeS = 7200;	// local time of the transition
+	};
+
+	static const char *parseName(const char *p, char *name, int size);
+	static const char *parseTime(const char *p, int32_t &seconds);
+	static const char *parseRule(const char *p, Rule &rule);
+
+	// UTC time (seconds) of the rule in given year, offsetS is the offset in effect before it
+	static int64_t transitionS(const Rule &rule, int year, int32_t offsetS);
+
+	char m_stdName[16];
+	char m_dstName[16];
+
+	// seconds east of UTC
+	int32_t m_stdOffsetS;
+	int32_t m_dstOffsetS;
+
+	bool m_hasDst;
+	Rule m_start;
+	Rule m_end;
+};
@@ -4,6 +4,8 @@
 #include "utils.h"
 #include "config.h"
 #include "SerialAndTelnetInit.h"
+#include "postmortem.h"
+#include "syslogClient.h"
 #include "../tasks/ntpTask.h"
 
 #define LOG_SIZE_MAX 512
@@ -21,10 +23,18 @@ void printf_internal(const char *fmt, ...)
 	vsnprintf(buf, LOG_SIZE_MAX, fmt, ap);
 	va_end(ap);
 
+	uint64_t now = compensatedMillis();
+
+	// keep the last lines for post-mortem analysis
+	postmortemLog(now, buf);
+
+	// ship to syslog collector (if enabled)
+	syslogAppend(buf);
+
 	if (SerialAndTelnetInit::lock()) {
-		SERIAL.print(msToTimeStr(compensatedMillis()));
-		SERIAL.print(": ");
-		SERIAL.print(buf);
+		SerialAndTelnetInit::print(msToTimeStr(now));
+		SerialAndTelnetInit::print(": ");
+		SerialAndTelnetInit::print(buf);
 		SerialAndTelnetInit::unlock();
 	}
 }
@@ -32,7 +42,11 @@ void printf_internal(const char *fmt, ...)
 char *msToTimeStr(uint64_t ms)
 {
 	static char timeBuf[32];
+	return msToTimeStr(ms, timeBuf, sizeof(timeBuf));
+}
 
+char *msToTimeStr(uint64_t ms, char *timeBuf, size_t size)
+{
 	unsigned long s = ms / 1000;
 	unsigned long h = ((s % 86400L) / 3600);
 	unsigned long m = ((s % 3600) / 60);
@@ -40,7 +54,7 @@ char *msToTimeStr(uint64_t ms)
 	s = (s % 60);
 	ms = ms % 1000;
 
-	snprintf(timeBuf, sizeof(timeBuf) - 1, "%02lu:%02lu:%02lu.%03lu", h, m, s, (unsigned long)ms);
+	snprintf(timeBuf, size - 1, "%02lu:%02lu:%02lu.%03lu", h, m, s, (unsigned long)ms);
 	return timeBuf;
 }
 
@@ -3,22 +3,18 @@
 #include <Arduino.h>
 
 #include "config/config.h"
-#include "TelnetSpy.h"
-
-// create instance of telnet/serial wrapper
-extern TelnetSpy SerialAndTelnet;
 
 #undef SERIAL
-#define SERIAL  SerialAndTelnet
+#define SERIAL  Serial
 
-//
-// printf macro
-//
+// printf macro and per-module log levels
+#include "log.h"
 
-#define LOG_PRINTF(fmt, ...) printf_internal(PSTR(fmt), ##__VA_ARGS__)
-void printf_internal(const char *fmt, ...);
+// deferred-format logging for hot paths
+#include "binlog.h"
 
 void logInit();
 char *msToTimeStr(uint64_t ms);
+char *msToTimeStr(uint64_t ms, char *timeBuf, size_t size);
 
 void longDelay(uint32_t ms);
@@ -1,49 +1,148 @@
 #include <Arduino.h>
+#include <esp_task_wdt.h>
 #include "watchdog.h"
 #include "config.h"
 #include "utils.h"
 #include "ledTask.h"
+#include "postmortem.h"
+
+struct WatchdogSlot {
+	TaskHandle_t m_task;
+	const char *m_name;
+	uint32_t m_timeoutMs;
+	volatile uint32_t m_deadlineMs;		// aligned 32-bit, so stores are atomic
+};
+
+// slots are appended under the mutex and never removed, so they can be
+// searched without locking up to numSlots
+static WatchdogSlot slots[WATCHDOG_MAX_TASKS];
+static volatile uint8_t numSlots = 0;
 
 static SemaphoreHandle_t mutex = NULL;
-static uint32_t periodicResetTs = 0;
-static uint32_t watchdogResetTs = 0;
-static bool watchdogReboot = false;
-static bool watchdogEnabled = true;
+static const char *rebootCause = NULL;
+static volatile bool watchdogReboot = false;
+static volatile bool watchdogEnabled = true;
 
-void watchdogTask(void *pvParameters __attribute__((unused)))
+static WatchdogSlot *findSlot(TaskHandle_t task)
 {
-	while (1) {
+	for (uint8_t i = 0; i < numSlots; i++) {
+		if (slots[i].m_task == task) {
+			return &slots[i];
+		}
+	}
+	return NULL;
+}
+
+// bit i set if slot i missed its deadline
+static uint32_t overdueSlots()
+{
+	uint32_t now = millis();
+	uint32_t overdue = 0;
 
-		uint32_t diffMs = 0;
-		if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
-			diffMs = millis() - watchdogResetTs;
-			xSemaphoreGive(mutex);
+	for (uint8_t i = 0; i < numSlots; i++) {
+		if ((int32_t)(now - slots[i].m_deadlineMs) > 0) {
+			overdue |= 1UL << i;
 		}
+	}
+	return overdue;
+}
 
-		if (watchdogReboot) {
-			LOG_PRINTF("Reboot scheduled, resetting the board!\n");
-			setLedColor(COLOR_RED, true);
-			delay(2000);
-			ESP.restart();
+static void restartSlots()
+{
+	uint32_t now = millis();
+	for (uint8_t i = 0; i < numSlots; i++) {
+		slots[i].m_deadlineMs = now + slots[i].m_timeoutMs;
+	}
+}
+
+#if WATCHDOG_HW_TASK_WDT == true
+// The core starts the task WDT already (CONFIG_ESP_TASK_WDT: 5 s, no panic,
+// idle tasks subscribed). Depending on the framework version
+// esp_task_wdt_init() then either updates the configuration or refuses with
+// ESP_ERR_INVALID_STATE; in the latter case the idle tasks are unsubscribed
+// for a deinit and init and subscribed again.
+static esp_err_t hwWatchdogInit()
+{
+	esp_err_t err = esp_task_wdt_init(WATCHDOG_HW_TIMEOUT_S, true);
+	if (err != ESP_ERR_INVALID_STATE) {
+		return err;
+	}
+
+	TaskHandle_t idle[portNUM_PROCESSORS];
+	bool subscribed[portNUM_PROCESSORS];
+	for (int i = 0; i < portNUM_PROCESSORS; i++) {
+		idle[i] = xTaskGetIdleTaskHandleForCPU(i);
+		subscribed[i] = esp_task_wdt_status(idle[i]) == ESP_OK;
+		if (subscribed[i]) {
+			esp_task_wdt_delete(idle[i]);
+		}
+	}
+
+	err = esp_task_wdt_deinit();
+	if (err == ESP_OK) {
+		err = esp_task_wdt_init(WATCHDOG_HW_TIMEOUT_S, true);
+	}
+
+	for (int i = 0; i < portNUM_PROCESSORS; i++) {
+		if (subscribed[i]) {
+			esp_task_wdt_add(idle[i]);
 		}
+	}
+	return err;
+}
+#endif
+
+void watchdogTask(void *pvParameters __attribute__((unused)))
+{
+#if WATCHDOG_HW_TASK_WDT == true
+	// if this task gets starved or stuck, the hardware task WDT takes over
+	esp_err_t err = hwWatchdogInit();
+	if (err != ESP_OK) {
+		LOG_ERROR(WATCHDOG, "Watchdog: task WDT not reconfigured (%s), running on the core's settings\n", esp_err_to_name(err));
+	}
 
-		if ((diffMs > WATCHDOG_TIMEOUT) && watchdogEnabled) {
-			LOG_PRINTF("Watchddog timeout elapsed, resetting the board!\n");
+	err = esp_task_wdt_add(NULL);
+	if (err != ESP_OK) {
+		LOG_ERROR(WATCHDOG, "Watchdog: not guarded by the task WDT (%s)\n", esp_err_to_name(err));
+	}
+#endif
+
+	while (1) {
+
+		if (watchdogReboot) {
+			LOG_WARN(WATCHDOG, "Reboot scheduled, resetting the board!\n");
+			postmortemSetResetCause(rebootCause);
 			setLedColor(COLOR_RED, true);
 			delay(2000);
 			ESP.restart();
 		}
 
-		uint32_t periodicResetDiff = millis() - periodicResetTs;
+		uint32_t overdue = overdueSlots();
+
+		if (overdue && watchdogEnabled) {
+			char cause[POSTMORTEM_RECORD_SIZE];
+			int len = snprintf(cause, sizeof(cause), "Watchdog timeout:");
 
-		if ((periodicResetDiff > PERIODIC_RESET_TIMEOUT) && watchdogEnabled) {
-			LOG_PRINTF("Periodic reset!\n");
-			setLedColor(COLOR_RED, false);
+			for (uint8_t i = 0; i < numSlots; i++) {
+				if (overdue & (1UL << i)) {
+					LOG_ERROR(WATCHDOG, "Watchdog: %s missed its deadline by %u ms\n", slots[i].m_name, millis() - slots[i].m_deadlineMs);
+					if (len < (int)sizeof(cause)) {
+						len += snprintf(cause + len, sizeof(cause) - len, " %s", slots[i].m_name);
+					}
+				}
+			}
+
+			LOG_ERROR(WATCHDOG, "Watchddog timeout elapsed, resetting the board!\n");
+			postmortemSetResetCause(cause);
+			setLedColor(COLOR_RED, true);
 			delay(2000);
 			ESP.restart();
 		}
 
-		delay(2000);
+#if WATCHDOG_HW_TASK_WDT == true
+		esp_task_wdt_reset();
+#endif
+		delay(WATCHDOG_CHECK_INTERVAL_MS);
 	}
 }
 
@@ -51,7 +150,6 @@ void watchdogInit()
 {
 	// create semaphore for watchdog
 	mutex = xSemaphoreCreateMutex();
-	periodicResetTs = millis();
 
 	//
 	// watchdog task
@@ -62,18 +160,53 @@ void watchdogInit()
 		"watchdogTask",
 		2048, // Stack size (bytes)
 		NULL, // Parameter
-		0,	  // Task priority
+		1,	  // Task priority, above the idle tasks
 		NULL  // Task handle
 	);	
 }
 
-void watchdogReset()
+bool watchdogRegister(const uint32_t &timeoutMs)
 {
+	bool ret = false;
+	TaskHandle_t task = xTaskGetCurrentTaskHandle();
+
 	if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
-		if (!watchdogReboot)
-			watchdogResetTs = millis();
+		WatchdogSlot *slot = findSlot(task);
+
+		if (!slot && numSlots < WATCHDOG_MAX_TASKS) {
+			slot = &slots[numSlots];
+			slot->m_task = task;
+			slot->m_name = pcTaskGetTaskName(task);
+		}
+
+		if (slot) {
+			slot->m_timeoutMs = timeoutMs;
+			slot->m_deadlineMs = millis() + timeoutMs;
+			ret = true;
+
+			// publish the slot after it is complete
+			if (slot == &slots[numSlots]) {
+				__sync_synchronize();
+				numSlots++;
+			}
+		}
 		xSemaphoreGive(mutex);
 	}
+
+	if (!ret) {
+		LOG_ERROR(WATCHDOG, "Watchdog: no free slot for %s\n", pcTaskGetTaskName(task));
+	}
+	return ret;
+}
+
+void watchdogReset()
+{
+	WatchdogSlot *slot = findSlot(xTaskGetCurrentTaskHandle());
+
+	// a scheduled reboot must not be delayed
+	if (slot && !watchdogReboot) {
+		slot->m_deadlineMs = millis() + slot->m_timeoutMs;
+	}
 }
 
 bool watchdogEnable(const bool &enable)
@@ -81,13 +214,12 @@ bool watchdogEnable(const bool &enable)
 	bool ret = false;
 	if (xSemaphoreTake(mutex, portMAX_DELAY ) == pdTRUE) {
 		ret = watchdogEnabled;
-		watchdogEnabled = enable;
 
-		// if re-enabled, reset it
-		if (enable) {
-			if (!watchdogReboot)
-				watchdogResetTs = millis();
+		// if re-enabled, give every task a fresh deadline first
+		if (enable && !watchdogReboot) {
+			restartSlots();
 		}
+		watchdogEnabled = enable;
 		xSemaphoreGive(mutex);
 	}
 
@@ -103,19 +235,13 @@ void watchdogOverride(std::function<void(void)> fn)
 	}
 }
 
-void watchdogScheduleReboot()
+void watchdogScheduleReboot(const char *cause)
 {
 	if (xSemaphoreTake(mutex, portMAX_DELAY) == pdTRUE) {
+		if (!watchdogReboot) {
+			rebootCause = cause;
+		}
 		watchdogReboot = true;
 		xSemaphoreGive(mutex);
 	}
 }
-
-//
-// Watchdog task
-//
-
-uint32_t watchdogTimeToReset()
-{
-	return PERIODIC_RESET_TIMEOUT - (millis() - periodicResetTs);
-}
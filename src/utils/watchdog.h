@@ -1,11 +1,26 @@
 #pragma once
 #include <functional>
+#include <stdint.h>
+#include "config.h"
+
+//
+// Software watchdog with per-task heartbeats.
+//
+// Every task that shall be supervised registers itself once and then checks
+// in periodically with watchdogReset(). A check-in is a single store of the
+// task's next deadline, no locking involved. The watchdog task scans all
+// slots and reboots the board naming the task(s) that missed their deadline.
+//
 
 void watchdogInit();
+
+// register the calling task, returns false if all slots are taken
+bool watchdogRegister(const uint32_t &timeoutMs = WATCHDOG_TIMEOUT);
+
+// check in the calling task, ignored for unregistered tasks
 void watchdogReset();
-void watchdogScheduleReboot();
+
+// reboot from the watchdog task, cause is recorded in the post-mortem log
+void watchdogScheduleReboot(const char *cause = "Scheduled reboot");
 bool watchdogEnable(const bool &enable);
 void watchdogOverride(std::function<void(void)> fn);
-
-uint32_t watchdogTimeToReset();
-
@@ -0,0 +1,41 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "log.h"
+#include "hostTest.h"
+
+//
+// Host side of the logging (utils.cpp on the device): every message is
+// formatted like on the device, it goes to stdout only if HOST_LOG is set in
+// the environment so the test output stays readable.
+//
+
+int g_hostTestFailures = 0;
+
+void printf_internal(const char *fmt, ...)
+{
+	static int enabled = -1;
+	if (enabled < 0) {
+		enabled = getenv("HOST_LOG") != NULL;
+	}
+
+	char buffer[256];
+	va_list args;
+	va_start(args, fmt);
+	int len = vsnprintf(buffer, sizeof(buffer), fmt, args);
+	va_end(args);
+
+	if (enabled && len > 0) {
+		fputs(buffer, stdout);
+	}
+}
+
+int hostTestResult(const char *name)
+{
+	if (g_hostTestFailures) {
+		printf("%s: %d check(s) failed\n", name, g_hostTestFailures);
+		return 1;
+	}
+	printf("%s: passed\n", name);
+	return 0;
+}
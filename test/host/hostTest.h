@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdio.h>
+
+//
+// Minimal checks for the host tests: a failed check prints where and why,
+// the test keeps going and exits with hostTestResult().
+//
+
+extern int g_hostTestFailures;
+
+#define CHECK(cond) \
+	do { \
+		if (!(cond)) { \
+			printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+			g_hostTestFailures++; \
+		} \
+	} while (0)
+
+#define CHECK_EQ(actual, expected) \
+	do { \
+		long long a_ = (long long)(actual); \
+		long long e_ = (long long)(expected); \
+		if (a_ != e_) { \
+			printf("%s:%d: %s is %lld, expected %lld\n", __FILE__, __LINE__, #actual, a_, e_); \
+			g_hostTestFailures++; \
+		} \
+	} while (0)
+
+// exit code of main()
+int hostTestResult(const char *name);
@@ -0,0 +1,33 @@
+#include <string>
+#include "log.h"
+
+//
+// Code size of disabled log calls, see the log-size target of the Makefile:
+// a request handler with the per-request logs of serverTask.cpp, built with
+// LOG_LEVEL_SIZE at INFO (the logs compiled out) and at DEBUG.
+//
+
+struct Request {
+	std::string remoteIP() const;
+	std::string url() const;
+	int param(const char *name) const;
+};
+
+#define LOG_LEVEL_SIZE LOG_SIZE_LEVEL
+#define LOG_MODULE_SIZE LOG_MODULE_SERVER
+
+int handleRequests(const Request *requests, const int &count)
+{
+	int sum = 0;
+	for (int i = 0; i < count; i++) {
+		const Request &request = requests[i];
+		LOG_DEBUG(SIZE, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, request.remoteIP().c_str());
+		LOG_DEBUG(SIZE, "%s(%d): url %s\n", __FUNCTION__, __LINE__, request.url().c_str());
+
+		int value = request.param("value");
+		LOG_DEBUG(SIZE, "%s(%d): value %d from %s\n", __FUNCTION__, __LINE__, value, request.remoteIP().c_str());
+		LOG_INFO(SIZE, "value set to %d\n", value);
+		sum += value;
+	}
+	return sum;
+}
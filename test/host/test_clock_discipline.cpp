@@ -0,0 +1,86 @@
+#include "clockDiscipline.h"
+#include "hostTest.h"
+
+//
+// ClockDiscipline: frequency estimate and its limit, offsets slewed in or
+// stepped, the update interval
+//
+
+#define S 1000000LL
+#define PRECISION_US 1000
+
+// a crystal 40 ppm fast, ideal samples every interval
+static void learnsDrift()
+{
+	ClockDiscipline clock;
+	int64_t localUs = 10 * S;
+	int64_t wallUs = 1700000000LL * S;
+
+	clock.sample(wallUs, localUs, PRECISION_US);
+	CHECK(clock.synced());
+	CHECK_EQ(clock.intervalMs(), NTP_UPDATE_INTERVAL_MS);
+
+	for (int i = 0; i < 20; i++) {
+		int64_t dt = clock.intervalMs() * 1000LL;
+		localUs += dt;
+		wallUs += dt - dt * 40000 / 1000000000LL;
+		clock.sample(wallUs, localUs, PRECISION_US);
+	}
+
+	CHECK_EQ(clock.state().m_freqPpb, -40000);
+	CHECK(clock.lastOffsetUs() < 1000 && clock.lastOffsetUs() > -1000);
+	CHECK_EQ(clock.intervalMs(), NTP_UPDATE_INTERVAL_MAX_MS);
+
+	// the converted time follows the reference between the samples
+	int64_t dt = 1000 * S;
+	int64_t expectedUs = wallUs + dt - dt * 40000 / 1000000000LL;
+	int64_t errorUs = ClockDiscipline::wallUs(clock.state(), localUs + dt) - expectedUs;
+	CHECK(errorUs < 1000 && errorUs > -1000);
+}
+
+// a measured drift beyond the 32 bits of the state (e.g. a reference that
+// jumped) is limited with its sign, not wrapped around first
+static void limitsFrequency()
+{
+	ClockDiscipline fast;
+	fast.sample(0, 0, PRECISION_US);
+	fast.sample(400 * S, 100 * S, PRECISION_US);	// +3e9 ppb
+	CHECK_EQ(fast.state().m_freqPpb, CLOCK_MAX_FREQ_PPM * 1000);
+
+	ClockDiscipline slow;
+	slow.sample(0, 0, PRECISION_US);
+	slow.sample(-300 * S, 100 * S, PRECISION_US);	// -4e9 ppb
+	CHECK_EQ(slow.state().m_freqPpb, -CLOCK_MAX_FREQ_PPM * 1000);
+
+	// plausible drifts are taken as measured
+	ClockDiscipline normal;
+	normal.sample(0, 0, PRECISION_US);
+	normal.sample(100 * S + 2000, 100 * S, PRECISION_US);	// +20 ppm
+	CHECK_EQ(normal.state().m_freqPpb, 20000);
+}
+
+static void stepsAndSlews()
+{
+	ClockDiscipline clock;
+	clock.sample(1000 * S, 0, PRECISION_US);
+
+	// small offsets are slewed in at CLOCK_SLEW_RATE_PPM
+	clock.sample(1010 * S + 100000, 10 * S, 50 * S);
+	CHECK_EQ(clock.lastOffsetUs(), 100000);
+	CHECK_EQ(ClockDiscipline::wallUs(clock.state(), 10 * S), 1010 * S);
+	CHECK_EQ(ClockDiscipline::wallUs(clock.state(), 110 * S), 1110 * S + 100 * S * CLOCK_SLEW_RATE_PPM / 1000000);
+	CHECK_EQ(ClockDiscipline::wallUs(clock.state(), 1010 * S), 2010 * S + 100000);
+
+	// large ones are stepped, and the interval starts over
+	clock.sample(5000 * S, 20 * S, 50 * S);
+	CHECK_EQ(ClockDiscipline::wallUs(clock.state(), 20 * S), 5000 * S);
+	CHECK_EQ(clock.intervalMs(), NTP_UPDATE_INTERVAL_MS);
+}
+
+int main()
+{
+	learnsDrift();
+	limitsFrequency();
+	stepsAndSlews();
+	return hostTestResult("test_clock_discipline");
+}
@@ -0,0 +1,183 @@
+#include <pthread.h>
+#include <time.h>
+#include "seqLock.h"
+#include "clockDiscipline.h"
+#include "timezone.h"
+#include "hostTest.h"
+
+//
+// The sequence lock of the clock state in ntpTask.cpp with host threads: a
+// writer publishing as fast as it can and readers checking that no snapshot
+// is ever torn, i.e. all fields come from the same write. Then the cost of a
+// read against the mutex the clock state used before.
+//
+
+#define READERS 3
+#define TORTURE_MS 2000
+#define BENCH_READS 10000000
+
+// ntpTask.cpp
+struct ClockSnapshot {
+	ClockDiscipline::State m_clock;
+	Timezone::Window m_timezone;
+	bool m_synced = false;
+};
+
+static ClockSnapshot snapshot(const uint32_t &n)
+{
+	ClockSnapshot state;
+	state.m_clock.m_localBaseUs = n;
+	state.m_clock.m_wallBaseUs = n * 1000003LL;
+	state.m_clock.m_slewUs = -(int64_t)n;
+	state.m_clock.m_freqPpb = n * 7;
+	state.m_timezone.m_nextTransitionMs = n + 5;
+	state.m_timezone.m_offsetS = n % 3600;
+	state.m_timezone.m_nextOffsetS = -(int32_t)(n % 3600);
+	state.m_synced = n & 1;
+	return state;
+}
+
+static bool consistent(const ClockSnapshot &state)
+{
+	uint32_t n = state.m_clock.m_localBaseUs;
+	ClockSnapshot expected = snapshot(n);
+	return state.m_clock.m_wallBaseUs == expected.m_clock.m_wallBaseUs &&
+		state.m_clock.m_slewUs == expected.m_clock.m_slewUs &&
+		state.m_clock.m_freqPpb == expected.m_clock.m_freqPpb &&
+		state.m_timezone.m_nextTransitionMs == expected.m_timezone.m_nextTransitionMs &&
+		state.m_timezone.m_offsetS == expected.m_timezone.m_offsetS &&
+		state.m_timezone.m_nextOffsetS == expected.m_timezone.m_nextOffsetS &&
+		state.m_synced == expected.m_synced;
+}
+
+static int64_t nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static SeqLock<ClockSnapshot> g_clockState;
+static ClockSnapshot g_mutexState;
+static pthread_mutex_t g_clockMutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool g_stop = false;
+
+struct ReaderStats {
+	uint64_t m_reads = 0;
+	uint64_t m_torn = 0;
+	uint64_t m_backwards = 0;
+};
+
+static void *writer(void *)
+{
+	for (uint32_t n = 1; !g_stop; n++) {
+		ClockSnapshot state = snapshot(n);
+		g_clockState.write(state);
+	}
+	return NULL;
+}
+
+static void *reader(void *arg)
+{
+	ReaderStats *stats = (ReaderStats *)arg;
+	int64_t last = 0;
+
+	while (!g_stop) {
+		ClockSnapshot state = g_clockState.read();
+		stats->m_reads++;
+		if (!consistent(state)) {
+			stats->m_torn++;
+		}
+		if (state.m_clock.m_localBaseUs < last) {
+			stats->m_backwards++;
+		}
+		last = state.m_clock.m_localBaseUs;
+	}
+	return NULL;
+}
+
+static void torture()
+{
+	pthread_t writerThread;
+	pthread_t readerThreads[READERS];
+	ReaderStats stats[READERS];
+
+	g_stop = false;
+	pthread_create(&writerThread, NULL, writer, NULL);
+	for (int i = 0; i < READERS; i++) {
+		pthread_create(&readerThreads[i], NULL, reader, &stats[i]);
+	}
+
+	struct timespec ts = {TORTURE_MS / 1000, (TORTURE_MS % 1000) * 1000000L};
+	nanosleep(&ts, NULL);
+	g_stop = true;
+
+	pthread_join(writerThread, NULL);
+	ReaderStats total;
+	for (int i = 0; i < READERS; i++) {
+		pthread_join(readerThreads[i], NULL);
+		total.m_reads += stats[i].m_reads;
+		total.m_torn += stats[i].m_torn;
+		total.m_backwards += stats[i].m_backwards;
+	}
+
+	CHECK(total.m_reads > 0);
+	CHECK(g_clockState.writes() > 0);
+	CHECK_EQ(total.m_torn, 0);
+	CHECK_EQ(total.m_backwards, 0);
+	printf("  %u writes, %llu reads by %d readers: %llu torn\n",
+		g_clockState.writes(), (unsigned long long)total.m_reads, READERS, (unsigned long long)total.m_torn);
+}
+
+static ClockSnapshot mutexRead()
+{
+	pthread_mutex_lock(&g_clockMutex);
+	ClockSnapshot state = g_mutexState;
+	pthread_mutex_unlock(&g_clockMutex);
+	return state;
+}
+
+static void *mutexWriter(void *)
+{
+	for (uint32_t n = 1; !g_stop; n++) {
+		pthread_mutex_lock(&g_clockMutex);
+		g_mutexState = snapshot(n);
+		pthread_mutex_unlock(&g_clockMutex);
+	}
+	return NULL;
+}
+
+// ns per read, with a writer running concurrently or not
+static double bench(const bool &useMutex, const bool &contended)
+{
+	pthread_t writerThread;
+	g_stop = false;
+	if (contended) {
+		pthread_create(&writerThread, NULL, useMutex ? mutexWriter : writer, NULL);
+	}
+
+	volatile int64_t sink = 0;
+	int64_t startNs = nowNs();
+	for (uint32_t i = 0; i < BENCH_READS; i++) {
+		ClockSnapshot state = useMutex ? mutexRead() : g_clockState.read();
+		sink = sink + state.m_clock.m_wallBaseUs;
+	}
+	int64_t elapsedNs = nowNs() - startNs;
+
+	g_stop = true;
+	if (contended) {
+		pthread_join(writerThread, NULL);
+	}
+	return (double)elapsedNs / BENCH_READS;
+}
+
+int main()
+{
+	torture();
+
+	printf("  read cost (host, ns per read):\n");
+	printf("    seqlock uncontended %6.1f, with a busy writer %6.1f\n", bench(false, false), bench(false, true));
+	printf("    mutex   uncontended %6.1f, with a busy writer %6.1f\n", bench(true, false), bench(true, true));
+
+	return hostTestResult("test_clock_state");
+}
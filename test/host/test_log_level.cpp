@@ -0,0 +1,105 @@
+#include <string.h>
+#include <time.h>
+#include "log.h"
+#include "hostTest.h"
+
+//
+// The per-module log levels: the module table, the runtime override and
+// that disabled calls don't evaluate their arguments. Then the cost of a
+// call compiled out, disabled at runtime and enabled (formatted, like
+// printf_internal() does on the device before writing it out).
+//
+
+#define LOG_LEVEL_TEST LOG_LEVEL_INFO
+#define LOG_MODULE_TEST LOG_MODULE_SERVER
+
+#define BENCH_CALLS 2000000
+
+static int g_evaluations = 0;
+
+static const char *argument()
+{
+	g_evaluations++;
+	return "192.168.2.100";
+}
+
+static void modules()
+{
+	for (uint8_t i = 0; i < LOG_MODULE_COUNT; i++) {
+		CHECK(logModuleName(i)[0]);
+		CHECK_EQ(logModuleFind(logModuleName(i)), i);
+		CHECK(logModuleMaxLevel(i) <= LOG_LEVEL_VERBOSE);
+		CHECK_EQ(g_logLevels[i], logModuleMaxLevel(i));
+	}
+	CHECK_EQ(logModuleFind("WiFi"), LOG_MODULE_WIFI);
+	CHECK_EQ(logModuleFind("sched"), LOG_MODULE_SCHED);
+	CHECK_EQ(logModuleFind("beeper"), -1);
+	CHECK_EQ(logModuleName(LOG_MODULE_COUNT)[0], 0);
+
+	// the runtime level can't go above the compile-time one
+	CHECK(logSetLevel(LOG_MODULE_NTP, LOG_LEVEL_VERBOSE));
+	CHECK_EQ(g_logLevels[LOG_MODULE_NTP], LOG_LEVEL_NTP);
+	CHECK(logSetLevel(LOG_MODULE_NTP, LOG_LEVEL_ERROR));
+	CHECK_EQ(g_logLevels[LOG_MODULE_NTP], LOG_LEVEL_ERROR);
+	CHECK(logSetLevel(LOG_MODULE_NTP, LOG_LEVEL_NTP));
+	CHECK(!logSetLevel(LOG_MODULE_COUNT, LOG_LEVEL_INFO));
+}
+
+static void arguments()
+{
+	g_evaluations = 0;
+
+	// above the compile-time level
+	LOG_DEBUG(TEST, "request from %s\n", argument());
+	CHECK_EQ(g_evaluations, 0);
+
+	// above the runtime level
+	logSetLevel(LOG_MODULE_TEST, LOG_LEVEL_WARN);
+	LOG_INFO(TEST, "request from %s\n", argument());
+	CHECK_EQ(g_evaluations, 0);
+
+	logSetLevel(LOG_MODULE_TEST, LOG_LEVEL_TEST);
+	LOG_INFO(TEST, "request from %s\n", argument());
+	CHECK_EQ(g_evaluations, 1);
+}
+
+static int64_t nowNs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void bench()
+{
+	int64_t startNs = nowNs();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		LOG_DEBUG(TEST, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, argument());
+		__asm__ __volatile__("" ::: "memory");
+	}
+	double compiledOutNs = (double)(nowNs() - startNs) / BENCH_CALLS;
+
+	logSetLevel(LOG_MODULE_TEST, LOG_LEVEL_WARN);
+	startNs = nowNs();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		LOG_INFO(TEST, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, argument());
+	}
+	double disabledNs = (double)(nowNs() - startNs) / BENCH_CALLS;
+
+	logSetLevel(LOG_MODULE_TEST, LOG_LEVEL_TEST);
+	startNs = nowNs();
+	for (uint32_t i = 0; i < BENCH_CALLS; i++) {
+		LOG_INFO(TEST, "%s(%d): request from %s\n", __FUNCTION__, __LINE__, argument());
+	}
+	double enabledNs = (double)(nowNs() - startNs) / BENCH_CALLS;
+
+	printf("  ns per call (host): compiled out %.1f, disabled at runtime %.1f, enabled %.1f (formatting only)\n", compiledOutNs, disabledNs, enabledNs);
+}
+
+int main()
+{
+	modules();
+	arguments();
+	bench();
+	return hostTestResult("test_log_level");
+}
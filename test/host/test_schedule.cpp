@@ -0,0 +1,128 @@
+#include <set>
+#include <utility>
+#include "schedule.h"
+#include "timezone.h"
+#include "hostTest.h"
+
+//
+// Replay of the scheduler task loop on a virtual UTC clock through the DST
+// changes of TIMEZONE: sleep until the next local deadline (capped at
+// SCHEDULE_MAX_SLEEP_MS and the next transition), pop what is due, skip what
+// is late by more than SCHEDULE_MAX_LATE_MS like the task does. Every slot
+// of every rule has to ring exactly once, on time and in heap order, except
+// the slots in the hour skipped by the spring change; those count as
+// missed. Slots in the hour repeated in autumn ring once.
+//
+
+#define MS_PER_DAY 86400000LL
+#define MS_PER_MINUTE 60000LL
+
+#define SUNDAY 0x01
+#define WORKDAYS 0x3e
+#define EVERY_DAY 0x7f
+
+static const uint32_t g_rules[] = {
+	Schedule::packRule(WORKDAYS, 8 * 60, 5, false),
+	Schedule::packRule(WORKDAYS, 8 * 60 + 45, 5, false),
+	Schedule::packRule(0x0a, 12 * 60, 30, true),		// Monday, Wednesday
+	Schedule::packRule(EVERY_DAY, 2 * 60 + 30, 1, false),	// in the skipped / repeated hour
+	Schedule::packRule(SUNDAY, 3 * 60, 1, false),		// right after it
+	Schedule::packRule(EVERY_DAY, 23 * 60 + 59, 1, true),
+};
+
+#define NUM_RULES (sizeof(g_rules) / sizeof(g_rules[0]))
+
+typedef std::set<std::pair<uint8_t, int64_t>> Slots;	// (rule, local fire time)
+
+static bool localTimeExists(const Timezone &zone, const int64_t &localMs)
+{
+	for (int32_t offsetS = -14 * 3600; offsetS <= 14 * 3600; offsetS += 900) {
+		int64_t utcMs = localMs - offsetS * 1000LL;
+		if (Timezone::toLocalMs(zone.window(utcMs), utcMs) == localMs) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void replay(const char *name, const int64_t &startUtcMs, const int64_t &endUtcMs)
+{
+	Timezone zone;
+	CHECK(zone.parse(TIMEZONE));
+
+	int64_t utcMs = startUtcMs;
+	Timezone::Window window = zone.window(utcMs);
+	int64_t startLocalMs = Timezone::toLocalMs(window, utcMs);
+
+	Schedule schedule;
+	schedule.setRules(g_rules, NUM_RULES, startLocalMs);
+
+	Slots rung;
+	uint32_t pops = 0;
+	uint32_t skipped = 0;
+	uint32_t wakeups = 0;
+	int64_t lastFireMs = INT64_MIN;
+	int64_t maxLateMs = 0;
+	int64_t nowMs = startLocalMs;
+
+	while (utcMs < endUtcMs) {
+		if (utcMs >= window.m_nextTransitionMs) {
+			window = zone.window(utcMs);
+		}
+		nowMs = Timezone::toLocalMs(window, utcMs);
+		wakeups++;
+
+		Schedule::Event event;
+		while (schedule.pop(nowMs, event)) {
+			pops++;
+			CHECK(event.m_fireMs >= lastFireMs);
+			lastFireMs = event.m_fireMs;
+
+			if (nowMs - event.m_fireMs > SCHEDULE_MAX_LATE_MS) {
+				skipped++;
+				continue;
+			}
+			maxLateMs = (nowMs - event.m_fireMs > maxLateMs) ? nowMs - event.m_fireMs : maxLateMs;
+			CHECK(rung.insert(std::make_pair(event.m_rule, event.m_fireMs)).second);
+		}
+
+		// SchedulerContext::sleepMs()
+		int64_t sleepMs = SCHEDULE_MAX_SLEEP_MS;
+		if (schedule.nextDeadlineMs() - nowMs < sleepMs) {
+			sleepMs = schedule.nextDeadlineMs() - nowMs;
+		}
+		if (window.m_nextTransitionMs - utcMs < sleepMs) {
+			sleepMs = window.m_nextTransitionMs - utcMs;
+		}
+		utcMs += (sleepMs > 1) ? sleepMs : 1;
+	}
+
+	// every slot between the start and the last wakeup that exists locally
+	Slots expected;
+	uint32_t gapSlots = 0;
+	for (uint8_t rule = 0; rule < NUM_RULES; rule++) {
+		for (int64_t fireMs = Schedule::nextFireMs(g_rules[rule], startLocalMs); fireMs <= nowMs; fireMs = Schedule::nextFireMs(g_rules[rule], fireMs)) {
+			if (localTimeExists(zone, fireMs)) {
+				expected.insert(std::make_pair(rule, fireMs));
+			} else {
+				gapSlots++;
+			}
+		}
+	}
+
+	CHECK(rung == expected);
+	CHECK_EQ(skipped, gapSlots);
+	CHECK_EQ(pops, rung.size() + skipped);
+	// the slot right after the skipped hour too, the task wakes up at the jump
+	CHECK_EQ(maxLateMs, 0);
+	printf("  %s: %u/%u slots rung in order, %u in the skipped hour, at most %lld s late, %u wakeups\n", name, (uint32_t)rung.size(), (uint32_t)expected.size(), skipped, (long long)maxLateMs / 1000, wakeups);
+}
+
+int main()
+{
+	// CET-1CEST,M3.5.0,M10.5.0/3: 2024-03-31 and 2024-10-27
+	replay("spring 2024", 1711584000000LL, 1712188800000LL);	// 03-28 .. 04-04 UTC
+	replay("autumn 2024", 1729468800000LL, 1730073600000LL);	// 10-21 .. 10-28 UTC
+	replay("year 2025", 1735689600000LL, 1767225600000LL);
+	return hostTestResult("test_schedule");
+}
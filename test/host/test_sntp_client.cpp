@@ -0,0 +1,208 @@
+#include <atomic>
+#include <thread>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "sntpClient.h"
+#include "hostTest.h"
+
+//
+// SntpClient against stand-in NTP servers on loopback addresses. A stand-in
+// runs on the client's clock shifted by a given offset and can hold a
+// request before answering, or not answer at all.
+//
+
+#define S 1000000LL
+#define MS 1000LL
+
+// seconds between 1900 and 1970, the NTP seconds wrap 2036-02-07 06:28:16
+#define NTP_UNIX_OFFSET 2208988800LL
+#define ERA1_UNIX_S 2085978496LL
+
+static int64_t monotonicUs()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * S + ts.tv_nsec / 1000;
+}
+
+static void writeTimestamp(uint8_t *p, const int64_t &unixUs)
+{
+	uint64_t seconds = (uint64_t)(unixUs / S + NTP_UNIX_OFFSET) & 0xffffffffULL;
+	uint64_t fraction = ((uint64_t)(unixUs % S) << 32) / S;
+	uint64_t ts = (seconds << 32) | fraction;
+	for (int i = 7; i >= 0; i--) {
+		p[i] = ts & 0xff;
+		ts >>= 8;
+	}
+}
+
+struct StandIn {
+	int m_fd = -1;
+	int64_t m_offsetUs = 0;		// server time minus client time
+	int64_t m_holdUs = 0;		// between receiving the request and answering
+	bool m_silent = false;
+	std::atomic<bool> m_stop;
+	std::thread m_thread;
+
+	StandIn(const char *ip, uint16_t &port, const int64_t &offsetUs, const int64_t &holdUs = 0, const bool &silent = false)
+		: m_offsetUs(offsetUs)
+		, m_holdUs(holdUs)
+		, m_silent(silent)
+		, m_stop(false)
+	{
+		m_fd = socket(AF_INET, SOCK_DGRAM, 0);
+		struct sockaddr_in addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sin_family = AF_INET;
+		addr.sin_port = htons(port);
+		inet_pton(AF_INET, ip, &addr.sin_addr);
+		CHECK(bind(m_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+
+		// the first stand-in picks the port, the others share it
+		socklen_t len = sizeof(addr);
+		getsockname(m_fd, (struct sockaddr *)&addr, &len);
+		port = ntohs(addr.sin_port);
+
+		struct timeval timeout = {0, 50000};
+		setsockopt(m_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		m_thread = std::thread([this]() { run(); });
+	}
+
+	~StandIn()
+	{
+		m_stop = true;
+		m_thread.join();
+		close(m_fd);
+	}
+
+	void run()
+	{
+		while (!m_stop) {
+			uint8_t packet[48];
+			struct sockaddr_in from;
+			socklen_t fromLen = sizeof(from);
+			ssize_t len = recvfrom(m_fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, &fromLen);
+			int64_t receivedUs = monotonicUs() + m_offsetUs;
+			if (len != sizeof(packet) || m_silent) {
+				continue;
+			}
+
+			if (m_holdUs) {
+				usleep(m_holdUs);
+			}
+
+			// the client's transmit timestamp comes back as the originate one
+			memcpy(&packet[24], &packet[40], 8);
+			packet[0] = 0x24;	// LI = 0, version 4, mode 4 (server)
+			packet[1] = 2;		// stratum
+			writeTimestamp(&packet[32], receivedUs);
+			writeTimestamp(&packet[40], monotonicUs() + m_offsetUs);
+			sendto(m_fd, packet, sizeof(packet), 0, (struct sockaddr *)&from, fromLen);
+		}
+	}
+};
+
+// wall time offset of the client clock to reach a unix time
+static int64_t offsetTo(const int64_t &unixUs)
+{
+	return unixUs - monotonicUs();
+}
+
+static bool near(const int64_t &value, const int64_t &expected, const int64_t &toleranceUs)
+{
+	return value >= expected - toleranceUs && value <= expected + toleranceUs;
+}
+
+// the hold time of a server is no round trip delay, the lowest delay wins
+static void offsetAndDelay()
+{
+	printf("offsetAndDelay\n");
+	uint16_t port = 0;
+	int64_t offset = offsetTo(1704067200LL * S);	// 2024-01-01
+	StandIn slow("127.0.0.1", port, offset, 200 * MS);
+	StandIn fast("127.0.0.2", port, offset + 20 * MS);
+
+	static const char *const names[] = {"127.0.0.1", "127.0.0.2"};
+	SntpClient client(names, 2, port, 0);
+
+	SntpSample sample;
+	CHECK(client.query(sample));
+	CHECK_EQ(sample.m_server, 1);
+	CHECK(near(sample.m_offsetUs, offset + 20 * MS, 5 * MS));
+	CHECK(sample.m_delayUs >= 0 && sample.m_delayUs < 5 * MS);
+	printf("  offset error %lld us, delay %lld us\n", (long long)(sample.m_offsetUs - offset - 20 * MS), (long long)sample.m_delayUs);
+}
+
+// server time in the next NTP era, and a reply straddling the wrap
+static void era2036()
+{
+	printf("era2036\n");
+	static const char *const names[] = {"127.0.0.1"};
+
+	{
+		uint16_t port = 0;
+		int64_t offset = offsetTo((ERA1_UNIX_S + 86400) * S);
+		StandIn server("127.0.0.1", port, offset);
+		SntpClient client(names, 1, port, 0);
+
+		SntpSample sample;
+		CHECK(client.query(sample));
+		CHECK(near(sample.m_offsetUs, offset, 5 * MS));
+	}
+
+	{
+		// received in era 0, answered in era 1
+		uint16_t port = 0;
+		int64_t offset = offsetTo(ERA1_UNIX_S * S - 50 * MS);
+		StandIn server("127.0.0.1", port, offset, 100 * MS);
+		SntpClient client(names, 1, port, 0);
+
+		SntpSample sample;
+		CHECK(client.query(sample));
+		CHECK(near(sample.m_offsetUs, offset, 5 * MS));
+		CHECK(sample.m_delayUs >= 0 && sample.m_delayUs < 5 * MS);
+	}
+}
+
+// a silent server costs the query timeout, no more
+static void timeout()
+{
+	printf("timeout\n");
+	uint16_t port = 0;
+	int64_t offset = offsetTo(1704067200LL * S);
+	StandIn answering("127.0.0.1", port, offset);
+	StandIn silent("127.0.0.2", port, offset, 0, true);
+
+	static const char *const names[] = {"127.0.0.1", "127.0.0.2"};
+	SntpClient client(names, 2, port, 0);
+
+	SntpSample sample;
+	int64_t startUs = monotonicUs();
+	CHECK(client.query(sample));
+	int64_t elapsedUs = monotonicUs() - startUs;
+	CHECK_EQ(sample.m_server, 0);
+	CHECK(near(sample.m_offsetUs, offset, 5 * MS));
+	CHECK(elapsedUs >= NTP_QUERY_TIMEOUT_MS * MS && elapsedUs < NTP_QUERY_TIMEOUT_MS * MS + 200 * MS);
+
+	// nobody answers
+	static const char *const silentOnly[] = {"127.0.0.2"};
+	SntpClient none(silentOnly, 1, port, 0);
+	startUs = monotonicUs();
+	CHECK(!none.query(sample));
+	elapsedUs = monotonicUs() - startUs;
+	CHECK(elapsedUs < NTP_QUERY_TIMEOUT_MS * MS + 200 * MS);
+	printf("  query with a silent server: %lld ms\n", (long long)elapsedUs / MS);
+}
+
+int main()
+{
+	offsetAndDelay();
+	era2036();
+	timeout();
+	return hostTestResult("test_sntp_client");
+}
@@ -0,0 +1,109 @@
+#include "sntpFilter.h"
+#include "hostTest.h"
+
+//
+// SNTP timestamps and the sample selection of SntpFilter on crafted replies
+//
+
+#define S 1000000LL
+#define MS 1000LL
+
+static const char *const g_names[] = {"a", "b", "c", "d"};
+
+static uint64_t ntpTimestamp(const uint64_t &seconds, const uint32_t &fraction = 0)
+{
+	return (seconds << 32) | fraction;
+}
+
+static void timestamps()
+{
+	// 1970-01-01, 2024-01-01 and half a second
+	CHECK_EQ(sntpToUnixUs(ntpTimestamp(2208988800ULL)), 0);
+	CHECK_EQ(sntpToUnixUs(ntpTimestamp(2208988800ULL + 1704067200ULL, 0x80000000)), 1704067200LL * S + 500000);
+
+	// the last second of era 0 and the first ones of era 1 (2036-02-07 06:28:16)
+	CHECK_EQ(sntpToUnixUs(ntpTimestamp(0xffffffffULL)), 2085978495LL * S);
+	CHECK_EQ(sntpToUnixUs(ntpTimestamp(0)), 2085978496LL * S);
+	CHECK_EQ(sntpToUnixUs(ntpTimestamp(1000)), 2085979496LL * S);
+}
+
+// replies with the given delay and offset, symmetric paths
+static void reply(SntpFilter &filter, const int8_t &server, const int64_t &sentUs, const int64_t &delayUs, const int64_t &offsetUs, const int64_t &processingUs = 0)
+{
+	int64_t t1 = sentUs;
+	int64_t t2 = t1 + delayUs / 2 + offsetUs;
+	int64_t t3 = t2 + processingUs;
+	int64_t t4 = t3 - offsetUs + delayUs / 2;
+	filter.add(server, t1, t2, t3, t4);
+}
+
+static void clockFilter()
+{
+	SntpFilter filter(g_names, 2);
+	SntpSample result;
+	CHECK(!filter.select(result));
+	CHECK_EQ(filter.best(0).m_server, -1);
+
+	// the lowest delay reply of the burst wins, whatever its offset
+	reply(filter, 0, 1000 * MS, 40 * MS, 5 * MS);
+	reply(filter, 0, 1001 * MS, 12 * MS, 2 * MS, 3 * MS);
+	reply(filter, 0, 1002 * MS, 30 * MS, 9 * MS);
+	CHECK_EQ(filter.best(0).m_delayUs, 12 * MS);
+	CHECK_EQ(filter.best(0).m_offsetUs, 2 * MS);
+	CHECK_EQ(filter.best(0).m_localUs, 1001 * MS + 3 * MS + 12 * MS);
+
+	// server processing time is not part of the delay
+	CHECK_EQ(filter.best(0).m_delayUs, 12 * MS);
+
+	// a negative delay (bogus server timestamps) is never taken
+	filter.add(1, 0, 0, 50 * MS, 10 * MS);
+	CHECK_EQ(filter.best(1).m_server, -1);
+
+	// servers beyond the configured ones are ignored
+	reply(filter, 2, 0, MS, 0);
+	reply(filter, -1, 0, MS, 0);
+	CHECK(filter.select(result));
+	CHECK_EQ(result.m_server, 0);
+
+	filter.reset();
+	CHECK(!filter.select(result));
+}
+
+static void selection()
+{
+	SntpFilter filter(g_names, 4);
+	SntpSample result;
+
+	// b is nearest but a falseticker (the median is c), d has the lowest
+	// delay of the rest
+	reply(filter, 0, 0, 30 * MS, 10 * MS);
+	reply(filter, 1, 0, 5 * MS, 12 * MS + NTP_OUTLIER_MS * MS + MS);
+	reply(filter, 2, 0, 25 * MS, 12 * MS);
+	reply(filter, 3, 0, 20 * MS, 8 * MS);
+	CHECK(filter.select(result));
+	CHECK_EQ(result.m_server, 3);
+	CHECK_EQ(result.m_offsetUs, 8 * MS);
+
+	// exactly NTP_OUTLIER_MS from the median (c) it is taken
+	filter.reset();
+	reply(filter, 0, 0, 30 * MS, 10 * MS);
+	reply(filter, 1, 0, 5 * MS, 12 * MS + NTP_OUTLIER_MS * MS);
+	reply(filter, 2, 0, 25 * MS, 12 * MS);
+	CHECK(filter.select(result));
+	CHECK_EQ(result.m_server, 1);
+
+	// a single server is its own median
+	filter.reset();
+	reply(filter, 2, 0, 80 * MS, -3 * S);
+	CHECK(filter.select(result));
+	CHECK_EQ(result.m_server, 2);
+	CHECK_EQ(result.m_offsetUs, -3 * S);
+}
+
+int main()
+{
+	timestamps();
+	clockFilter();
+	selection();
+	return hostTestResult("test_sntp_filter");
+}
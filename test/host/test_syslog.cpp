@@ -0,0 +1,177 @@
+#include <string>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "syslogQueue.h"
+#include "hostTest.h"
+
+//
+// The syslog sender on loopback: records are queued, popped and sent one
+// message per datagram like syslogClient.cpp does, a collector socket
+// receives them and parses every datagram as a single RFC 5424 message.
+//
+
+#define HOST_NAME "buzzer-1234"
+
+// 2025-01-31 12:34:56.789 UTC
+#define UTC_MS 1738326896789ULL
+
+struct Loopback {
+	int m_collector = -1;
+	int m_sender = -1;
+	struct sockaddr_in m_addr = {};
+
+	Loopback()
+	{
+		m_collector = socket(AF_INET, SOCK_DGRAM, 0);
+		m_sender = socket(AF_INET, SOCK_DGRAM, 0);
+		CHECK(m_collector >= 0 && m_sender >= 0);
+
+		// any free port
+		m_addr.sin_family = AF_INET;
+		m_addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		m_addr.sin_port = 0;
+		CHECK(bind(m_collector, (struct sockaddr *)&m_addr, sizeof(m_addr)) == 0);
+		socklen_t len = sizeof(m_addr);
+		CHECK(getsockname(m_collector, (struct sockaddr *)&m_addr, &len) == 0);
+
+		struct timeval timeout = {1, 0};
+		setsockopt(m_collector, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+	}
+
+	~Loopback()
+	{
+		close(m_collector);
+		close(m_sender);
+	}
+
+	// SyslogContext::flush(), returns the number of datagrams sent
+	uint32_t flush(SyslogQueue &queue)
+	{
+		SyslogQueue::Header header;
+		char record[SYSLOG_RECORD_MAX + 1];
+		char message[SYSLOG_RECORD_MAX + 128];
+		uint32_t sent = 0;
+
+		while (queue.pop(header, record)) {
+			size_t len = SyslogQueue::format(header, record, HOST_NAME, message, sizeof(message));
+			CHECK(sendto(m_sender, message, len, 0, (struct sockaddr *)&m_addr, sizeof(m_addr)) == (ssize_t)len);
+			sent++;
+		}
+		return sent;
+	}
+
+	// next datagram, empty on timeout
+	std::string receive()
+	{
+		char buf[2048];
+		ssize_t len = recv(m_collector, buf, sizeof(buf), 0);
+		return (len > 0) ? std::string(buf, len) : std::string();
+	}
+};
+
+// <PRI>VERSION SP TIMESTAMP SP HOSTNAME SP APP-NAME SP PROCID SP MSGID SP SD SP MSG
+static bool parse(const std::string &message, std::string &timestamp, std::string &text)
+{
+	const char *prefix = "<14>1 ";
+	if (message.compare(0, strlen(prefix), prefix)) {
+		return false;
+	}
+
+	size_t pos = strlen(prefix);
+	std::string fields[6];
+	for (int i = 0; i < 6; i++) {
+		size_t end = message.find(' ', pos);
+		if (end == std::string::npos) {
+			return false;
+		}
+		fields[i] = message.substr(pos, end - pos);
+		pos = end + 1;
+	}
+
+	timestamp = fields[0];
+	text = message.substr(pos);
+	return fields[1] == HOST_NAME && fields[2] == "buzzer" && fields[3] == "-" && fields[4] == "-" && fields[5] == "-" &&
+		message.find('\n') == std::string::npos;
+}
+
+static void messages()
+{
+	printf("messages\n");
+	Loopback loopback;
+	SyslogQueue queue;
+
+	CHECK(queue.push("boot\n", 0, false, 100));
+	CHECK(queue.push("synced", UTC_MS, true, 200));
+	CHECK_EQ(queue.pendingSince(), 100);
+
+	std::string longText(SYSLOG_RECORD_MAX + 50, 'x');
+	CHECK(queue.push(longText.c_str(), UTC_MS + 1000, true, 300));
+
+	CHECK_EQ(loopback.flush(queue), 3);
+	CHECK_EQ(queue.used(), 0);
+
+	std::string timestamp, text;
+	CHECK(parse(loopback.receive(), timestamp, text));
+	CHECK(timestamp == "-");
+	CHECK(text == "boot");
+
+	CHECK(parse(loopback.receive(), timestamp, text));
+	CHECK(timestamp == "2025-01-31T12:34:56.789Z");
+	CHECK(text == "synced");
+
+	CHECK(parse(loopback.receive(), timestamp, text));
+	CHECK(timestamp == "2025-01-31T12:34:57.789Z");
+	CHECK(text == longText.substr(0, SYSLOG_RECORD_MAX));
+}
+
+// a full buffer drops, records queued across the wrap of the ring arrive intact
+static void fullBuffer()
+{
+	printf("fullBuffer\n");
+	Loopback loopback;
+	SyslogQueue queue;
+	char text[64];
+
+	uint32_t queued = 0;
+	for (uint32_t i = 0; ; i++) {
+		snprintf(text, sizeof(text), "record %05u", i);
+		if (!queue.push(text, UTC_MS + i, true, i)) {
+			break;
+		}
+		queued++;
+	}
+	CHECK(queued > 0);
+	CHECK(queue.used() <= SYSLOG_BUFFER_SIZE);
+
+	uint32_t numReceived = 0;
+	for (uint32_t round = 0; round < 3; round++) {
+		uint32_t first = numReceived;
+		CHECK_EQ(loopback.flush(queue), queued);
+
+		for (uint32_t i = 0; i < queued; i++) {
+			std::string timestamp, received;
+			CHECK(parse(loopback.receive(), timestamp, received));
+			snprintf(text, sizeof(text), "record %05u", first + i);
+			CHECK(received == text);
+			numReceived++;
+		}
+
+		// the same amount again, now wrapping around the end of the ring
+		for (uint32_t i = 0; i < queued; i++) {
+			snprintf(text, sizeof(text), "record %05u", numReceived + i);
+			CHECK(queue.push(text, UTC_MS, true, 0));
+		}
+	}
+	printf("  %u records, %u per full buffer, one datagram each\n", numReceived, queued);
+}
+
+int main()
+{
+	messages();
+	fullBuffer();
+	return hostTestResult("test_syslog");
+}
@@ -0,0 +1,115 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "timezone.h"
+#include "hostTest.h"
+
+//
+// Timezone against glibc: the same POSIX TZ strings through tzset() and
+// localtime_r(), 2020 to 2030, hourly and to the second at each transition.
+// The window is refreshed like the firmware does, only once the next
+// transition has passed.
+//
+
+static const char *g_zones[] = {
+	"CET-1CEST,M3.5.0,M10.5.0/3",			// Europe/Prague
+	"GMT0BST,M3.5.0/1,M10.5.0",				// Europe/London
+	"EST5EDT,M3.2.0,M11.1.0",				// America/New_York
+	"AEST-10AEDT,M10.1.0,M4.1.0/3",			// Australia/Sydney, DST over the new year
+	"NZST-12NZDT,M9.5.0,M4.1.0/3",			// Pacific/Auckland
+	"<-04>4<-03>,M9.1.6/24,M4.1.6/24",		// America/Santiago, transitions at 24:00
+	"<+0330>-3:30<+0430>,J79/24,J263/24",	// Asia/Tehran before 2022, julian days
+	"IST-5:30",								// Asia/Kolkata, no DST
+	"<-03>3",								// America/Sao_Paulo, no DST
+};
+
+#define START_S 1577836800LL	// 2020-01-01 00:00:00 UTC
+#define END_S 1924992000LL		// 2031-01-01 00:00:00 UTC
+
+static long glibcOffsetS(const int64_t &utcS)
+{
+	time_t t = utcS;
+	struct tm tm;
+	localtime_r(&t, &tm);
+	return tm.tm_gmtoff;
+}
+
+// the first second at which glibc uses the new offset, between lo and hi
+static int64_t glibcTransitionS(int64_t lo, int64_t hi)
+{
+	long before = glibcOffsetS(lo);
+	while (hi - lo > 1) {
+		int64_t mid = lo + (hi - lo) / 2;
+		if (glibcOffsetS(mid) == before) {
+			lo = mid;
+		} else {
+			hi = mid;
+		}
+	}
+	return hi;
+}
+
+static void compareZone(const char *tz)
+{
+	setenv("TZ", tz, 1);
+	tzset();
+
+	Timezone zone;
+	CHECK(zone.parse(tz));
+
+	uint32_t samples = 0;
+	uint32_t mismatches = 0;
+	uint32_t transitions = 0;
+	Timezone::Window window = zone.window(START_S * 1000);
+
+	for (int64_t s = START_S; s < END_S; s += 3600) {
+		int64_t ms = s * 1000;
+		if (ms >= window.m_nextTransitionMs) {
+			// toLocalMs() covers the one transition until the refresh
+			CHECK_EQ(Timezone::toLocalMs(window, ms) - ms, window.m_nextOffsetS * 1000LL);
+			window = zone.window(ms);
+		}
+
+		long expected = glibcOffsetS(s);
+		if (Timezone::toLocalMs(window, ms) - ms != expected * 1000LL) {
+			if (mismatches++ < 3) {
+				printf("  %s at %lld: offset %lld s, glibc %ld s\n", tz, (long long)s, (long long)(Timezone::toLocalMs(window, ms) - ms) / 1000, expected);
+			}
+		}
+		samples++;
+
+		// to the second around each glibc transition in the next hour
+		if (s + 3600 < END_S && glibcOffsetS(s + 3600) != expected) {
+			int64_t at = glibcTransitionS(s, s + 3600);
+			Timezone::Window before = zone.window((at - 1) * 1000);
+			CHECK_EQ(before.m_nextTransitionMs, at * 1000);
+			CHECK_EQ(Timezone::toLocalMs(before, (at - 1) * 1000) - (at - 1) * 1000, glibcOffsetS(at - 1) * 1000LL);
+			CHECK_EQ(Timezone::toLocalMs(before, at * 1000) - at * 1000, glibcOffsetS(at) * 1000LL);
+			transitions++;
+		}
+	}
+
+	CHECK_EQ(mismatches, 0);
+	printf("  %-36s %u samples, %u transitions, %u mismatches\n", tz, samples, transitions, mismatches);
+}
+
+static void parseErrors()
+{
+	Timezone zone;
+	CHECK(!zone.parse(""));
+	CHECK(!zone.parse("CET"));
+	CHECK(!zone.parse("CET-1CEST,M3.5.0"));
+	CHECK(!zone.parse("CET-1CEST,M13.5.0,M10.5.0/3"));
+	CHECK(zone.parse("UTC0"));
+	CHECK_EQ(zone.window(START_S * 1000).m_offsetS, 0);
+	CHECK_EQ(zone.window(START_S * 1000).m_nextTransitionMs, INT64_MAX);
+}
+
+int main()
+{
+	for (size_t i = 0; i < sizeof(g_zones) / sizeof(g_zones[0]); i++) {
+		compareZone(g_zones[i]);
+	}
+	parseErrors();
+	return hostTestResult("test_timezone");
+}
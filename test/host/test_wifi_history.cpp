@@ -0,0 +1,157 @@
+#include <string.h>
+#include "WiFiHistory.h"
+#include "hostTest.h"
+
+//
+// Moving averages, saturation, the LRU replacement and the fast reconnect
+// veto of WiFiHistory
+//
+
+#define HASH 0x12345678
+
+static const uint8_t g_bssidA[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+static const uint8_t g_bssidB[6] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x77};
+
+static void movingAverages()
+{
+	WiFiHistory history;
+	CHECK(!history.find(HASH, g_bssidA));
+	CHECK(!history.takeDirty());
+
+	// the first sample is taken as is, then each one counts 1/WIFI_HISTORY_WEIGHT
+	history.reportConnect(HASH, g_bssidA, 800);
+	const WiFiHistory::Entry *entry = history.find(HASH, g_bssidA);
+	CHECK(entry);
+	CHECK(history.takeDirty());
+	CHECK(!history.takeDirty());
+	CHECK_EQ(entry->m_connectMs, 800);
+	CHECK_EQ(entry->m_failPermille, 0);
+	CHECK_EQ(entry->m_attempts, 1);
+
+	history.reportConnect(HASH, g_bssidA, 400);
+	CHECK_EQ(entry->m_connectMs, 800 - 400 / WIFI_HISTORY_WEIGHT);
+
+	history.reportFailure(HASH, g_bssidA);
+	CHECK_EQ(entry->m_failPermille, 1000 / WIFI_HISTORY_WEIGHT);
+	CHECK_EQ(entry->m_connectMs, 800 - 400 / WIFI_HISTORY_WEIGHT);
+	CHECK_EQ(entry->m_attempts, 3);
+
+	// a failure first counts fully
+	history.reportFailure(HASH, g_bssidB);
+	CHECK_EQ(history.find(HASH, g_bssidB)->m_failPermille, 1000);
+	CHECK_EQ(history.find(HASH, g_bssidB)->m_connectMs, 0);
+
+	// connect times of 0 ms would read as no success yet
+	WiFiHistory zero;
+	zero.reportConnect(HASH, g_bssidA, 0);
+	CHECK_EQ(zero.find(HASH, g_bssidA)->m_connectMs, 1);
+
+	history.reportSession(HASH, g_bssidA, 1200);
+	history.reportSession(HASH, g_bssidA, 0);
+	CHECK_EQ(entry->m_sessions, 2);
+	CHECK_EQ(entry->m_sessionS, 1200 - 1200 / WIFI_HISTORY_WEIGHT);
+}
+
+static void saturation()
+{
+	WiFiHistory history;
+	for (uint32_t i = 0; i < 0x10005; i++) {
+		history.reportFailure(HASH, g_bssidA);
+		history.reportSession(HASH, g_bssidA, 10);
+	}
+	const WiFiHistory::Entry *entry = history.find(HASH, g_bssidA);
+	CHECK_EQ(entry->m_attempts, 0xffff);
+	CHECK_EQ(entry->m_sessions, 0xffff);
+	CHECK_EQ(entry->m_failPermille, 1000);
+}
+
+static void eviction()
+{
+	WiFiHistory history;
+	uint8_t bssid[6] = {0};
+
+	for (uint8_t i = 0; i < WIFI_HISTORY_SIZE; i++) {
+		bssid[5] = i;
+		history.reportConnect(HASH, bssid, 500);
+	}
+
+	// entry 0 is used again, entry 1 is now the least recently used one
+	bssid[5] = 0;
+	history.reportConnect(HASH, bssid, 500);
+
+	bssid[5] = WIFI_HISTORY_SIZE;
+	history.reportFailure(HASH, bssid);
+	const WiFiHistory::Entry *entry = history.find(HASH, bssid);
+	CHECK(entry);
+	CHECK_EQ(entry->m_attempts, 1);
+	CHECK_EQ(entry->m_connectMs, 0);
+
+	bssid[5] = 1;
+	CHECK(!history.find(HASH, bssid));
+	for (uint8_t i = 0; i <= WIFI_HISTORY_SIZE; i++) {
+		bssid[5] = i;
+		CHECK_EQ(history.find(HASH, bssid) != NULL, i != 1);
+	}
+
+	// the same BSSID in another network is another entry
+	bssid[5] = 0;
+	CHECK(!history.find(HASH + 1, bssid));
+}
+
+static void fastReconnectVeto()
+{
+	WiFiHistory history;
+
+	// unknown, or too few attempts to judge
+	CHECK(history.fastReconnectAllowed(HASH, g_bssidA));
+	for (uint8_t i = 1; i < WIFI_HISTORY_MIN_ATTEMPTS; i++) {
+		history.reportFailure(HASH, g_bssidA);
+		CHECK(history.fastReconnectAllowed(HASH, g_bssidA));
+	}
+	history.reportFailure(HASH, g_bssidA);
+	CHECK(!history.fastReconnectAllowed(HASH, g_bssidA));
+
+	// successes bring the failure rate back below the limit
+	uint8_t successes = 0;
+	while (!history.fastReconnectAllowed(HASH, g_bssidA) && successes < 10) {
+		history.reportConnect(HASH, g_bssidA, 500);
+		successes++;
+	}
+	CHECK_EQ(successes, 3);
+	CHECK(history.find(HASH, g_bssidA)->m_failPermille <= WIFI_HISTORY_FAST_MAX_FAIL_PERMILLE);
+}
+
+static void score()
+{
+	WiFiHistory history;
+
+	// no history, no penalty
+	CHECK_EQ(history.score(HASH, g_bssidA, -60), -60);
+
+	// connect time only: 1 dB per WIFI_HISTORY_CONNECT_MS_PER_DB, capped
+	history.reportConnect(HASH, g_bssidA, 3 * WIFI_HISTORY_CONNECT_MS_PER_DB);
+	CHECK_EQ(history.score(HASH, g_bssidA, -60), -63);
+	history.reportConnect(HASH, g_bssidB, 100 * WIFI_HISTORY_CONNECT_MS_PER_DB);
+	CHECK_EQ(history.score(HASH, g_bssidB, -60), -60 - WIFI_HISTORY_CONNECT_PENALTY_DB);
+
+	// all attempts failed, sessions of 0 s
+	WiFiHistory bad;
+	bad.reportFailure(HASH, g_bssidA);
+	bad.reportSession(HASH, g_bssidA, 0);
+	CHECK_EQ(bad.score(HASH, g_bssidA, -60), -60 - WIFI_HISTORY_FAIL_PENALTY_DB - WIFI_HISTORY_SESSION_PENALTY_DB);
+
+	// long sessions cost nothing
+	WiFiHistory good;
+	good.reportSession(HASH, g_bssidA, WIFI_HISTORY_SHORT_SESSION_S);
+	CHECK_EQ(good.score(HASH, g_bssidA, -60), -60);
+}
+
+int main()
+{
+	movingAverages();
+	saturation();
+	eviction();
+	fastReconnectVeto();
+	score();
+	return hostTestResult("test_wifi_history");
+}
@@ -0,0 +1,239 @@
+#include <string.h>
+#include "WiFiSimDriver.h"
+#include "WiFiMultiSSID.h"
+#include "hostTest.h"
+
+//
+// WiFiMultiSSID against a simulated environment: two access points of the
+// same network on channels 6 and 11. Every scenario starts from a first
+// connect (a full scan, the cache is empty) and prints the time to connect
+// of the step it is about.
+//
+
+#define SSID "home"
+#define PASSWORD "password1"
+#define BSSID_A 0x112233445566ULL
+#define BSSID_B 0x112233445577ULL
+
+#define RETRIES 3
+#define TIMEOUT_MS 10000
+
+struct Setup {
+	WiFiSimDriver m_sim;
+	WiFiMultiSSID m_multi;
+	size_t m_a;
+	size_t m_b;
+
+	Setup()
+		: m_multi(m_sim)
+	{
+		m_a = m_sim.addAP(SSID, PASSWORD, BSSID_A, 6);
+		m_b = m_sim.addAP(SSID, PASSWORD, BSSID_B, 11, 400, 300);
+		m_sim.setRssi(m_a, 0, -55);
+		m_sim.setRssi(m_b, 0, -65);
+		m_multi.addAP(SSID, PASSWORD);
+
+		uint32_t startMs = m_sim.millis();
+		CHECK_EQ(m_multi.connect(0, RETRIES, TIMEOUT_MS), WL_CONNECTED);
+		CHECK_EQ(m_multi.scanStats().m_fullScans, 1);
+		CHECK(connectedTo(m_a));
+		printf("  first connect (full scan): %u ms\n", m_sim.millis() - startMs);
+	}
+
+	bool connectedTo(const size_t &ap)
+	{
+		uint8_t bssid[6];
+		return m_sim.status() == WL_CONNECTED && m_sim.bssid(bssid) && !memcmp(bssid, m_sim.ap(ap).m_bssid, 6);
+	}
+
+	WiFiMultiSSID::LastParams params(const size_t &ap)
+	{
+		WiFiMultiSSID::LastParams params;
+		strcpy(params.m_credentials.m_ssid, SSID);
+		strcpy(params.m_credentials.m_password, PASSWORD);
+		memcpy(params.m_bssid, m_sim.ap(ap).m_bssid, 6);
+		params.m_channel = m_sim.ap(ap).m_channel;
+		return params;
+	}
+
+	// the reconnect of the WiFi task: the last BSSID first, then a scan
+	uint8_t reconnect(const WiFiMultiSSID::LastParams &last)
+	{
+		uint8_t status = m_multi.fastReconnect(last, 0, RETRIES, TIMEOUT_MS, WIFI_FAST_AUTH_DEADLINE_MS);
+		if (status != WL_CONNECTED) {
+			status = m_multi.connect(0, RETRIES, TIMEOUT_MS);
+		}
+		return status;
+	}
+};
+
+// the cached BSSID went away while we were disconnected
+static void fastReconnectVanished()
+{
+	printf("fast reconnect to a vanished BSSID\n");
+	Setup setup;
+	WiFiSimDriver &sim = setup.m_sim;
+
+	sim.advance(10000);
+	sim.disconnect();
+	sim.setRssi(setup.m_a, sim.millis(), -127);
+
+	uint32_t startMs = sim.millis();
+	CHECK_EQ(setup.reconnect(setup.params(setup.m_a)), WL_CONNECTED);
+	uint32_t connectMs = sim.millis() - startMs;
+	printf("  reconnect: %u ms\n", connectMs);
+
+	// given up at the deadline instead of the 3 s the radio takes, then a
+	// targeted scan found the other access point
+	CHECK(setup.connectedTo(setup.m_b));
+	CHECK_EQ(setup.m_multi.scanStats().m_authTimeouts, 1);
+	CHECK_EQ(setup.m_multi.scanStats().m_targetedHits, 1);
+	CHECK(connectMs < sim.timing().m_noApMs);
+	CHECK_EQ(sim.stats().m_rejectedScans, 0);
+}
+
+// the network is where the cache says, two channels are scanned instead of all
+static void targetedScanHit()
+{
+	printf("targeted scan hit\n");
+	Setup setup;
+	WiFiSimDriver &sim = setup.m_sim;
+
+	sim.advance(10000);
+	sim.disconnect();
+
+	uint32_t startMs = sim.millis();
+	CHECK_EQ(setup.m_multi.connect(0, RETRIES, TIMEOUT_MS), WL_CONNECTED);
+	uint32_t connectMs = sim.millis() - startMs;
+	printf("  connect: %u ms, scan %u ms\n", connectMs, setup.m_multi.scanStats().m_lastScanMs);
+
+	const WiFiMultiSSID::ScanStats &stats = setup.m_multi.scanStats();
+	CHECK(setup.connectedTo(setup.m_a));
+	CHECK_EQ(stats.m_targetedScans, 1);
+	CHECK_EQ(stats.m_targetedHits, 1);
+	CHECK_EQ(stats.m_fullScans, 1);
+	CHECK_EQ(stats.m_lastChannels, (1 << 6) | (1 << 11));
+
+	// the strong one on channel 6 stopped the scan before channel 11
+	CHECK_EQ(stats.m_earlyStops, 1);
+	CHECK(stats.m_lastScanMs < WIFI_SIM_MAX_CHANNEL * sim.timing().m_fullScanMsPerChannel);
+}
+
+// both access points moved to other channels, the targeted scan comes up
+// empty and the full scan finds them
+static void fullScanFallback()
+{
+	printf("full scan fallback\n");
+	Setup setup;
+	WiFiSimDriver &sim = setup.m_sim;
+
+	sim.advance(10000);
+	sim.disconnect();
+	sim.ap(setup.m_a).m_channel = 1;
+	sim.ap(setup.m_b).m_channel = 3;
+
+	uint32_t startMs = sim.millis();
+	CHECK_EQ(setup.m_multi.connect(0, RETRIES, TIMEOUT_MS), WL_CONNECTED);
+	uint32_t connectMs = sim.millis() - startMs;
+	printf("  connect: %u ms\n", connectMs);
+
+	const WiFiMultiSSID::ScanStats &stats = setup.m_multi.scanStats();
+	CHECK(setup.connectedTo(setup.m_a));
+	CHECK_EQ(sim.channel(), 1);
+	CHECK_EQ(stats.m_targetedScans, 1);
+	CHECK_EQ(stats.m_targetedHits, 0);
+	CHECK_EQ(stats.m_fullScans, 2);
+	CHECK_EQ(stats.m_lastChannels, 0);
+}
+
+// the configuration portal replaced the credentials, the cached access
+// points of the old network must not be tried any more
+static void newCredentials()
+{
+	printf("new credentials\n");
+	Setup setup;
+	WiFiSimDriver &sim = setup.m_sim;
+
+	size_t office = sim.addAP("office", "password2", 0x112233445588ULL, 1);
+	sim.setRssi(office, 0, -70);
+
+	sim.advance(10000);
+	sim.disconnect();
+	setup.m_multi.clearAPs();
+	CHECK(setup.m_multi.addAP("office", "password2"));
+
+	uint32_t startMs = sim.millis();
+	CHECK_EQ(setup.m_multi.connect(0, RETRIES, TIMEOUT_MS), WL_CONNECTED);
+	printf("  connect: %u ms\n", sim.millis() - startMs);
+
+	const WiFiMultiSSID::ScanStats &stats = setup.m_multi.scanStats();
+	CHECK(setup.connectedTo(office));
+	CHECK_EQ(stats.m_targetedScans, 0);
+	CHECK_EQ(stats.m_fullScans, 2);
+}
+
+// the link got weak, the background scan of the WiFi task finds the other
+// access point and we move over without a scan of our own
+static void roam()
+{
+	printf("roam\n");
+	Setup setup;
+	WiFiSimDriver &sim = setup.m_sim;
+
+	sim.advance(10000);
+	sim.setRssi(setup.m_a, sim.millis(), -80);
+
+	// not yet stronger by the hysteresis
+	sim.setRssi(setup.m_b, sim.millis(), -80 + WIFI_ROAM_HYSTERESIS_DB - 1);
+	WiFiMultiSSID::LastParams candidate;
+	CHECK(sim.scanStart(0, 0));
+	sim.advance(WIFI_SIM_MAX_CHANNEL * sim.timing().m_fullScanMsPerChannel);
+	CHECK(!setup.m_multi.findRoamCandidate(WIFI_ROAM_HYSTERESIS_DB, candidate));
+	sim.scanDelete();
+
+	sim.setRssi(setup.m_b, sim.millis(), -60);
+	CHECK(sim.scanStart(0, 0));
+	sim.advance(WIFI_SIM_MAX_CHANNEL * sim.timing().m_fullScanMsPerChannel);
+	CHECK(setup.m_multi.findRoamCandidate(WIFI_ROAM_HYSTERESIS_DB, candidate));
+	sim.scanDelete();
+	CHECK(!memcmp(candidate.m_bssid, sim.ap(setup.m_b).m_bssid, 6));
+	CHECK_EQ(candidate.m_channel, 11);
+
+	// the WiFi task starts a session on every connect
+	setup.m_multi.sessionStart();
+	CHECK(!setup.m_multi.linkLost());
+
+	uint32_t startMs = sim.millis();
+	uint32_t attempts = sim.stats().m_attempts;
+	setup.m_multi.sessionEnd(false);
+	setup.m_multi.begin(candidate);
+	while (sim.status() != WL_CONNECTED && sim.millis() - startMs < TIMEOUT_MS) {
+		sim.delay(10);
+	}
+	uint32_t downtimeMs = sim.millis() - startMs;
+	printf("  roam: %u ms\n", downtimeMs);
+
+	CHECK(setup.connectedTo(setup.m_b));
+	CHECK_EQ(downtimeMs, sim.ap(setup.m_b).m_authMs + sim.ap(setup.m_b).m_dhcpMs);
+	CHECK_EQ(sim.stats().m_rejectedScans, 0);
+
+	// leaving A is part of the roam, the WiFi task must not reconnect
+	setup.m_multi.sessionStart();
+	CHECK(!setup.m_multi.linkLost());
+	CHECK_EQ(sim.stats().m_attempts, attempts + 1);
+
+	// losing B afterwards is a lost link
+	sim.setRssi(setup.m_b, sim.millis(), -127);
+	sim.advance(10);
+	CHECK(setup.m_multi.linkLost());
+}
+
+int main()
+{
+	fastReconnectVanished();
+	targetedScanHit();
+	fullScanFallback();
+	newCredentials();
+	roam();
+	return hostTestResult("test_wifi_sim");
+}
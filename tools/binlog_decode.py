@@ -0,0 +1,162 @@
+#!/usr/bin/env python3
+#
+# Decoder for the binary log served by the buzzer at /binlog (see src/utils/binlog.h).
+#
+# Usage:
+#   curl -s http://<buzzer>/binlog -o binlog.bin
+#   tools/binlog_decode.py .pio/build/m5stamp/firmware.elf binlog.bin
+#
+# The format strings are not part of the dump, only their addresses. They are
+# looked up in the sections of the ELF file the dump was produced by.
+#
+# Tests: tools/test_binlog_decode.py (also run by make -C test/host test)
+#
+
+import re
+import struct
+import sys
+
+BINLOG_MAGIC = 0xB1
+BINLOG_HEADER_WORDS = 3
+BINLOG_DUMP_MAGIC = 0x31474C42
+
+SHT_PROGBITS = 1
+
+# printf conversion: flags, width, precision, length, conversion
+SPEC_RE = re.compile(r'%([-+ #0]*)(\d+|\*)?(?:\.(\d+|\*))?(hh|h|ll|l|j|z|t|L)?([diouxXcspfFeEgGaA%])')
+
+
+class Elf:
+	def __init__(self, data):
+		if data[:4] != b'\x7fELF' or data[4] != 1 or data[5] != 1:
+			raise ValueError('only little endian ELF32 files are supported')
+
+		self.data = data
+		self.sections = []
+
+		shoff, = struct.unpack_from('<I', data, 0x20)
+		shentsize, shnum = struct.unpack_from('<HH', data, 0x2E)
+
+		for i in range(shnum):
+			_, shtype, _, addr, offset, size = struct.unpack_from('<IIIIII', data, shoff + i * shentsize)
+			if shtype == SHT_PROGBITS and addr and size:
+				self.sections.append((addr, offset, size))
+
+	def string(self, addr):
+		for base, offset, size in self.sections:
+			if base <= addr < base + size:
+				start = offset + addr - base
+				end = self.data.index(b'\0', start, offset + size)
+				return self.data[start:end].decode('utf-8', 'replace')
+		return None
+
+
+def signed(value, bits):
+	return value - (1 << bits) if value & (1 << (bits - 1)) else value
+
+
+def format_record(elf, fmt, words):
+	out = []
+	pos = 0
+	args = list(words)
+
+	def take(count):
+		if len(args) < count:
+			raise ValueError('not enough arguments recorded')
+		value = 0
+		for i in range(count):
+			value |= args.pop(0) << (32 * i)
+		return value
+
+	for m in SPEC_RE.finditer(fmt):
+		out.append(fmt[pos:m.start()])
+		pos = m.end()
+
+		flags, width, precision, length, conv = m.groups()
+		if conv == '%':
+			out.append('%')
+			continue
+
+		if width == '*':
+			width = str(signed(take(1), 32))
+		if precision == '*':
+			precision = str(signed(take(1), 32))
+
+		spec = '%' + (flags or '') + (width or '') + ('.' + precision if precision is not None else '')
+		wide = length in ('ll', 'j')
+
+		if conv in 'fFeEgGaA':
+			value, = struct.unpack('<d', struct.pack('<Q', take(2)))
+			out.append((spec + ('f' if conv in 'aA' else conv)) % value)
+		elif conv in 'di':
+			out.append((spec + 'd') % signed(take(2 if wide else 1), 64 if wide else 32))
+		elif conv in 'ouxX':
+			out.append((spec + ('d' if conv == 'u' else conv)) % take(2 if wide else 1))
+		elif conv == 'c':
+			out.append((spec + 'c') % chr(take(1) & 0xFF))
+		elif conv == 'p':
+			out.append('0x%08x' % take(1))
+		elif conv == 's':
+			addr = take(1)
+			text = elf.string(addr)
+			out.append((spec + 's') % (text if text is not None else '<ptr 0x%08x>' % addr))
+
+	out.append(fmt[pos:])
+	return ''.join(out)
+
+
+def decode(elf, dump):
+	if len(dump) < 8:
+		raise ValueError('dump too short')
+
+	magic, dropped = struct.unpack_from('<II', dump, 0)
+	if magic != BINLOG_DUMP_MAGIC:
+		raise ValueError('not a binlog dump')
+
+	words = struct.unpack_from('<%dI' % ((len(dump) - 8) // 4), dump, 8)
+	lines = []
+
+	if dropped:
+		lines.append('<%d records dropped>' % dropped)
+
+	i = 0
+	while i + BINLOG_HEADER_WORDS <= len(words):
+		header, addr, ts = words[i:i + BINLOG_HEADER_WORDS]
+		if (header >> 24) != BINLOG_MAGIC:
+			raise ValueError('corrupted record at word %d' % i)
+
+		num_args = (header >> 16) & 0xFF
+		args = words[i + BINLOG_HEADER_WORDS:i + BINLOG_HEADER_WORDS + num_args]
+		i += BINLOG_HEADER_WORDS + num_args
+
+		fmt = elf.string(addr)
+		if fmt is None:
+			text = '<unknown format 0x%08x> %s\n' % (addr, ' '.join('%08x' % a for a in args))
+		else:
+			try:
+				text = format_record(elf, fmt, args)
+			except ValueError as e:
+				text = '<%s: %r>\n' % (e, fmt)
+
+		lines.append('%10u.%03u [%5u]: %s' % (ts // 1000, ts % 1000, header & 0xFFFF, text.rstrip('\n')))
+
+	return lines
+
+
+def main():
+	if len(sys.argv) != 3:
+		print('usage: %s <firmware.elf> <binlog.bin>' % sys.argv[0], file=sys.stderr)
+		return 1
+
+	with open(sys.argv[1], 'rb') as f:
+		elf = Elf(f.read())
+	with open(sys.argv[2], 'rb') as f:
+		dump = f.read()
+
+	for line in decode(elf, dump):
+		print(line)
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
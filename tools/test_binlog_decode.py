@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+#
+# Tests of binlog_decode.py against a minimal ELF file and crafted dumps.
+#
+# Usage:
+#   python3 tools/test_binlog_decode.py
+#
+
+import os
+import struct
+import sys
+import unittest
+
+sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+
+import binlog_decode as bd
+
+RODATA_ADDR = 0x3F400000
+
+
+class Image:
+	"""ELF32 with the given strings in a .rodata like PROGBITS section"""
+
+	def __init__(self, strings):
+		self.addr = {}
+		rodata = b''
+		for s in strings:
+			self.addr[s] = RODATA_ADDR + len(rodata)
+			rodata += s.encode() + b'\0'
+
+		ehdr_size = 52
+		shdr_size = 40
+		data_offset = ehdr_size
+		shoff = (data_offset + len(rodata) + 3) & ~3
+
+		sections = [
+			struct.pack('<10I', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0),
+			struct.pack('<10I', 0, bd.SHT_PROGBITS, 2, RODATA_ADDR, data_offset, len(rodata), 0, 0, 4, 0),
+			# not loaded (address 0), must be ignored
+			struct.pack('<10I', 0, bd.SHT_PROGBITS, 0, 0, data_offset, len(rodata), 0, 0, 1, 0),
+		]
+
+		ident = b'\x7fELF' + bytes([1, 1, 1]) + bytes(9)
+		ehdr = ident + struct.pack('<HHIIIIIHHHHHH', 2, 94, 1, 0, 0, shoff, 0, ehdr_size, 0, 0, shdr_size, len(sections), 0)
+		assert len(ehdr) == ehdr_size
+
+		self.data = ehdr + rodata + bytes(shoff - data_offset - len(rodata)) + b''.join(sections)
+
+
+def record(addr, args, seq=1, ts=12345):
+	return [(bd.BINLOG_MAGIC << 24) | (len(args) << 16) | seq, addr, ts] + list(args)
+
+
+def dump(records, dropped=0, magic=bd.BINLOG_DUMP_MAGIC):
+	words = [w for r in records for w in r]
+	return struct.pack('<II%dI' % len(words), magic, dropped, *words)
+
+
+def u64(value):
+	value &= (1 << 64) - 1
+	return [value & 0xFFFFFFFF, value >> 32]
+
+
+def f64(value):
+	return u64(struct.unpack('<Q', struct.pack('<d', value))[0])
+
+
+class DecodeTest(unittest.TestCase):
+	def decode(self, image, records, dropped=0):
+		return bd.decode(bd.Elf(image.data), dump(records, dropped))
+
+	def text(self, fmt, args, extra=()):
+		image = Image([fmt] + list(extra))
+		lines = self.decode(image, [record(image.addr[fmt], args)])
+		self.assertEqual(len(lines), 1)
+		return lines[0].split(': ', 1)[1]
+
+	def test_header(self):
+		image = Image(['x\n'])
+		lines = self.decode(image, [record(image.addr['x\n'], [], seq=7, ts=61234)])
+		self.assertEqual(lines, ['        61.234 [    7]: x'])
+
+	def test_integers(self):
+		self.assertEqual(self.text('%d %d', [5, 0xFFFFFFFB]), '5 -5')
+		self.assertEqual(self.text('%u', [0xFFFFFFFF]), '4294967295')
+		self.assertEqual(self.text('%08x %X', [0xBEEF, 0xAB]), '0000beef AB')
+		self.assertEqual(self.text('%llx', u64(0x123456789ABCDEF0)), '123456789abcdef0')
+		self.assertEqual(self.text('%lld', u64(-2)), '-2')
+		self.assertEqual(self.text('%c%%', [ord('A')]), 'A%')
+
+	def test_float(self):
+		self.assertEqual(self.text('%f', f64(1.5)), '1.500000')
+		self.assertEqual(self.text('%.2f ms', f64(-0.125)), '-0.12 ms')
+
+	def test_string(self):
+		self.assertEqual(self.text('ssid %s', [RODATA_ADDR + len('ssid %s') + 1], extra=['home']), 'ssid home')
+		self.assertEqual(self.text('[%-6s]', [RODATA_ADDR + len('[%-6s]') + 1], extra=['ab']), '[ab    ]')
+
+		# a string on the heap or stack can't be decoded
+		self.assertEqual(self.text('%s', [0x3FFB0000]), '<ptr 0x3ffb0000>')
+
+	def test_star(self):
+		self.assertEqual(self.text('[%*d]', [5, 42]), '[   42]')
+		self.assertEqual(self.text('[%-*d]', [4, 7]), '[7   ]')
+		self.assertEqual(self.text('%.*f', [3] + f64(3.14159)), '3.142')
+
+	def test_missing_arguments(self):
+		self.assertEqual(self.text('%d %d\n', [1]), "<not enough arguments recorded: '%d %d\\n'>")
+
+	def test_dropped(self):
+		image = Image(['a', 'b'])
+		lines = self.decode(image, [record(image.addr['a'], []), record(image.addr['b'], [])], dropped=3)
+		self.assertEqual(lines[0], '<3 records dropped>')
+		self.assertEqual([line.split(': ', 1)[1] for line in lines[1:]], ['a', 'b'])
+
+		# no marker without drops
+		self.assertEqual(len(self.decode(image, [record(image.addr['a'], [])])), 1)
+
+	def test_unknown_format(self):
+		image = Image(['a'])
+		lines = self.decode(image, [record(0x400D1234, [1, 0xFF]), record(image.addr['a'], [])])
+		self.assertEqual(lines[0].split(': ', 1)[1], '<unknown format 0x400d1234> 00000001 000000ff')
+		self.assertEqual(lines[1].split(': ', 1)[1], 'a')
+
+	def test_corrupted(self):
+		image = Image(['a'])
+		elf = bd.Elf(image.data)
+
+		with self.assertRaisesRegex(ValueError, 'not a binlog dump'):
+			bd.decode(elf, dump([record(image.addr['a'], [])], magic=0x12345678))
+
+		with self.assertRaisesRegex(ValueError, 'dump too short'):
+			bd.decode(elf, b'BLG1')
+
+		words = record(image.addr['a'], [])
+		words[0] &= 0x00FFFFFF
+		with self.assertRaisesRegex(ValueError, 'corrupted record at word 0'):
+			bd.decode(elf, dump([words]))
+
+		# a record cut off at the end of the dump is not decoded
+		self.assertEqual(bd.decode(elf, dump([record(image.addr['a'], [])])[:-4]), [])
+
+	def test_not_elf32(self):
+		with self.assertRaises(ValueError):
+			bd.Elf(b'\x7fELF' + bytes([2, 1]) + bytes(64))
+
+
+if __name__ == '__main__':
+	unittest.main()